@@ -7,7 +7,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#define WORD_COUNT 8
+#define WORD_COUNT 1024
+
+/* 64 bit words on the heap, for the 64 bit vector, multiply by word and vector lane kernels. */
+typedef struct
+{
+    uint64_t *words;
+    size_t n;
+} BigInt64;
+
+#define BIGINT_TYPE BigInt64
+#define WORD_TYPE uint64_t
+#define WORD_BITS 64
+#define GETWORD(bi, i) ((bi)->words[i])
+#define SETWORD(bi, i, word) ((bi)->words[i] = (word))
+#define GETNWORDS(bi) ((bi)->n)
+#define SETNWORDS(bi, nWords) ((bi)->n = (nWords))
+#define ZERO_BIGINT(bi) (memset((bi)->words, 0, (bi)->n * sizeof((bi)->words[0])))
+#define WORD_PTR(bi) ((bi)->words)
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 Uint128;
+    #define DOUBLE_WORD_TYPE Uint128
+#endif
+#define NUM_THEORY
+#define ALLOC_BIGINT(bi, nWords) {free((bi)->words); (bi)->n = (nWords); (bi)->words = calloc((bi)->n + 1, sizeof(uint64_t)); if (!(bi)->words) goto cleanup;}
+#define COPY_BIGINT(dst, src) {ALLOC_BIGINT(dst, (src)->n); memcpy((dst)->words, (src)->words, (src)->n * sizeof(uint64_t));}
+#define INIT_EMPTY(bi) {(bi)->n = 0; (bi)->words = NULL;}
+#define DEINIT_BIGINT(bi) {free((bi)->words);}
+#define PREFIX w64_
+#define DECLARE_STUFF
+#define DEFINE_STUFF
+#include "bigint.h"
+#undef INIT_EMPTY
+#undef DEINIT_BIGINT
 
 typedef struct
 {
@@ -70,6 +102,8 @@ void dump(const BigInt *bi, const char *header)
 #define DEINIT_BIGINT(bi)  {free((bi)->dummy);}
 #define ZERO_BIGINT(bi) (memset(bi, 0, (bi)->n * sizeof((bi)->words[0])))
 #define DUMP_BIGINT(x, y) dump(x, y)
+#define NEXTPRIME_SIEVE_PRIMES 64 /* Keeps the scratch space small and the searches go through several intervals. */
+#define NEXTPRIME_INTERVAL 64
 #define DECLARE_STUFF
 #define DEFINE_STUFF
 #include "bigint.h"
@@ -87,11 +121,78 @@ typedef struct
 #define GETNWORDS(bi) 8
 #define SETNWORDS(bi, words) (void)(words)
 #define ZERO_BIGINT(bi) (memset(bi, 0, sizeof((bi)->words)))
+#define USE_CARRY_BUILTINS 0 /* Keeps the portable carry computation tested. */
 #define PREFIX i256_
 #define DECLARE_STUFF
 #define DEFINE_STUFF
 #include "bigint.h"
 
+/* Same as the first one, but with small thresholds so the divide and conquer algorithms are exercised on small numbers.
+ * It also uses the double word multiplication and division, and the vector kernels where available. */
+#define BIGINT_TYPE BigInt
+#define GETNWORDS(bi) ((bi)->n)
+#define SETNWORDS(bi, nWords) ((bi)->n = (nWords))
+#define GETWORD(bi, i) (getWord((bi), (i)))
+#define SETWORD(bi, i, word) (setWord((bi), (i), (word)))
+#define WORD_TYPE uint32_t
+#define WORD_BITS 32
+#define ZERO_BIGINT(bi) (memset(bi, 0, (bi)->n * sizeof((bi)->words[0])))
+#define KARATSUBA_THRESHOLD 2
+#define TOOM3_THRESHOLD 5
+#define NTT_THRESHOLD 12
+#define DOUBLE_WORD_TYPE uint64_t
+#define WORD_PTR(bi) ((bi)->words)
+#define MODPOW_LANES_WINDOW 2
+#define NEXTPRIME_SIEVE_PRIMES 100
+#define NEXTPRIME_INTERVAL 40 /* Not a multiple of the word size. */
+#if (defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 34)) || defined(__APPLE__)
+    /* Runs modPowBatch and nextPrime on multiple threads. (pthreads is part of the C library there, no need for -lpthread.) */
+    #include <pthread.h>
+    #define THREAD_TYPE pthread_t
+    #define THREAD_ENTRY(name, arg) void *name(void *arg)
+    #define THREAD_RETURN return NULL
+    #define THREAD_START(thread, name, arg) pthread_create(&(thread), NULL, name, arg)
+    #define THREAD_JOIN(thread) pthread_join(thread, NULL)
+#endif
+#define PREFIX sm_
+#define DECLARE_STUFF
+#define DEFINE_STUFF
+#include "bigint.h"
+
+uint32_t testRandomState = 12345;
+
+uint32_t testRandom(void)
+{
+    /* Simple LCG, good enough to generate test numbers. */
+    testRandomState = testRandomState * 1103515245 + 12345;
+    return (testRandomState >> 16) | (testRandomState << 16);
+}
+
+void fillRandom(BigInt *bi, size_t n)
+{
+    size_t i;
+
+    bi->n = n;
+    for (i = 0; i < n; i++)
+    {
+        bi->words[i] = testRandom();
+    }
+}
+
+/* Allocates n random words, the caller frees them. */
+void fillRandom64(BigInt64 *bi, size_t n)
+{
+    size_t i;
+
+    bi->n = n;
+    bi->words = malloc((n + 1) * sizeof(uint64_t));
+    if (!bi->words) abort();
+    for (i = 0; i < n; i++)
+    {
+        bi->words[i] = (uint64_t)testRandom() << 32 | testRandom();
+    }
+}
+
 #include <stdio.h>
 #include <signal.h>
 
@@ -109,6 +210,252 @@ int main()
     assert(high == 0xFFFFFFFE);
     assert(low == 1);
 
+    {
+        /* The word primitives must give the same results with the builtin carries and the double word type as without. */
+        size_t iter;
+
+        for (iter = 0; iter < 10000; iter++)
+        {
+            uint32_t a = testRandom(), b = testRandom(), c = testRandom();
+            uint32_t r1, r2, h1, h2, l1, l2;
+            int carryIn = (int)(iter & 1);
+            int c1, c2;
+
+            if (iter % 4 == 2) a = 0xFFFFFFFF;
+            if (iter % 8 == 3) b = 0;
+
+            c1 = addDigit(a, b, &r1);
+            c2 = i256_addDigit(a, b, &r2);
+            assert(c1 == c2 && r1 == r2);
+            c1 = subDigit(a, b, &r1);
+            c2 = i256_subDigit(a, b, &r2);
+            assert(c1 == c2 && r1 == r2);
+            c1 = addCarry(a, b, carryIn, &r1);
+            c2 = i256_addCarry(a, b, carryIn, &r2);
+            assert(c1 == c2 && r1 == r2);
+            c1 = subBorrow(a, b, carryIn, &r1);
+            c2 = i256_subBorrow(a, b, carryIn, &r2);
+            assert(c1 == c2 && r1 == r2);
+            assert(r1 == a - b - (uint32_t)carryIn);
+
+            mulDigit(a, b, &h1, &l1);
+            sm_mulDigit(a, b, &h2, &l2);
+            assert(h1 == h2 && l1 == l2);
+
+            if (c == 0) c = 1;
+            a %= c; /* The quotient must fit into a word. */
+            divDigit(a, b, c, &h1, &l1);
+            sm_divDigit(a, b, c, &h2, &l2);
+            assert(h1 == h2 && l1 == l2);
+        }
+    }
+
+    {
+        /* Word vector kernels against the whole number operations. */
+        size_t n, iter;
+
+        for (n = 1; n <= 12; n++)
+        {
+            for (iter = 0; iter < 8; iter++)
+            {
+                BigInt a = {{0}, 0, NULL}, r = {{0}, 0, NULL}, ref = {{0}, 0, NULL}, w = {{0}, 1, NULL};
+                BigInt prod = {{0}, 0, NULL};
+                uint32_t word = iter % 4 == 3 ? 0xFFFFFFFF : testRandom();
+                unsigned shift = 1 + testRandom() % 31;
+                uint32_t out, back;
+                int res;
+
+                fillRandom(&a, n);
+                fillRandom(&r, n);
+                w.words[0] = word;
+                prod.n = n + 1;
+                ref.n = n + 1;
+
+                /* mul1 */
+                res = mul(&a, &w, &prod);
+                assert(res == 0);
+                out = mul1(&ref, 0, &a, 0, n, word);
+                assert(out == prod.words[n]);
+                assert(!memcmp(ref.words, prod.words, n * sizeof(uint32_t)));
+
+                /* addMul1: ref = r + a*word */
+                memcpy(ref.words, r.words, n * sizeof(uint32_t));
+                ref.words[n] = 0;
+                res = add(&ref, &prod, &ref);
+                assert(res == 0);
+                out = addMul1(&r, 0, &a, 0, n, word);
+                assert(out == ref.words[n]);
+                assert(!memcmp(r.words, ref.words, n * sizeof(uint32_t)));
+
+                /* subMul1 undoes it. */
+                back = subMul1(&r, 0, &a, 0, n, word);
+                assert(back == out);
+
+                /* lshiftN and rshiftN in place. */
+                memcpy(ref.words, r.words, n * sizeof(uint32_t));
+                ref.n = n;
+                out = lshiftN(&ref, 0, &ref, 0, n, shift);
+                assert(out == r.words[n - 1] >> (32 - shift));
+                back = rshiftN(&ref, 0, &ref, 0, n, shift);
+                assert(back == 0);
+                ref.words[n - 1] |= out << (32 - shift);
+                assert(!memcmp(ref.words, r.words, n * sizeof(uint32_t)));
+
+                free(a.dummy);
+                free(r.dummy);
+                free(ref.dummy);
+                free(w.dummy);
+                free(prod.dummy);
+            }
+        }
+    }
+    {
+        /* The 64 bit multiply by word kernels (MULX and ADX if the CPU has them) against the 32 bit whole number operations. */
+        size_t n, i, iter;
+
+        for (n = 1; n <= 16; n++)
+        {
+            for (iter = 0; iter < 8; iter++)
+            {
+                BigInt a = {{0}, 0, NULL}, r = {{0}, 0, NULL}, w = {{0}, 0, NULL}, prod = {{0}, 0, NULL}, sum = {{0}, 0, NULL};
+                uint64_t aWords[16], rWords[16], origWords[16];
+                BigInt64 a64, r64;
+                uint64_t word, out, back;
+                int res;
+
+                fillRandom(&a, 2*n);
+                fillRandom(&r, 2*n);
+                fillRandom(&w, 2);
+                if (iter % 4 == 3)
+                {
+                    /* All ones, so every carry is taken. */
+                    memset(a.words, 0xFF, 2*n * sizeof(uint32_t));
+                    memset(r.words, 0xFF, 2*n * sizeof(uint32_t));
+                    memset(w.words, 0xFF, 2 * sizeof(uint32_t));
+                }
+                a64.words = aWords;
+                a64.n = n;
+                r64.words = rWords;
+                r64.n = n;
+                word = w.words[0] | (uint64_t)w.words[1] << 32;
+                for (i = 0; i < n; i++)
+                {
+                    a64.words[i] = a.words[2*i] | (uint64_t)a.words[2*i + 1] << 32;
+                    r64.words[i] = r.words[2*i] | (uint64_t)r.words[2*i + 1] << 32;
+                }
+                memcpy(origWords, rWords, sizeof(rWords));
+                prod.n = 2*n + 2;
+                sum.n = 2*n + 2;
+                res = mul(&a, &w, &prod);
+                assert(res == 0);
+                memcpy(sum.words, r.words, 2*n * sizeof(uint32_t));
+                res = add(&sum, &prod, &sum);
+                assert(res == 0);
+
+                /* mul1 */
+                out = w64_mul1(&r64, 0, &a64, 0, n, word);
+                assert(out == (prod.words[2*n] | (uint64_t)prod.words[2*n + 1] << 32));
+                for (i = 0; i < n; i++) assert(r64.words[i] == (prod.words[2*i] | (uint64_t)prod.words[2*i + 1] << 32));
+
+                /* addMul1, and subMul1 undoes it. */
+                memcpy(rWords, origWords, sizeof(rWords));
+                out = w64_addMul1(&r64, 0, &a64, 0, n, word);
+                assert(out == (sum.words[2*n] | (uint64_t)sum.words[2*n + 1] << 32));
+                for (i = 0; i < n; i++) assert(r64.words[i] == (sum.words[2*i] | (uint64_t)sum.words[2*i + 1] << 32));
+                back = w64_subMul1(&r64, 0, &a64, 0, n, word);
+                assert(back == out);
+                assert(!memcmp(rWords, origWords, n * sizeof(uint64_t)));
+
+                free(a.dummy);
+                free(r.dummy);
+                free(w.dummy);
+                free(prod.dummy);
+                free(sum.dummy);
+            }
+        }
+    }
+    {
+        /* Leading zero words are skipped, the results must be the same as with the trimmed numbers. */
+        size_t nA, nB, iter;
+
+        for (nA = 1; nA <= 14; nA++)
+        {
+            for (nB = 1; nB <= 14; nB++)
+            {
+                for (iter = 0; iter < 3; iter++)
+                {
+                    BigInt a = {{0}, 0, NULL}, b = {{0}, 0, NULL}, aPad, bPad;
+                    BigInt r = {{0}, 0, NULL}, ref = {{0}, 0, NULL}, q = {{0}, 0, NULL}, qRef = {{0}, 0, NULL};
+                    BigInt pow2 = {{0}, 0, NULL};
+                    BigInt scratch = {{0}, 0, NULL};
+                    size_t padA = testRandom() % 6, padB = testRandom() % 6;
+                    unsigned shift = testRandom() % (32 * (unsigned)(nA + padA) + 8);
+                    int res;
+
+                    fillRandom(&a, nA);
+                    fillRandom(&b, nB);
+                    a.words[nA - 1] |= 1;
+                    b.words[nB - 1] |= 1;
+                    if (iter == 1) memcpy(b.words, a.words, (nA < nB ? nA : nB) * sizeof(uint32_t)); /* Same low words. */
+                    aPad = a;
+                    bPad = b;
+                    aPad.n = nA + padA;
+                    bPad.n = nB + padB;
+
+                    assert(lessThan(&aPad, &bPad) == lessThan(&a, &b));
+                    assert(lessThan(&bPad, &aPad) == lessThan(&b, &a));
+                    assert(equal(&aPad, &bPad) == equal(&a, &b));
+                    assert(equal(&aPad, &a) && equal(&a, &aPad));
+
+                    r.n = aPad.n + bPad.n;
+                    ref.n = nA + nB;
+                    res = mul(&aPad, &bPad, &r);
+                    assert(res == 0);
+                    res = mul(&a, &b, &ref);
+                    assert(res == 0);
+                    assert(equal(&r, &ref));
+                    scratch.n = sm_mulScratchSize(aPad.n, bPad.n);
+                    res = sm_mulScratch(&aPad, &bPad, &r, &scratch);
+                    assert(res == 0);
+                    assert(equal(&r, &ref));
+
+                    q.n = aPad.n;
+                    r.n = bPad.n;
+                    qRef.n = nA;
+                    ref.n = nB;
+                    divMod(&aPad, &bPad, &q, &r);
+                    divMod(&a, &b, &qRef, &ref);
+                    assert(equal(&q, &qRef) && equal(&r, &ref));
+
+                    /* shl is a multiplication by 2^shift, shr is a division, both truncated. */
+                    pow2.n = shift / 32 + 1;
+                    memset(pow2.words, 0, sizeof(pow2.words));
+                    pow2.words[shift / 32] = (uint32_t)1 << (shift % 32);
+                    ref.n = aPad.n;
+                    mul(&aPad, &pow2, &ref);
+                    shl(&aPad, &r, shift);
+                    assert(r.n == aPad.n && equal(&r, &ref));
+                    qRef.n = aPad.n;
+                    ref.n = pow2.n;
+                    divMod(&aPad, &pow2, &qRef, &ref);
+                    shr(&aPad, &r, shift);
+                    assert(r.n == aPad.n && equal(&r, &qRef));
+                    r = aPad;
+                    shl(&r, &r, shift % 40);
+                    shr(&r, &r, shift % 40);
+                    if (shift % 40 <= 32 * padA) assert(equal(&r, &a));
+
+                    free(a.dummy);
+                    free(b.dummy);
+                    free(r.dummy);
+                    free(ref.dummy);
+                    free(q.dummy);
+                    free(qRef.dummy);
+                    free(pow2.dummy);
+                }
+            }
+        }
+    }
     {
         BigInt zero = {{0, 0, 0, 0}, 4, NULL};
         BigInt nonzero = {{0, 1, 0, 0}, 4, NULL};
@@ -280,6 +627,130 @@ int main()
         assert(C.words[2] == 0xFFFFFFFF);
         assert(C.words[3] == 0xFFFFFFFF);
     }
+    {
+        BigInt A = {{0}, 0, NULL}, B = {{0}, 0, NULL};
+        BigInt ref = {{0}, 0, NULL}, C = {{0}, 0, NULL};
+        BigInt scratch = {{0}, 0, NULL};
+        size_t nA, nB, nR;
+        int refRes, res;
+
+        /* Karatsuba, Toom-3 and NTT must give the same results as the schoolbook method, including truncation. */
+        for (nA = 1; nA <= 16; nA++)
+        {
+            for (nB = 1; nB <= 16; nB++)
+            {
+                for (nR = 1; nR <= nA + nB + 1; nR++)
+                {
+                    fillRandom(&A, nA);
+                    fillRandom(&B, nB);
+                    if (nR & 1)
+                    {
+                        /* All ones to exercise the carries. */
+                        memset(A.words, 0xFF, nA * sizeof(A.words[0]));
+                        memset(B.words, 0xFF, nB * sizeof(B.words[0]));
+                    }
+                    ref.n = nR;
+                    C.n = nR;
+                    scratch.n = sm_mulScratchSize(nA, nB);
+                    assert(scratch.n <= WORD_COUNT);
+
+                    refRes = mul(&A, &B, &ref);
+                    res = sm_mulScratch(&A, &B, &C, &scratch);
+                    assert(res == refRes);
+                    assert(!memcmp(C.words, ref.words, nR * sizeof(C.words[0])));
+                }
+            }
+        }
+
+        /* Forcing the algorithms. */
+        fillRandom(&A, 16);
+        fillRandom(&B, 16);
+        ref.n = 32;
+        C.n = 32;
+        scratch.n = sm_mulScratchSize(16, 16);
+        refRes = mul(&A, &B, &ref);
+        res = sm_mulKaratsuba(&A, &B, &C, &scratch);
+        assert(res == refRes);
+        assert(!memcmp(C.words, ref.words, 32 * sizeof(C.words[0])));
+        memset(C.words, 0, sizeof(C.words));
+        res = sm_mulToom3(&A, &B, &C, &scratch);
+        assert(res == refRes);
+        assert(!memcmp(C.words, ref.words, 32 * sizeof(C.words[0])));
+        memset(C.words, 0, sizeof(C.words));
+        res = sm_mulNtt(&A, &B, &C, &scratch);
+        assert(res == refRes);
+        assert(!memcmp(C.words, ref.words, 32 * sizeof(C.words[0])));
+
+        /* Unbalanced numbers are multiplied in chunks of the shorter one's size, that includes a partial last chunk. */
+        for (nA = 30; nA <= 41; nA += 11)
+        {
+            for (nB = 5; nB <= 12; nB += 7)
+            {
+                fillRandom(&A, nA);
+                fillRandom(&B, nB);
+                ref.n = nA + nB;
+                C.n = nA + nB;
+                scratch.n = sm_mulScratchSize(nA, nB);
+                assert(scratch.n < sm_mulScratchSize(nA, nA));
+                refRes = mul(&A, &B, &ref);
+                res = sm_mulKaratsuba(&A, &B, &C, &scratch);
+                assert(res == refRes);
+                assert(!memcmp(C.words, ref.words, (nA + nB) * sizeof(C.words[0])));
+                memset(C.words, 0, sizeof(C.words));
+                res = sm_mulToom3(&B, &A, &C, &scratch);
+                assert(res == refRes);
+                assert(!memcmp(C.words, ref.words, (nA + nB) * sizeof(C.words[0])));
+                memset(C.words, 0, sizeof(C.words));
+                res = sm_mulNtt(&A, &B, &C, &scratch);
+                assert(res == refRes);
+                assert(!memcmp(C.words, ref.words, (nA + nB) * sizeof(C.words[0])));
+
+                /* Truncated. */
+                ref.n = nA + 1;
+                C.n = nA + 1;
+                refRes = mul(&A, &B, &ref);
+                res = sm_mulScratch(&A, &B, &C, &scratch);
+                assert(res == refRes);
+                assert(!memcmp(C.words, ref.words, (nA + 1) * sizeof(C.words[0])));
+            }
+        }
+
+        /* Defaults are large enough for small numbers to not need scratch. */
+        assert(mulScratchSize(8, 8) == 0);
+        assert(sm_mulScratchSize(1, 8) == 0);
+    }
+    {
+        BigInt A = {{0}, 0, NULL};
+        BigInt ref = {{0}, 0, NULL}, C = {{0}, 0, NULL}, D = {{0}, 0, NULL};
+        BigInt scratch = {{0}, 0, NULL};
+        size_t nA, nR;
+        int refRes, res;
+
+        /* Squaring must match multiplication, including truncation. */
+        for (nA = 1; nA <= 16; nA++)
+        {
+            for (nR = 1; nR <= 2*nA + 1; nR++)
+            {
+                fillRandom(&A, nA);
+                if (nR & 1)
+                {
+                    memset(A.words, 0xFF, nA * sizeof(A.words[0]));
+                }
+                ref.n = nR;
+                C.n = nR;
+                D.n = nR;
+                scratch.n = sm_mulScratchSize(nA, nA);
+
+                refRes = mul(&A, &A, &ref);
+                res = sqr(&A, &C);
+                assert(res == refRes);
+                assert(!memcmp(C.words, ref.words, nR * sizeof(C.words[0])));
+                res = sm_sqrScratch(&A, &D, &scratch);
+                assert(res == refRes);
+                assert(!memcmp(D.words, ref.words, nR * sizeof(D.words[0])));
+            }
+        }
+    }
     {
         BigInt A = {{0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, 4, NULL};
         BigInt B = {{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, 4, NULL};
@@ -309,6 +780,29 @@ int main()
         assert(A.n == 4);
         assert(borrow == 1);
     }
+    {
+        BigInt A = {{0x00000000, 0x00000000, 0x00000001, 0x00000000}, 4, NULL};
+        BigInt B = {{0x00000001, 0x00000001}, 2, NULL};
+        BigInt C = {0};
+        int borrow;
+
+        /* Test when one of the numbers is shorter. */
+        borrow = sub(&A, &B, &C);
+        assert(C.words[0] == 0xFFFFFFFF);
+        assert(C.words[1] == 0xFFFFFFFE);
+        assert(C.words[2] == 0x00000000);
+        assert(C.words[3] == 0x00000000);
+        assert(C.n == 4);
+        assert(borrow == 0);
+
+        borrow = sub(&B, &A, &C);
+        assert(C.words[0] == 0x00000001);
+        assert(C.words[1] == 0x00000001);
+        assert(C.words[2] == 0xFFFFFFFF);
+        assert(C.words[3] == 0xFFFFFFFF);
+        assert(C.n == 4);
+        assert(borrow == 1);
+    }
     {
         BigInt A = {{0x12345678, 0x22222222, 0x33333333, 0x44444444}, 4, NULL};
         BigInt B = {0};
@@ -564,6 +1058,80 @@ int main()
         assert(remainder.words[2] == 0x00000000);
         assert(remainder.words[3] == 0x00000000);
     }
+    {
+        /* Cases from Hacker's Delight where the quotient estimate must be corrected. */
+        BigInt dividends[] = {
+            {{0x00000000, 0x00000000, 0x80000000, 0x7fffffff}, 4, NULL},
+            {{0x00000003, 0x00000000, 0x80000000}, 3, NULL},
+            {{0x00000000, 0xfffffffe, 0x80000000}, 3, NULL},
+            {{0x00000000, 0x00000000, 0x00000000, 0x80000000}, 4, NULL}
+        };
+        BigInt divisors[] = {
+            {{0x00000001, 0x00000000, 0x80000000}, 3, NULL},
+            {{0x00000001, 0x00000000, 0x20000000}, 3, NULL},
+            {{0x00000000, 0x80000000}, 2, NULL},
+            {{0x00000001, 0x40000000}, 2, NULL}
+        };
+        BigInt quotient = {{0}, 0, NULL}, remainder = {{0}, 0, NULL};
+        BigInt prod = {{0}, 0, NULL};
+        size_t i, nD, nS;
+        int res;
+
+        for (i = 0; i < sizeof(dividends) / sizeof(*dividends); i++)
+        {
+            divMod(&dividends[i], &divisors[i], &quotient, &remainder);
+            assert(lessThan(&remainder, &divisors[i]));
+            prod.n = quotient.n + divisors[i].n;
+            res = mul(&quotient, &divisors[i], &prod);
+            assert(res == 0);
+            res = add(&prod, &remainder, &prod);
+            assert(res == 0);
+            assert(equal(&prod, &dividends[i]));
+        }
+
+        /* Random numbers, q*d + r = n and r < d must hold. */
+        for (nD = 1; nD <= 10; nD++)
+        {
+            for (nS = 1; nS <= 10; nS++)
+            {
+                for (i = 0; i < 20; i++)
+                {
+                    BigInt dividend = {{0}, 0, NULL}, divisor = {{0}, 0, NULL};
+
+                    fillRandom(&dividend, nD);
+                    fillRandom(&divisor, nS);
+                    /* Vary the top word of the divisor to exercise the normalization. */
+                    divisor.words[nS - 1] >>= i;
+                    if (i & 1) divisor.words[nS - 1] = 0xFFFFFFFF;
+                    if (isZero(&divisor)) continue;
+
+                    divMod(&dividend, &divisor, &quotient, &remainder);
+                    assert(quotient.n == nD);
+                    assert(remainder.n == nS);
+                    assert(lessThan(&remainder, &divisor));
+                    prod.n = nD + nS;
+                    res = mul(&quotient, &divisor, &prod);
+                    assert(res == 0);
+                    res = add(&prod, &remainder, &prod);
+                    assert(res == 0);
+                    assert(equal(&prod, &dividend));
+                }
+            }
+        }
+    }
+    {
+        uint32_t q, r;
+
+        divDigit(0x12345678, 0x9ABCDEF0, 0x87654321, &q, &r);
+        assert(q == 0x226B9022);
+        assert(r == 0x38BC648E);
+        divDigit(0, 100, 7, &q, &r);
+        assert(q == 14);
+        assert(r == 2);
+        divDigit(0xFFFFFFFE, 0xFFFFFFFF, 0xFFFFFFFF, &q, &r);
+        assert(q == 0xFFFFFFFF);
+        assert(r == 0xFFFFFFFE);
+    }
     {
         BigInt zero = {{0}, 2, NULL};
         BigInt nonzero = {{0x666, 0}, 2, NULL};
@@ -600,6 +1168,7 @@ int main()
         gcdEuclidean(&A, &B, &gcd);
         assert(gcd.n == 1);
         assert(gcd.words[0] == 2431);
+        free(gcd.dummy);
 
         /* Try something large. */
         gcdEuclidean(&bigA, &bigB, &gcd);
@@ -607,12 +1176,14 @@ int main()
         assert(gcd.words[0] == 0xd542c9ca);
         assert(gcd.words[1] == 0x00001340);
         assert(gcd.words[2] == 0x00000000);
+        free(gcd.dummy);
 
         /* Mess with zero. */
         gcdEuclidean(&bigA, &zero, &gcd);
         assert(gcd.n == 2);
         assert(gcd.words[0] == 0x8cc61a06);
         assert(gcd.words[1] == 0xbfe2f415);
+        free(gcd.dummy);
 
         gcdEuclidean(&zero, &bigA, &gcd);
         assert(gcd.n == 3);
@@ -627,6 +1198,76 @@ int main()
         free(bigB.dummy);
         free(zero.dummy);
     }
+    {
+        /* Binary and Lehmer GCD against the plain Euclidean algorithm, gcd(g*x, g*y) for random numbers. */
+        size_t nG, nX, iter;
+
+        for (nG = 1; nG <= 6; nG++)
+        {
+            for (nX = 1; nX <= 8; nX++)
+            {
+                for (iter = 0; iter < 4; iter++)
+                {
+                    BigInt g = {{0}, 0, NULL}, x = {{0}, 0, NULL}, y = {{0}, 0, NULL};
+                    BigInt a = {{0}, 0, NULL}, b = {{0}, 0, NULL};
+                    BigInt high = {{0}, 0, NULL}, low = {{0}, 0, NULL}, rem = {{0}, 0, NULL};
+                    BigInt gcd;
+                    size_t nY = iter == 3 ? 1 : nX;
+                    int res;
+
+                    fillRandom(&g, nG);
+                    fillRandom(&x, nX);
+                    fillRandom(&y, nY);
+                    if (iter == 1) g.words[0] &= ~0xFFu; /* Common factors of 2. */
+                    if (iter == 2) x.words[0] &= ~0xFu;
+                    a.n = nG + nX;
+                    b.n = nG + nY;
+                    res = mul(&g, &x, &a);
+                    assert(res == 0);
+                    res = mul(&g, &y, &b);
+                    assert(res == 0);
+
+                    gcdEuclidean(&a, &b, &gcd);
+                    assert(gcd.n == b.n);
+
+                    /* Reference */
+                    high = a;
+                    low = b;
+                    high.n = low.n = rem.n = a.n > b.n ? a.n : b.n;
+                    while (!isZero(&low))
+                    {
+                        divMod(&high, &low, NULL, &rem);
+                        high = low;
+                        low = rem;
+                    }
+                    assert(equal(&gcd, &high));
+
+                    free(gcd.dummy);
+                }
+            }
+        }
+    }
+    {
+        /* Consecutive Fibonacci numbers, all the quotients are 1. */
+        BigInt f1 = {{1}, 1, NULL}, f2 = {{1}, 1, NULL}, tmp;
+        BigInt gcd;
+        size_t i;
+        int res;
+
+        f1.n = f2.n = 12;
+        for (i = 0; i < 500; i++)
+        {
+            tmp = f2;
+            res = add(&f1, &f2, &f2);
+            assert(res == 0);
+            f1 = tmp;
+        }
+        gcdEuclidean(&f2, &f1, &gcd);
+        assert(gcd.words[0] == 1);
+        gcd.words[0] = 0;
+        assert(isZero(&gcd));
+        free(gcd.dummy);
+    }
     {
         /* Quick sanity to see the extended euclidean works.*/
         BigInt A = {{2310}, 1, NULL};
@@ -703,7 +1344,7 @@ int main()
         free(Y.dummy);
         free(GCD.dummy);
         /* Zero division testcase */
-        /* 42x + 0y = 42 will be solvesd. Both X and Y will be 1.*/
+        /* 42x + 0y = 42 will be solved. X will be 1, Y will be zero.*/
         gcdExtendedEuclidean(&nonzero, &zero, &X, &Y, &GCD);
         assert(GCD.n == 2);
         assert(GCD.words[0] == 42);
@@ -714,7 +1355,7 @@ int main()
         assert(X.words[1] == 0);
 
         assert(Y.n == 1);
-        assert(Y.words[0] == 1);
+        assert(Y.words[0] == 0);
 
         free(zero.dummy);
         free(nonzero.dummy);
@@ -722,6 +1363,128 @@ int main()
         free(Y.dummy);
         free(GCD.dummy);
     }
+    {
+        /* Random extended GCDs: a*x + b*y must be the GCD. */
+        size_t nA, nB, iter, i;
+
+        for (nA = 1; nA <= 8; nA++)
+        {
+            for (nB = 1; nB <= 8; nB++)
+            {
+                for (iter = 0; iter < 4; iter++)
+                {
+                    BigInt a = {{0}, 0, NULL}, b = {{0}, 0, NULL};
+                    BigInt xExt = {{0}, 0, NULL}, yExt = {{0}, 0, NULL};
+                    BigInt ax = {{0}, 0, NULL}, by = {{0}, 0, NULL}, gcdExt = {{0}, 0, NULL};
+                    BigInt X, Y, GCD, ref;
+
+                    fillRandom(&a, nA);
+                    fillRandom(&b, nB);
+                    if (iter == 1)
+                    {
+                        /* Common factor. */
+                        a.words[0] &= ~0xFFu;
+                        b.words[0] &= ~0xFFu;
+                    }
+                    gcdExtendedEuclidean(&a, &b, &X, &Y, &GCD);
+                    gcdEuclidean(&a, &b, &ref);
+                    assert(X.n == nB);
+                    assert(Y.n == nA);
+                    assert(equal(&GCD, &ref));
+
+                    /* Sign extend the cofactors and compute modulo the words. */
+                    xExt.n = yExt.n = ax.n = by.n = gcdExt.n = nA + nB;
+                    for (i = 0; i < nA + nB; i++)
+                    {
+                        xExt.words[i] = i < X.n ? X.words[i] : (X.words[X.n - 1] >> 31) ? 0xFFFFFFFFu : 0;
+                        yExt.words[i] = i < Y.n ? Y.words[i] : (Y.words[Y.n - 1] >> 31) ? 0xFFFFFFFFu : 0;
+                        gcdExt.words[i] = i < GCD.n ? GCD.words[i] : 0;
+                    }
+                    mul(&a, &xExt, &ax);
+                    mul(&b, &yExt, &by);
+                    add(&ax, &by, &ax);
+                    assert(equal(&ax, &gcdExt));
+
+                    free(X.dummy);
+                    free(Y.dummy);
+                    free(GCD.dummy);
+                    free(ref.dummy);
+                }
+            }
+        }
+    }
+    {
+        BigInt a = {{3}, 1, NULL};
+        BigInt m = {{7}, 1, NULL};
+        BigInt even = {{4}, 1, NULL}, evenM = {{10}, 1, NULL};
+        BigInt one = {{1}, 1, NULL};
+        BigInt inv;
+        int ret;
+
+        ret = modInverse(&a, &m, &inv);
+        assert(ret == 0);
+        assert(inv.n == 1);
+        assert(inv.words[0] == 5);
+        free(inv.dummy);
+
+        ret = modInverse(&even, &evenM, &inv);
+        assert(ret == -1);
+        assert(isZero(&inv));
+        free(inv.dummy);
+
+        /* Everything is zero modulo 1. */
+        ret = modInverse(&a, &one, &inv);
+        assert(ret == 0);
+        assert(isZero(&inv));
+        free(inv.dummy);
+    }
+    {
+        /* Random modular inverses. */
+        size_t nM, nA, iter;
+
+        for (nM = 1; nM <= 8; nM++)
+        {
+            for (nA = 1; nA <= nM + 1; nA++)
+            {
+                for (iter = 0; iter < 4; iter++)
+                {
+                    BigInt a = {{0}, 0, NULL}, m = {{0}, 0, NULL};
+                    BigInt prod = {{0}, 0, NULL}, rem = {{0}, 0, NULL};
+                    BigInt inv, gcd;
+                    int ret, res;
+
+                    fillRandom(&a, nA);
+                    fillRandom(&m, nM);
+                    if (iter % 2) m.words[0] |= 1;
+                    ret = modInverse(&a, &m, &inv);
+                    gcdEuclidean(&a, &m, &gcd);
+                    assert(inv.n == nM);
+                    if (ret == 0)
+                    {
+                        assert(lessThan(&inv, &m));
+                        prod.n = nA + nM;
+                        rem.n = nM;
+                        res = mul(&a, &inv, &prod);
+                        assert(res == 0);
+                        divMod(&prod, &m, NULL, &rem);
+                        assert(rem.words[0] == 1);
+                        rem.words[0] = 0;
+                        assert(isZero(&rem));
+                        assert(gcd.words[0] == 1);
+                    }
+                    else
+                    {
+                        assert(ret == -1);
+                        assert(isZero(&inv));
+                        assert(gcd.words[0] != 1 || significantWords(&gcd) > 1);
+                    }
+
+                    free(inv.dummy);
+                    free(gcd.dummy);
+                }
+            }
+        }
+    }
     {
         BigInt base = {{3, 0}, 2, NULL};
         BigInt exponent = {{19}, 1, NULL};
@@ -784,6 +1547,219 @@ int main()
         free(modulus.dummy);
         free(res.dummy);
     }
+    {
+        /* Sliding window with the scratch from the caller, even modulus, long runs of zeros in the exponent. */
+        BigInt base = {{0xec99108d, 0xc7fde805, 0x7734d7c1, 0x73ab4876, 0x8201e2bd}, 5, NULL};
+        BigInt exponent = {{0x00000009, 0x00000b00, 0x80000000}, 3, NULL};
+        BigInt modulus = {{0x73cf256c, 0xdda1494c, 0x8f4d3e27, 0xdb5b5fab}, 4, NULL};
+        uint32_t expected[] = {0x3812e70d, 0x5dfc9a7c, 0xf833b759, 0x3ba76c91};
+        BigInt scratch = {{0}, 0, NULL};
+        BigInt res = {{0}, 0, NULL};
+        int ret;
+
+        scratch.n = modPowScratchSize(4);
+        ret = modPowScratch(&base, &exponent, &modulus, &res, &scratch);
+        assert(ret == 0);
+        assert(res.n == 4);
+        assert(!memcmp(res.words, expected, sizeof(expected)));
+    }
+    {
+        BigInt base = {{42, 0}, 2, NULL};
+        BigInt exponent = {{4242424242}, 1, NULL};
+        BigInt modulus = {{1000001}, 1, NULL};
+        BigInt evenModulus = {{1000000}, 1, NULL};
+        BigInt res;
+        int ret;
+
+        /* Odd modulus, computed in Montgomery form. */
+        ret = modPowMont(&base, &exponent, &modulus, &res);
+        assert(ret == 0);
+        assert(res.n == 1);
+        assert(res.words[0] == 35601);
+        free(res.dummy);
+
+        /* Even modulus, falls back to modPow. */
+        ret = modPowMont(&base, &exponent, &evenModulus, &res);
+        assert(ret == 0);
+        assert(res.n == 1);
+        assert(res.words[0] == 880064);
+        free(res.dummy);
+    }
+    {
+        /* Montgomery multiplication and exponentiation against the plain ones on random numbers. */
+        size_t nM, iter;
+
+        for (nM = 1; nM <= 8; nM++)
+        {
+            for (iter = 0; iter < 20; iter++)
+            {
+                BigInt m = {{0}, 0, NULL}, r2 = {{0}, 0, NULL};
+                BigInt a = {{0}, 0, NULL}, b = {{0}, 0, NULL};
+                BigInt x = {{0}, 0, NULL}, y = {{0}, 0, NULL}, z = {{0}, 0, NULL};
+                BigInt prod = {{0}, 0, NULL}, expected = {{0}, 0, NULL};
+                BigInt exponent = {{0}, 0, NULL};
+                BigInt res1, res2;
+                uint32_t mInv;
+                int res;
+
+                fillRandom(&m, nM);
+                m.words[0] |= 1;
+                if (iter & 1) m.words[nM - 1] = 0xFFFFFFFF; /* Exercise the final subtraction. */
+                if (iter == 2 && nM > 1) m.words[nM - 1] = 0; /* Leading zero word. */
+                if (nM == 1 && m.words[0] == 1) m.words[0] = 3;
+
+                fillRandom(&prod, nM);
+                a.n = nM;
+                divMod(&prod, &m, NULL, &a);
+                fillRandom(&prod, nM);
+                b.n = nM;
+                divMod(&prod, &m, NULL, &b);
+
+                montCtxInit(&m, &mInv, &r2);
+                assert(r2.n == nM);
+                assert((uint32_t)(mInv * m.words[0]) == 0xFFFFFFFF);
+
+                x.n = y.n = z.n = nM;
+                montToDomain(&a, &m, mInv, &r2, &x);
+                montToDomain(&b, &m, mInv, &r2, &y);
+                montMul(&x, &y, &m, mInv, &z);
+                montFromDomain(&z, &m, mInv, &x);
+
+                prod.n = 2*nM;
+                res = mul(&a, &b, &prod);
+                assert(res == 0);
+                expected.n = nM;
+                divMod(&prod, &m, NULL, &expected);
+                assert(equal(&x, &expected));
+
+                /* Squaring. */
+                montToDomain(&a, &m, mInv, &r2, &x);
+                montMul(&x, &x, &m, mInv, &z);
+                montFromDomain(&z, &m, mInv, &y);
+                res = mul(&a, &a, &prod);
+                assert(res == 0);
+                divMod(&prod, &m, NULL, &expected);
+                assert(equal(&y, &expected));
+
+                fillRandom(&exponent, 1 + iter % 3);
+                res = modPow(&a, &exponent, &m, &res1);
+                assert(res == 0);
+                res = modPowMont(&a, &exponent, &m, &res2);
+                assert(res == 0);
+                assert(res1.n == nM);
+                assert(res2.n == nM);
+                assert(equal(&res1, &res2));
+
+                free(r2.dummy);
+                free(res1.dummy);
+                free(res2.dummy);
+            }
+        }
+    }
+    {
+        /* Fixed window exponentiation against the sliding window one, odd, even and zero modulus. */
+        size_t nM, iter;
+
+        for (nM = 1; nM <= 8; nM++)
+        {
+            for (iter = 0; iter < 12; iter++)
+            {
+                BigInt m = {{0}, 0, NULL}, a = {{0}, 0, NULL}, exponent = {{0}, 0, NULL};
+                BigInt res1, res2;
+                int res;
+
+                fillRandom(&m, nM);
+                fillRandom(&a, nM + iter % 2);
+                fillRandom(&exponent, 1 + iter % 3);
+                if (iter % 3 == 0) m.words[0] |= 1;
+                if (iter % 3 == 1) m.words[0] &= ~1u;
+                if (iter == 2) memset(m.words, 0, sizeof(m.words));
+                if (iter == 5) memset(exponent.words, 0, sizeof(exponent.words));
+
+                res = modPow(&a, &exponent, &m, &res1);
+                assert(res == 0);
+                res = modPowFixedWindow(&a, &exponent, &m, &res2);
+                assert(res == 0);
+                assert(res1.n == nM);
+                assert(res2.n == nM);
+                assert(equal(&res1, &res2));
+
+                free(res1.dummy);
+                free(res2.dummy);
+            }
+        }
+    }
+    {
+        /* Barrett reduction against divMod on random numbers. */
+        size_t nM, iter;
+
+        for (nM = 1; nM <= 16; nM++)
+        {
+            for (iter = 0; iter < 20; iter++)
+            {
+                BigInt m = {{0}, 0, NULL}, mu = {{0}, 0, NULL};
+                BigInt a = {{0}, 0, NULL}, b = {{0}, 0, NULL}, x = {{0}, 0, NULL};
+                BigInt res = {{0}, 0, NULL}, expected = {{0}, 0, NULL};
+                BigInt scratch = {{0}, 0, NULL};
+                size_t k = nM;
+                int ret;
+
+                fillRandom(&m, nM);
+                if (iter == 1) m.words[0] &= ~1u; /* Even */
+                if (iter == 2 && nM > 1) { m.words[nM - 1] = 0; k--; } /* Leading zero word. */
+                if (iter == 3) { memset(m.words, 0, nM * sizeof(*m.words)); m.words[nM - 1] = 1; } /* b^(nM-1), mu would overflow. */
+                if (iter == 4) { memset(m.words, 0xFF, nM * sizeof(*m.words)); }
+                if (iter >= 5) m.words[nM - 1] >>= iter;
+                if (m.words[k - 1] == 0) m.words[k - 1] = 1;
+
+                barrettCtxInit(&m, &mu);
+                assert(mu.n == k + 1);
+
+                /* Any x below b^2k */
+                fillRandom(&x, 2*k);
+                res.n = nM;
+                expected.n = nM;
+                scratch.n = barrettScratchSize(nM);
+                barrettReduce(&x, &m, &mu, &res, &scratch);
+                divMod(&x, &m, NULL, &expected);
+                assert(equal(&res, &expected));
+
+                /* In place. */
+                barrettReduce(&x, &m, &mu, &x, &scratch);
+                assert(x.n == nM);
+                assert(equal(&x, &expected));
+
+                fillRandom(&x, nM);
+                a.n = nM;
+                divMod(&x, &m, NULL, &a);
+                fillRandom(&x, nM);
+                b.n = nM;
+                divMod(&x, &m, NULL, &b);
+                x.n = 2*nM;
+                ret = mul(&a, &b, &x);
+                assert(ret == 0);
+                divMod(&x, &m, NULL, &expected);
+
+                modMulBarrett(&a, &b, &m, &mu, &res, &scratch);
+                assert(equal(&res, &expected));
+
+                /* With the fast multiplication algorithms. */
+                scratch.n = sm_barrettScratchSize(nM);
+                sm_modMulBarrett(&a, &b, &m, &mu, &res, &scratch);
+                assert(equal(&res, &expected));
+
+                /* Squaring in place. */
+                x.n = 2*nM;
+                ret = mul(&a, &a, &x);
+                assert(ret == 0);
+                divMod(&x, &m, NULL, &expected);
+                sm_modMulBarrett(&a, &a, &m, &mu, &a, &scratch);
+                assert(equal(&a, &expected));
+
+                free(mu.dummy);
+            }
+        }
+    }
     {
         BigInt witness = {{1}, 1, NULL};
         uint32_t primeList[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 997/*, 5471, 35381, 100019*/};
@@ -839,6 +1815,160 @@ int main()
         free(witness.dummy);
         free(toTest.dummy);
     }
+    {
+        /* isProbablePrime must agree with trial division for small numbers, also with leading zero words. */
+        BigInt toTest = {{0}, 2, NULL};
+        BigInt big = {{0}, 5, NULL};
+        uint64_t value, divisor;
+        int iter, isPrime, prime;
+
+        for (iter = 0; iter < 3000 + 100; iter++)
+        {
+            value = iter < 3000 ? (uint64_t)iter : ((uint64_t)testRandom() << 32 | testRandom()) % ((uint64_t)1 << 36);
+            toTest.words[0] = (uint32_t)value;
+            toTest.words[1] = (uint32_t)(value >> 32);
+
+            isPrime = value >= 2;
+            for (divisor = 2; divisor * divisor <= value; divisor++)
+            {
+                if (value % divisor == 0)
+                {
+                    isPrime = 0;
+                    break;
+                }
+            }
+            prime = isProbablePrime(&toTest, 1);
+            assert(!prime == !isPrime);
+        }
+
+        /* Strong pseudoprimes to the bases 2, 3, 5, 7 and to the bases up to 23. */
+        toTest.words[0] = 0xbfa17dc7;
+        toTest.words[1] = 0;
+        prime = isProbablePrime(&toTest, 1);
+        assert(!prime);
+        toTest.words[0] = 0x4f9af9fb;
+        toTest.words[1] = 0x35159127;
+        prime = isProbablePrime(&toTest, 1);
+        assert(!prime);
+
+        /* 2^61 - 1 and the largest 64 bit prime. */
+        toTest.words[0] = 0xffffffff;
+        toTest.words[1] = 0x1fffffff;
+        prime = isProbablePrime(&toTest, 1);
+        assert(prime);
+        toTest.words[0] = 0xffffffc5;
+        toTest.words[1] = 0xffffffff;
+        prime = isProbablePrime(&toTest, 1);
+        assert(prime);
+
+        /* 2^127 - 1 is prime, 2^128 + 1 is not. */
+        big.words[0] = big.words[1] = big.words[2] = 0xffffffff;
+        big.words[3] = 0x7fffffff;
+        big.words[4] = 0;
+        prime = isProbablePrime(&big, 20);
+        assert(prime);
+        big.words[0] = 1;
+        big.words[1] = big.words[2] = big.words[3] = 0;
+        big.words[4] = 1;
+        prime = isProbablePrime(&big, 20);
+        assert(!prime);
+
+        free(toTest.dummy);
+        free(big.dummy);
+    }
+    {
+        /* The scratch variants of the build without NUM_THEORY must match the allocating functions. */
+        size_t nA, nM;
+        int iter;
+
+        for (nM = 1; nM <= 6; nM++)
+        {
+            for (nA = 1; nA <= 6; nA++)
+            {
+                for (iter = 0; iter < 4; iter++)
+                {
+                    BigInt a = {{0}, 0, NULL}, m = {{0}, 0, NULL}, e = {{0}, 0, NULL};
+                    BigInt res = {{0}, 0, NULL}, res2 = {{0}, 0, NULL}, res3 = {{0}, 0, NULL};
+                    BigInt x, y, g, expected;
+                    BigInt scratch = {{0}, 0, NULL};
+                    uint32_t mInv, mInv2;
+                    int ret, scratchRet;
+
+                    fillRandom(&a, nA);
+                    fillRandom(&m, nM);
+                    fillRandom(&e, 1 + iter);
+                    if (iter & 1) m.words[0] |= 1; /* Odd, so the Montgomery path is taken. */
+                    if (iter == 2) a.words[0] = m.words[0] * 6; /* Often a common factor. */
+                    if (m.words[nM - 1] == 0) m.words[nM - 1] = 1;
+
+                    gcdEuclidean(&a, &m, &g);
+                    scratch.n = sm_gcdScratchSize(nA, nM);
+                    sm_gcdScratch(&a, &m, &res, &scratch);
+                    assert(res.n == nM && equal(&res, &g));
+                    free(g.dummy);
+
+                    gcdExtendedEuclidean(&a, &m, &x, &y, &g);
+                    scratch.n = sm_gcdExtendedScratchSize(nA, nM);
+                    sm_gcdExtendedScratch(&a, &m, &res, &res2, &res3, &scratch);
+                    assert(res.n == nM && equal(&res, &x));
+                    assert(res2.n == nA && equal(&res2, &y));
+                    assert(res3.n == nM && equal(&res3, &g));
+                    free(x.dummy);
+                    free(y.dummy);
+                    free(g.dummy);
+
+                    ret = modInverse(&a, &m, &expected);
+                    scratch.n = sm_modInverseScratchSize(nA, nM);
+                    scratchRet = sm_modInverseScratch(&a, &m, &res, &scratch);
+                    assert(scratchRet == ret);
+                    assert(res.n == nM && equal(&res, &expected));
+                    free(expected.dummy);
+
+                    scratch.n = sm_lcmScratchSize(nA, nM);
+                    lcm(&a, &m, &expected);
+                    sm_lcmScratch(&a, &m, &res, &scratch);
+                    assert(res.n == nA + nM && equal(&res, &expected));
+                    free(expected.dummy);
+
+                    barrettCtxInit(&m, &expected);
+                    scratch.n = sm_barrettCtxScratchSize(nM);
+                    sm_barrettCtxInitScratch(&m, &res, &scratch);
+                    assert(equal(&res, &expected));
+                    free(expected.dummy);
+
+                    modPow(&a, &e, &m, &expected);
+                    scratch.n = sm_modPowScratchSize(nM);
+                    ret = sm_modPowScratch(&a, &e, &m, &res, &scratch);
+                    assert(ret == 0);
+                    assert(equal(&res, &expected));
+                    scratch.n = sm_modPowFixedWindowScratchSize(nM);
+                    ret = sm_modPowFixedWindowScratch(&a, &e, &m, &res, &scratch);
+                    assert(ret == 0);
+                    assert(equal(&res, &expected));
+                    scratch.n = sm_modPowMontScratchSize(nM);
+                    ret = sm_modPowMontScratch(&a, &e, &m, &res, &scratch);
+                    assert(ret == 0);
+                    assert(equal(&res, &expected));
+                    free(expected.dummy);
+
+                    if (m.words[0] & 1)
+                    {
+                        montCtxInit(&m, &mInv, &expected);
+                        scratch.n = sm_montCtxScratchSize(nM);
+                        sm_montCtxInitScratch(&m, &mInv2, &res, &scratch);
+                        assert(mInv == mInv2 && equal(&res, &expected));
+                        free(expected.dummy);
+
+                        if (nA <= nM && (nM > 1 || m.words[0] > 2))
+                        {
+                            scratch.n = sm_mrTestScratchSize(nM);
+                            assert(!sm_mrTestScratch(&m, &a, &scratch) == !mrTest(&m, &a));
+                        }
+                    }
+                }
+            }
+        }
+    }
     {
         BigInt a = {{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, 4, NULL};
         BigInt b = {{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, 3, NULL};
@@ -876,6 +2006,446 @@ int main()
         free(res.dummy);
     }
 
+    {
+        /* Batches with odd, even and zero modulo, the sm_ instance runs them on multiple threads. */
+        BigInt bases[7], exps[7], results[7], results2[7], m, expected, scratch;
+        size_t nM, i, threads;
+        int kind, res;
+
+        for (nM = 1; nM <= 6; nM++)
+        {
+            for (kind = 0; kind < 3; kind++)
+            {
+                fillRandom(&m, nM);
+                if (kind == 0) m.words[0] |= 3;
+                if (kind == 1) m.words[0] = (m.words[0] & ~(uint32_t)1) | 2;
+                if (kind == 2) memset(m.words, 0, nM * sizeof(m.words[0]));
+                for (i = 0; i < 7; i++)
+                {
+                    fillRandom(&bases[i], 1 + testRandom() % (2*nM));
+                    fillRandom(&exps[i], 1 + testRandom() % 3);
+                }
+                memset(exps[6].words, 0, exps[6].n * sizeof(exps[6].words[0]));
+
+                res = modPowBatch(bases, exps, &m, results, 7, 3);
+                assert(res == 0);
+                for (threads = 0; threads <= 4; threads++)
+                {
+                    scratch.n = sm_modPowBatchScratchSize(nM, threads);
+                    if (scratch.n > WORD_COUNT) break;
+                    res = sm_modPowBatchScratch(bases, exps, &m, results2, 7, threads, &scratch);
+                    assert(res == 0);
+                    for (i = 0; i < 7; i++)
+                    {
+                        modPow(&bases[i], &exps[i], &m, &expected);
+                        assert(equal(&results[i], &expected) && results[i].n == nM);
+                        assert(equal(&results2[i], &expected) && results2[i].n == nM);
+                        free(expected.dummy);
+                    }
+                }
+                for (i = 0; i < 7; i++)
+                {
+                    free(results[i].dummy);
+                }
+            }
+        }
+    }
+    {
+        /* Baillie-PSW against trial division, then against isProbablePrime (exact below 2^64) and with large numbers. */
+        BigInt toTest, scratch, factor1, factor2;
+        /* Strong pseudoprimes to base 2, then strong Lucas pseudoprimes, none of them has a factor up to 131.
+         * 1194649 and 12327121 are the squares of the Wieferich primes. */
+        uint32_t pseudoprimes[] = {
+            49141, 88357, 90751, 104653, 130561, 196093, 253241, 256999, 271951, 280601, 1194649, 12327121, 3215031751u,
+            22499, 40309, 58519, 75077, 97439, 100127, 113573, 115639, 130139, 158399, 161027, 176399
+        };
+        uint32_t value, divisor;
+        size_t i;
+        int iter, isPrime, prime, probablePrime, ret;
+
+        for (iter = 0; iter < 20000 + 100; iter++)
+        {
+            value = iter < 20000 ? (uint32_t)iter : testRandom() % ((uint32_t)1 << 30);
+            toTest.n = 2;
+            toTest.words[0] = value;
+            toTest.words[1] = 0;
+
+            for (divisor = 2; divisor * divisor <= value && value % divisor; divisor++);
+            isPrime = value >= 2 && divisor * divisor > value;
+            prime = isPrimeBPSW(&toTest);
+            assert(!prime == !isPrime);
+        }
+
+        for (i = 0; i < sizeof(pseudoprimes) / sizeof(*pseudoprimes); i++)
+        {
+            toTest.n = 1;
+            toTest.words[0] = pseudoprimes[i];
+            prime = isPrimeBPSW(&toTest);
+            assert(!prime);
+        }
+
+        for (iter = 0; iter < 300; iter++)
+        {
+            fillRandom(&toTest, 2);
+            toTest.words[0] |= 1;
+            if (iter % 3 == 0)
+            {
+                /* A prime. */
+                toTest.words[1] = 0;
+                ret = nextPrime(&toTest, 1, 1, &scratch);
+                assert(ret == 0);
+                toTest.words[0] = scratch.words[0];
+                free(scratch.dummy);
+            }
+            probablePrime = isProbablePrime(&toTest, 1);
+            prime = isPrimeBPSW(&toTest);
+            assert(!prime == !probablePrime);
+            scratch.n = sm_isPrimeBPSWScratchSize(2);
+            prime = sm_isPrimeBPSWScratch(&toTest, &scratch);
+            assert(!prime == !probablePrime);
+        }
+
+        /* Products of two primes of one or two words, every fifth one a square. The top bit of the starts is cleared, so
+         * there is always a prime that fits. */
+        for (iter = 0; iter < 60; iter++)
+        {
+            fillRandom(&toTest, 1 + iter % 2);
+            toTest.words[toTest.n - 1] >>= 1;
+            ret = nextPrime(&toTest, 1, 1, &factor1);
+            assert(ret == 0);
+            if (iter % 5 == 0)
+            {
+                ret = nextPrime(&toTest, 1, 1, &factor2);
+            }
+            else
+            {
+                fillRandom(&toTest, 1 + iter / 2 % 2);
+                toTest.words[toTest.n - 1] >>= 1;
+                ret = nextPrime(&toTest, 1, 1, &factor2);
+            }
+            assert(ret == 0);
+            toTest.n = factor1.n + factor2.n;
+            ret = mul(&factor1, &factor2, &toTest);
+            assert(ret == 0);
+            free(factor1.dummy);
+            free(factor2.dummy);
+
+            prime = isPrimeBPSW(&toTest);
+            assert(!prime);
+            scratch.n = sm_isPrimeBPSWScratchSize(toTest.n);
+            prime = sm_isPrimeBPSWScratch(&toTest, &scratch);
+            assert(!prime);
+            if (toTest.n == 2)
+            {
+                probablePrime = isProbablePrime(&toTest, 1);
+                assert(!probablePrime);
+            }
+        }
+
+        /* 3825123056546413051 is a strong pseudoprime to the bases up to 23. */
+        toTest.n = 2;
+        toTest.words[0] = 0x4f9af9fb;
+        toTest.words[1] = 0x35159127;
+        prime = isPrimeBPSW(&toTest);
+        assert(!prime);
+
+        /* 2^521 - 1 is prime, 2^128 + 1 is not. */
+        toTest.n = 17;
+        for (i = 0; i < 16; i++)
+        {
+            toTest.words[i] = 0xffffffff;
+        }
+        toTest.words[16] = 0x1ff;
+        prime = isPrimeBPSW(&toTest);
+        assert(prime);
+        toTest.n = 5;
+        memset(toTest.words, 0, 5 * sizeof(toTest.words[0]));
+        toTest.words[0] = toTest.words[4] = 1;
+        prime = isPrimeBPSW(&toTest);
+        assert(!prime);
+    }
+    {
+        /* nextPrime against trial division, then with large numbers, the sm_ instance runs it on multiple threads. */
+        BigInt start, res, res2, scratch;
+        BigInt candidates[4];
+        uint32_t value, expected, divisor;
+        size_t threads;
+        int iter, ret;
+
+        for (iter = 0; iter < 1500 + 100; iter++)
+        {
+            value = iter < 1500 ? (uint32_t)iter : testRandom() % ((uint32_t)1 << 30);
+            start.n = 2;
+            start.words[0] = value;
+            start.words[1] = 0;
+
+            for (expected = value < 2 ? 2 : value;; expected++)
+            {
+                for (divisor = 2; divisor * divisor <= expected && expected % divisor; divisor++);
+                if (divisor * divisor > expected) break;
+            }
+            ret = nextPrime(&start, 1, 1, &res);
+            assert(ret == 0);
+            assert(res.n == 2 && res.words[0] == expected && res.words[1] == 0);
+            free(res.dummy);
+        }
+
+        /* The largest primes below 2^64 are 2^64 - 59 and 2^64 - 83, the largest one below 2^128 is 2^128 - 159. */
+        start.n = 2;
+        start.words[0] = 0xffffffff - 93;
+        start.words[1] = 0xffffffff;
+        ret = nextPrime(&start, 1, 1, &res);
+        assert(ret == 0);
+        assert(res.words[0] == 0xffffffff - 82 && res.words[1] == 0xffffffff);
+        free(res.dummy);
+        start.words[0] = 0xffffffff - 81;
+        ret = nextPrime(&start, 1, 1, &res);
+        assert(ret == 0);
+        assert(res.words[0] == 0xffffffff - 58 && res.words[1] == 0xffffffff);
+        free(res.dummy);
+        start.words[0] = 0xffffffff - 57;
+        ret = nextPrime(&start, 1, 1, &res);
+        assert(ret != 0);
+        free(res.dummy);
+
+        start.n = 4;
+        start.words[0] = 0xffffffff - 171;
+        start.words[1] = start.words[2] = start.words[3] = 0xffffffff;
+        ret = nextPrime(&start, 10, 1, &res);
+        assert(ret == 0);
+        assert(res.words[0] == 0xffffffff - 158);
+        assert(res.words[1] == 0xffffffff && res.words[2] == 0xffffffff && res.words[3] == 0xffffffff);
+        free(res.dummy);
+
+        for (iter = 0; iter < 20; iter++)
+        {
+            fillRandom(&start, 1 + iter % 4);
+            ret = nextPrime(&start, 5, 1, &res);
+            assert(ret == 0);
+            assert(!lessThan(&res, &start) && isProbablePrime(&res, 5));
+            for (threads = 0; threads <= 4; threads++)
+            {
+                scratch.n = sm_nextPrimeScratchSize(start.n, threads);
+                if (scratch.n > WORD_COUNT) break;
+                ret = sm_nextPrimeScratch(&start, 5, threads, &res2, candidates, &scratch);
+                assert(ret == 0);
+                assert(equal(&res, &res2) && res2.n == start.n);
+            }
+            free(res.dummy);
+        }
+    }
+    {
+        /* Products of powers against modPow, mul and divMod. */
+        BigInt bases[4], exps[4], m, res, expected, power, product, scratch;
+        size_t nM, k, i;
+        int kind, ret;
+
+        for (nM = 1; nM <= 6; nM++)
+        {
+            for (kind = 0; kind < 3; kind++)
+            {
+                for (k = 0; k <= 4 && multiModPowScratchSize(nM, k) <= WORD_COUNT; k++)
+                {
+                    fillRandom(&m, nM);
+                    if (kind == 0) m.words[0] |= 3;
+                    if (kind == 1) m.words[0] = (m.words[0] & ~(uint32_t)1) | 2;
+                    if (kind == 2) memset(m.words, 0, nM * sizeof(m.words[0]));
+
+                    memset(expected.words, 0, nM * sizeof(expected.words[0]));
+                    expected.words[0] = 1;
+                    expected.n = nM;
+                    for (i = 0; i < k; i++)
+                    {
+                        fillRandom(&bases[i], 1 + testRandom() % (2*nM));
+                        fillRandom(&exps[i], 1 + testRandom() % 3);
+                        if (i == 1) memset(exps[i].words, 0, exps[i].n * sizeof(exps[i].words[0]));
+
+                        modPow(&bases[i], &exps[i], &m, &power);
+                        product.n = 2*nM;
+                        ret = mul(&expected, &power, &product);
+                        assert(ret == 0);
+                        divMod(&product, &m, NULL, &expected);
+                        expected.n = nM;
+                        free(power.dummy);
+                    }
+                    ret = multiModPow(bases, exps, k, &m, &res);
+                    assert(ret == 0);
+                    assert(equal(&res, &expected) && res.n == nM);
+                    free(res.dummy);
+
+                    scratch.n = sm_multiModPowScratchSize(nM, k);
+                    if (scratch.n > WORD_COUNT) continue;
+                    res.n = 0;
+                    ret = sm_multiModPowScratch(bases, exps, k, &m, &res, &scratch);
+                    assert(ret == 0);
+                    assert(equal(&res, &expected) && res.n == nM);
+                }
+            }
+        }
+    }
+    {
+        /* The sm_ instance does the exponentiations in the vector lanes if the CPU can. */
+        BigInt bases[4], exps[4], moduli[4], results[4], expected, scratch;
+        size_t nM, i;
+        int round, res;
+
+        for (nM = 1; sm_modPowLanesScratchSize(nM) <= WORD_COUNT; nM++)
+        {
+            for (round = 0; round < 4; round++)
+            {
+                for (i = 0; i < 4; i++)
+                {
+                    fillRandom(&moduli[i], nM);
+                    moduli[i].words[0] |= 3;
+                    if (round == 1) moduli[i].words[nM - 1] = 0;
+                    if (round == 2) moduli[i].words[nM - 1] |= 0x80000000;
+                    fillRandom(&bases[i], 1 + testRandom() % (2*nM));
+                    fillRandom(&exps[i], 1 + testRandom() % 3);
+                }
+                memset(exps[1].words, 0, exps[1].n * sizeof(exps[1].words[0]));
+                /* The even modulus makes it fall back to modPow. */
+                if (round == 3) moduli[2].words[0] ^= 1;
+
+                scratch.n = sm_modPowLanesScratchSize(nM);
+                res = sm_modPowLanesScratch(bases, exps, moduli, results, &scratch);
+                assert(res == 0);
+                for (i = 0; i < 4; i++)
+                {
+                    modPow(&bases[i], &exps[i], &moduli[i], &expected);
+                    assert(equal(&results[i], &expected) && results[i].n == nM);
+                    free(expected.dummy);
+                }
+
+                if (nM > 3) continue;
+                res = modPowLanes(bases, exps, moduli, results);
+                assert(res == 0);
+                for (i = 0; i < 4; i++)
+                {
+                    modPow(&bases[i], &exps[i], &moduli[i], &expected);
+                    assert(equal(&results[i], &expected) && results[i].n == nM);
+                    free(expected.dummy);
+                    free(results[i].dummy);
+                }
+            }
+        }
+    }
+    {
+        /* The lanes repack 64 bit words into the radix 2^26 limbs differently. The sizes go up to the largest modulus the lanes
+         * take (812 words are 1999 limbs, LANE_MAX_LIMBS is 2000) and one word above it, where modPowLanes falls back to modPow. */
+        static const size_t sizes[] = {1, 2, 3, 4, 7, 13, 40, 812, 813};
+        BigInt64 bases[4], exps[4], moduli[4], results[4], expected;
+        size_t s, i;
+        int round, res;
+
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            size_t nM = sizes[s];
+
+            /* Only the largest moduli for the big sizes, the lanes take a while there. */
+            for (round = nM > 40; round < 2; round++)
+            {
+                for (i = 0; i < 4; i++)
+                {
+                    fillRandom64(&moduli[i], nM);
+                    moduli[i].words[0] |= 1;
+                    /* The largest moduli of the size in the second round. */
+                    if (round == 1) moduli[i].words[nM - 1] = ~(uint64_t)0;
+                    fillRandom64(&bases[i], 1 + testRandom() % (2*nM));
+                    fillRandom64(&exps[i], nM > 40 ? 1 : 1 + testRandom() % 3);
+                    /* The lanes square for all bits of the exponent words anyway, a short exponent keeps the reference quick. */
+                    if (nM > 40) exps[i].words[0] %= 1000;
+                }
+
+                res = w64_modPowLanes(bases, exps, moduli, results);
+                assert(res == 0);
+                for (i = 0; i < 4; i++)
+                {
+                    res = w64_modPow(&bases[i], &exps[i], &moduli[i], &expected);
+                    assert(res == 0);
+                    assert(results[i].n == nM && !memcmp(results[i].words, expected.words, nM * sizeof(uint64_t)));
+                    free(expected.words);
+                    free(results[i].words);
+                    free(bases[i].words);
+                    free(exps[i].words);
+                    free(moduli[i].words);
+                }
+            }
+        }
+    }
+    {
+        /* The sm_ instance uses the vector kernels when they are available, compare them with the portable code. */
+        BigInt a, b, res, expected;
+        size_t nA, nB, i;
+
+        INIT_EMPTY(&a);
+        INIT_EMPTY(&b);
+        for (nA = 1; nA <= 70; nA++)
+        {
+            for (nB = 1; nB <= 70; nB += 1 + nB / 8)
+            {
+                fillRandom(&a, nA);
+                fillRandom(&b, nB);
+
+                expected.n = res.n = nA > nB ? nA : nB;
+                and(&a, &b, &expected);
+                sm_and(&a, &b, &res);
+                assert(equal(&res, &expected) && res.n == expected.n);
+                expected.n = res.n = nA > nB ? nA : nB;
+                or(&a, &b, &expected);
+                sm_or(&a, &b, &res);
+                assert(equal(&res, &expected) && res.n == expected.n);
+                expected.n = res.n = nA > nB ? nA : nB;
+                xor(&a, &b, &expected);
+                sm_xor(&a, &b, &res);
+                assert(equal(&res, &expected) && res.n == expected.n);
+            }
+            for (i = 0; i < 8; i++)
+            {
+                unsigned shift = testRandom() % (nA * 32 + 40);
+                unsigned smallShift = 1 + testRandom() % 31;
+                size_t off = testRandom() % nA;
+                uint32_t out, smOut;
+
+                fillRandom(&a, nA);
+                /* Some leading zero words for the zero scan. */
+                memset(a.words + nA - off, 0, off * sizeof(a.words[0]));
+                assert(sm_significantWords(&a) == significantWords(&a));
+                assert(sm_isZero(&a) == isZero(&a));
+
+                expected.n = res.n = nA;
+                shl(&a, &expected, shift);
+                sm_shl(&a, &res, shift);
+                assert(equal(&res, &expected) && res.n == expected.n);
+                expected.n = res.n = nA;
+                shr(&a, &expected, shift);
+                sm_shr(&a, &res, shift);
+                assert(equal(&res, &expected) && res.n == expected.n);
+
+                /* In place with offsets. */
+                fillRandom(&a, nA + off);
+                b = a;
+                out = lshiftN(&a, off, &a, 0, nA, smallShift);
+                smOut = sm_lshiftN(&b, off, &b, 0, nA, smallShift);
+                assert(smOut == out);
+                assert(!memcmp(a.words, b.words, (nA + off) * sizeof(a.words[0])));
+                out = rshiftN(&a, 0, &a, off, nA, smallShift);
+                smOut = sm_rshiftN(&b, 0, &b, off, nA, smallShift);
+                assert(smOut == out);
+                assert(!memcmp(a.words, b.words, (nA + off) * sizeof(a.words[0])));
+            }
+        }
+        memset(a.words, 0, sizeof(a.words));
+        for (nA = 1; nA <= 70; nA++)
+        {
+            a.n = nA;
+            assert(sm_isZero(&a));
+            assert(sm_significantWords(&a) == 0);
+            a.words[nA - 1] = 1;
+            assert(sm_significantWords(&a) == nA);
+            a.words[nA - 1] = 0;
+        }
+    }
+
     printf("ALL is OK! %s %s\n", __DATE__, __TIME__);
     return 0;
 }
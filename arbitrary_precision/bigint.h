@@ -54,12 +54,160 @@
 	#define DUMP_BIGINT(bigint, misc_string)
 #endif
 
+#ifndef GETUSEDWORDS
+    /* Example: #define GETUSEDWORDS(bi) ((bi)->nUsed) */
+    /* The number of words in the bigint without the leading zero words. If the bigint type keeps track of it, this can be defined
+     * to read it, otherwise it's computed by scanning down from the top word. It must be exact.
+     * The algorithms use it to skip the leading zero words. */
+    #define GETUSEDWORDS(bi) FN(significantWords)(bi)
+#endif
+
+/*
+ * DOUBLE_WORD_TYPE can be defined to an unsigned type that has twice the bits of WORD_TYPE (eg. uint64_t for 32 bit words or
+ * unsigned __int128 for 64 bit words). Then mulDigit and divDigit are done by a single widening operation instead of half word arithmetic.
+ */
+
+#ifndef USE_CARRY_BUILTINS
+    /* Non-zero to compute the carries with the __builtin_add_overflow family of the compiler, so they can become add with carry instructions. */
+    #if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+        #define USE_CARRY_BUILTINS 1
+    #else
+        #define USE_CARRY_BUILTINS 0
+    #endif
+#endif
+
+/*
+ * WORD_PTR(bi) can be defined to give a pointer to the words of the bigint, if they are stored in a contiguous array
+ * (eg. #define WORD_PTR(bi) ((bi)->words)). Then the bitwise operations, the shifts and the zero word scans can use vector instructions.
+ */
+
+#ifndef USE_SIMD
+    /* Non-zero to use SSE2 on x86 with GCC or clang, and AVX2 if the CPU supports it (checked at run time). Needs WORD_PTR. */
+    #if defined(WORD_PTR) && defined(__SSE2__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)) && (WORD_BITS == 32 || WORD_BITS == 64)
+        #define USE_SIMD 1
+    #else
+        #define USE_SIMD 0
+    #endif
+#endif
+
+#if USE_SIMD
+    #include <immintrin.h>
+#endif
+
+#ifndef USE_MULX
+    /* Non-zero to use the MULX, ADCX and ADOX instructions for the multiply by word kernels on x86-64 with GCC or clang, if the CPU
+     * supports them (checked at run time). Needs WORD_PTR and 64 bit words. */
+    #if defined(WORD_PTR) && defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)) && WORD_BITS == 64
+        #define USE_MULX 1
+    #else
+        #define USE_MULX 0
+    #endif
+#endif
+
+#if USE_MULX
+    #include <cpuid.h>
+#endif
+
+/*
+ * modPowBatch and nextPrime can spread their work over threads. To enable it define these (the example is for pthreads):
+ *
+ * THREAD_TYPE: The type of the thread handle. (#define THREAD_TYPE pthread_t)
+ * THREAD_ENTRY(name, arg): The header of a thread entry function that takes a void pointer. (#define THREAD_ENTRY(name, arg) void *name(void *arg))
+ * THREAD_RETURN: The statement that ends the thread entry function. (#define THREAD_RETURN return NULL)
+ * THREAD_START(thread, name, arg): Starts a thread, evaluates to zero on success. (#define THREAD_START(thread, name, arg) pthread_create(&(thread), NULL, name, arg))
+ * THREAD_JOIN(thread): Waits for the thread to finish. (#define THREAD_JOIN(thread) pthread_join(thread, NULL))
+ *
+ * The threads access different words of the same scratch bigint at the same time, GETWORD and SETWORD must allow that.
+ * Without THREAD_TYPE everything runs on the calling thread.
+ */
+
 #define HALF_WORD_BITS (WORD_BITS / 2)
 
-#define HALF_WORD_BASE (1 << HALF_WORD_BITS)
+#define HALF_WORD_BASE ((WORD_TYPE)1 << HALF_WORD_BITS)
 
 #define HALF_WORD_MASK (HALF_WORD_BASE - 1)
 
+#ifndef KARATSUBA_THRESHOLD
+    /* The number of words from which mulScratch switches from the schoolbook algorithm to Karatsuba. Must be at least 2. */
+    #define KARATSUBA_THRESHOLD 24
+#endif
+
+#ifndef TOOM3_THRESHOLD
+    /* The number of words from which mulScratch switches from Karatsuba to Toom-Cook 3-way multiplication. Must be larger than KARATSUBA_THRESHOLD. */
+    #define TOOM3_THRESHOLD 96
+#endif
+
+#ifndef NTT_THRESHOLD
+    /* The number of words from which mulScratch switches from Toom-Cook 3-way to number theoretic transform multiplication. */
+    #define NTT_THRESHOLD 2048
+#endif
+
+#ifndef GCD_LEHMER_THRESHOLD
+    /* The number of words from which gcdEuclidean switches from the binary GCD to Lehmer's algorithm. */
+    #define GCD_LEHMER_THRESHOLD 4
+#endif
+
+#ifndef MODPOW_WINDOW
+    /* The maximum number of exponent bits modPow processes at once. It needs a table of 2^(MODPOW_WINDOW - 1) numbers. */
+    #define MODPOW_WINDOW 5
+#endif
+
+#ifndef MODPOW_FIXED_WINDOW
+    /* The number of exponent bits modPowFixedWindow processes at once. It needs a table of 2^MODPOW_FIXED_WINDOW numbers. */
+    #define MODPOW_FIXED_WINDOW 4
+#endif
+
+#ifndef MULTIMODPOW_WINDOW
+    /* The number of exponent bits multiModPow processes at once. It needs a table of 2^MULTIMODPOW_WINDOW - 1 numbers for each base. */
+    #define MULTIMODPOW_WINDOW 4
+#endif
+
+/* The number of exponentiations modPowLanes does at once, in the 64 bit elements of a 256 bit vector. */
+#define MODPOW_LANES 4
+
+#ifndef MODPOW_LANES_WINDOW
+    /* The number of exponent bits modPowLanes processes at once. It needs a table of 2^MODPOW_LANES_WINDOW numbers. */
+    #define MODPOW_LANES_WINDOW 4
+#endif
+
+#ifndef MODPOW_BATCH_MAX_THREADS
+    /* The maximum number of threads modPowBatch uses, including the calling thread. nextPrime shares the limit. */
+    #define MODPOW_BATCH_MAX_THREADS 64
+#endif
+
+#ifndef NEXTPRIME_SIEVE_PRIMES
+    /* The number of small odd primes nextPrime sieves the candidates with. */
+    #define NEXTPRIME_SIEVE_PRIMES 2048
+#endif
+
+#ifndef NEXTPRIME_INTERVAL
+    /* The number of odd candidates a nextPrime thread sieves at once. */
+    #define NEXTPRIME_INTERVAL 4096
+#endif
+
+/* The number of small primes used for trial division and as fixed Miller-Rabin witnesses: the primes up to 131. */
+#define SMALL_PRIME_COUNT 32
+
+/* Primes of the form c*2^k + 1 for the number theoretic transform, their primitive roots and the largest usable k.
+ * For other word sizes the NTT is not available and the multiplication falls back to Toom-Cook. */
+#if WORD_BITS == 32
+    #define NTT_PRIME_1 ((WORD_TYPE)2013265921UL) /* 15*2^27 + 1 */
+    #define NTT_ROOT_1 31
+    #define NTT_PRIME_2 ((WORD_TYPE)998244353UL) /* 119*2^23 + 1 */
+    #define NTT_ROOT_2 3
+    #define NTT_PRIME_3 ((WORD_TYPE)469762049UL) /* 7*2^26 + 1 */
+    #define NTT_ROOT_3 3
+    #define NTT_MAX_LOG 23
+#elif WORD_BITS == 64
+    #define NTT_PRIME_1 (((WORD_TYPE)0x3A000000UL << 32) | 1) /* 29*2^57 + 1 */
+    #define NTT_ROOT_1 3
+    #define NTT_PRIME_2 (((WORD_TYPE)0x22800000UL << 32) | 1) /* 69*2^55 + 1 */
+    #define NTT_ROOT_2 5
+    #define NTT_PRIME_3 (((WORD_TYPE)0x1C800000UL << 32) | 1) /* 57*2^55 + 1 */
+    #define NTT_ROOT_3 7
+    #define NTT_MAX_LOG 55
+#endif
+
 #ifdef NUM_THEORY
 
 /* These functions create big integers within them so the user must provide these macros*/
@@ -116,6 +264,27 @@ SPECIFIER int FN(addDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result);
  */
 SPECIFIER int FN(subDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result);
 
+/**
+ * Adds two words and a carry.
+ *
+ * a, b (in): The two digits to add.
+ * carry (in): The incoming carry, 0 or 1.
+ * result (out): The sum.
+ *
+ * Returns the outgoing carry.
+ */
+SPECIFIER int FN(addCarry)(WORD_TYPE a, WORD_TYPE b, int carry, WORD_TYPE *result);
+
+/**
+ * Subtracts a word and a borrow from a word.
+ *
+ * a, b (in): The two digits to subtract.
+ * borrow (in): The incoming borrow, 0 or 1.
+ * result (out): The difference.
+ *
+ * Returns the outgoing borrow.
+ */
+SPECIFIER int FN(subBorrow)(WORD_TYPE a, WORD_TYPE b, int borrow, WORD_TYPE *result);
 
 /**
  * Multiplies two words together, returns the result in two parts.
@@ -125,6 +294,15 @@ SPECIFIER int FN(subDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result);
  */
 SPECIFIER void FN(mulDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *resultHigh, WORD_TYPE *resultLow);
 
+/**
+ * Divides a two word number by a word.
+ *
+ * high, low (in): The two words of the dividend.
+ * divisor (in): The divisor. Must be larger than high, so the quotient fits into a word.
+ * quotient, remainder (out): The results.
+ */
+SPECIFIER void FN(divDigit)(WORD_TYPE high, WORD_TYPE low, WORD_TYPE divisor, WORD_TYPE *quotient, WORD_TYPE *remainder);
+
 /**
  * Returns non-zero if the passed number is zero.
  *
@@ -169,11 +347,110 @@ SPECIFIER int FN(sub)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *r
  *
  * Outputs must not point to the inputs.
  *
+ * This is the schoolbook algorithm, it doesn't need extra space. For large numbers use mulScratch.
+ *
  * Returns non-zero if the result is truncated.
  */
 SPECIFIER int FN(mul)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result);
 
 
+/**
+ * Returns the number of words the scratch space of mulScratch, mulKaratsuba, mulToom3 and mulNtt must have to multiply an nA and an nB word number.
+ *
+ * nA, nB (in): The number of words in the two arguments.
+ *
+ * Returns zero if the numbers are small enough to be multiplied without scratch space.
+ */
+SPECIFIER size_t FN(mulScratchSize)(size_t nA, size_t nB);
+
+
+/**
+ * Multiplies two big integers using Karatsuba's algorithm.
+ *
+ * a, b, result (in, out): Same as in mul.
+ * scratch (in, out): Temporary space. It must have at least mulScratchSize(nA, nB) words allocated. Its contents are destroyed.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(mulKaratsuba)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch);
+
+
+/**
+ * Multiplies two big integers using the Toom-Cook 3-way algorithm.
+ *
+ * a, b, result (in, out): Same as in mul.
+ * scratch (in, out): Temporary space. It must have at least mulScratchSize(nA, nB) words allocated. Its contents are destroyed.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(mulToom3)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch);
+
+
+/**
+ * Multiplies two big integers using number theoretic transforms modulo three word sized primes.
+ * Available for 32 and 64 bit words and as long as the product has at most 2^23 (2^55 for 64 bit words) words.
+ * Otherwise it falls back to mulToom3.
+ *
+ * a, b, result (in, out): Same as in mul.
+ * scratch (in, out): Temporary space. It must have at least mulScratchSize(nA, nB) words allocated. Its contents are destroyed.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(mulNtt)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch);
+
+
+/**
+ * Multiplies two big integers, chooses the algorithm based on the size of the arguments:
+ * schoolbook below KARATSUBA_THRESHOLD words, Karatsuba below TOOM3_THRESHOLD words, Toom-Cook 3-way below NTT_THRESHOLD words,
+ * number theoretic transform above.
+ * If one number is more than twice as long as the other, the longer one is cut into chunks of the shorter one's size,
+ * and the algorithms work on those. So multiplying by a short number costs time proportional to the length of the long one.
+ *
+ * a, b, result (in, out): Same as in mul.
+ * scratch (opt, in, out): Temporary space with at least mulScratchSize(nA, nB) words allocated.
+ *      If NULL the schoolbook algorithm is used.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(mulScratch)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch);
+
+
+/**
+ * Squares a big integer. Computes every cross product only once, so it's faster than multiplying the number by itself.
+ *
+ * a (in): The number to square.
+ * result (in,out): The result, same as in mul.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(sqr)(const BIGINT_TYPE *a, BIGINT_TYPE *result);
+
+
+/**
+ * Squares a big integer, chooses the algorithm based on the size of the argument, like mulScratch does.
+ *
+ * a (in): The number to square.
+ * result (in,out): The result, same as in mul.
+ * scratch (opt, in, out): Temporary space with at least mulScratchSize(nA, nA) words allocated.
+ *      If NULL the schoolbook algorithm is used.
+ *
+ * Outputs must not point to the inputs.
+ *
+ * Returns non-zero if the result is truncated.
+ */
+SPECIFIER int FN(sqrScratch)(const BIGINT_TYPE *a, BIGINT_TYPE *result, BIGINT_TYPE *scratch);
+
+
 /**
  * Shifts big integer left.
  *
@@ -262,7 +539,7 @@ SPECIFIER int FN(equal)(const BIGINT_TYPE *a, const BIGINT_TYPE *b);
 
 
 /**
- * Bigint long division algorithm.
+ * Bigint long division algorithm. Computes a word of the quotient at a time (Knuth's algorithm D).
  *
  * dividend, divisor (in): as their name suggests...
  * quotient (opt, in, out), remainder (in, out): as their name suggests... The quotient can be NULL if only the modulus is needed.
@@ -282,517 +559,5782 @@ SPECIFIER void FN(divMod)(
     BIGINT_TYPE *remainder
 );
 
-
-#ifdef NUM_THEORY
-
 /**
- * Calculates the greatest common divisor of the big integers.
- *
- * a, b (in): The two numbers of interest.
- * gcd (out): Their GCD. Must be deinitialized by the caller.
+ * Montgomery multiplication. Computes a*b/R mod modulus, where R = 2^(WORD_BITS*n) and n is the number of words in the modulus.
+ * The reduction is interleaved with the multiplication (CIOS method), so no double length product is formed.
  *
- * The number of words in GCD matches the number of words in b.
+ * a, b (in): The factors in Montgomery form, both must be less than the modulus. They can be the same.
+ * modulus (in): The modulus, must be odd.
+ * mInv (in): -modulus^-1 mod 2^WORD_BITS, as computed by montCtxInit.
+ * result (out): The product in Montgomery form. Must have the same number of words allocated as the modulus.
  *
+ * The result must not be the same as the inputs.
  */
-SPECIFIER void FN(gcdEuclidean)(
+SPECIFIER void FN(montMul)(
     const BIGINT_TYPE *a,
     const BIGINT_TYPE *b,
-    BIGINT_TYPE *gcd
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    BIGINT_TYPE *result
 );
 
 /**
- * Solves the ax + by = gcd(a,b) equation on integer numbers.
- *
- * a, b (in): The two input parameters.
- * x, y, gcd (out): The two unknown and the coefficient, they will be calculated by the algorithm. Must be deinitalized by the caller.
+ * Converts a number into Montgomery form: computes a*R mod modulus.
  *
- * The x, y and gcd is initialized by this function.
- * The x will have the same amount of words as b.
- * The y will have the same amount of words as a.
- * The gcd will have the same amount of words as b.
+ * a (in): The number to convert, must be less than the modulus.
+ * modulus, mInv, r2 (in): The Montgomery context, as computed by montCtxInit.
+ * result (out): The number in Montgomery form. Must have the same number of words allocated as the modulus.
  *
+ * The result must not be the same as the input.
  */
-SPECIFIER void FN(gcdExtendedEuclidean)(
+SPECIFIER void FN(montToDomain)(
     const BIGINT_TYPE *a,
-    const BIGINT_TYPE *b,
-    BIGINT_TYPE *x,
-    BIGINT_TYPE *y,
-    BIGINT_TYPE *gcd
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    const BIGINT_TYPE *r2,
+    BIGINT_TYPE *result
 );
 
-
 /**
- * Performs integer exponentiation modulo a given number.
+ * Converts a number back from Montgomery form: computes a/R mod modulus.
  *
- * base, exponent, modulo (in): The inputs.
- * result (out): The result. It will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ * a (in): The number in Montgomery form, must be less than the modulus.
+ * modulus, mInv (in): The Montgomery context, as computed by montCtxInit.
+ * result (out): The normal number. Must have the same number of words allocated as the modulus.
  *
- * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ * The result must not be the same as the input.
  */
-SPECIFIER int FN(modPow)(
-    const BIGINT_TYPE *base,
-    const BIGINT_TYPE *exponent,
-    const BIGINT_TYPE *modulo,
+SPECIFIER void FN(montFromDomain)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
     BIGINT_TYPE *result
 );
 
 /**
- * Performs Miller-Rabin primality test.
+ * Returns the number of words the scratch space of barrettReduce and modMulBarrett needs for an n word modulus.
+ */
+SPECIFIER size_t FN(barrettScratchSize)(size_t n);
+
+/**
+ * Barrett reduction. Computes x mod modulus using only multiplications, with the reciprocal precomputed by barrettCtxInit.
  *
- * toTest (in): The number to test. This number must be odd and must be larger than 2, otherwise the behavior of the function is not defined.
- * witnessToTest (in): The witness to test with.
+ * x (in): The number to reduce. Must be less than b^2k, where b = 2^WORD_BITS and k is the number of nonzero words of the modulus.
+ *         (So the product of two reduced numbers is fine.)
+ * modulus, mu (in): The Barrett context, as computed by barrettCtxInit.
+ * result (out): The remainder. Must have the same number of words allocated as the modulus. It can be the same as x.
+ * scratch (in): Scratch space, it must have barrettScratchSize(GETNWORDS(modulus)) words.
+ */
+SPECIFIER void FN(barrettReduce)(
+    const BIGINT_TYPE *x,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Modular multiplication with Barrett reduction: computes a*b mod modulus.
  *
- * Returns zero if `toTest` is composite. Returns non-zero if it may be prime.
+ * a, b (in): The factors, both must be less than the modulus. They can be the same.
+ * modulus, mu (in): The Barrett context, as computed by barrettCtxInit.
+ * result (out): The product. Must have the same number of words allocated as the modulus. It can be the same as the inputs.
+ * scratch (in): Scratch space, it must have barrettScratchSize(GETNWORDS(modulus)) words.
  */
-SPECIFIER int FN(mrTest)(
-    const BIGINT_TYPE *toTest,
-    const BIGINT_TYPE *witnessToTest
+SPECIFIER void FN(modMulBarrett)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
 );
 
 
+/*
+ * Allocation free variants of the number theoretic functions.
+ *
+ * The caller provides a single scratch bigint, its required number of words is returned by the matching ...ScratchSize function.
+ * The outputs must have the documented number of words allocated, so these functions work on fixed size bigints too.
+ * The functions of the NUM_THEORY section are wrappers that allocate the output and the scratch and call these.
+ */
+
+/**
+ * Returns the number of scratch words gcdScratch needs for an nA and an nB word input.
+ */
+SPECIFIER size_t FN(gcdScratchSize)(size_t nA, size_t nB);
+
 /**
- * Performs multiplication just like mul, but it will allocate storage for the result instead of relying on the caller.
+ * Calculates the greatest common divisor of the big integers, like gcdEuclidean.
  *
- * a, b (in): The arguments to multiply.
- * res (out): The result, the caller most clean it up.
+ * a, b (in): The two numbers of interest.
+ * gcd (out): Their GCD. Must have the same number of words allocated as b.
+ * scratch (in): The scratch space, must have at least gcdScratchSize(GETNWORDS(a), GETNWORDS(b)) words.
  */
-SPECIFIER void mulEx(
+SPECIFIER void FN(gcdScratch)(
     const BIGINT_TYPE *a,
     const BIGINT_TYPE *b,
-    BIGINT_TYPE *res
+    BIGINT_TYPE *gcd,
+    BIGINT_TYPE *scratch
 );
 
+/**
+ * Returns the number of scratch words gcdExtendedScratch needs for an nA and an nB word input.
+ */
+SPECIFIER size_t FN(gcdExtendedScratchSize)(size_t nA, size_t nB);
 
 /**
- *  Computes the least common multiple.
+ * Solves the ax + by = gcd(a,b) equation like gcdExtendedEuclidean.
  *
- *  a,b (in): The two numbers.
- *  lcm (out): The result. The caller must clean it up.
+ * a, b (in): The two input parameters.
+ * x, gcd (out): Must have the same number of words allocated as b.
+ * y (out): Must have the same number of words allocated as a.
+ * scratch (in): The scratch space, must have at least gcdExtendedScratchSize(GETNWORDS(a), GETNWORDS(b)) words.
  */
-SPECIFIER void FN(lcm)(
+SPECIFIER void FN(gcdExtendedScratch)(
     const BIGINT_TYPE *a,
     const BIGINT_TYPE *b,
-    BIGINT_TYPE *lcm
+    BIGINT_TYPE *x,
+    BIGINT_TYPE *y,
+    BIGINT_TYPE *gcd,
+    BIGINT_TYPE *scratch
 );
-#endif
 
+/**
+ * Returns the number of scratch words modInverseScratch needs for an nA word number and an nM word modulus.
+ */
+SPECIFIER size_t FN(modInverseScratchSize)(size_t nA, size_t nM);
 
-#endif
+/**
+ * Computes the modular inverse like modInverse.
+ *
+ * a, modulus (in): The inputs. The modulus must not be zero.
+ * result (out): The inverse. Must have the same number of words allocated as the modulus.
+ * scratch (in): The scratch space, must have at least modInverseScratchSize(GETNWORDS(a), GETNWORDS(modulus)) words.
+ *
+ * Returns 0 on success. Returns -1 if there is no inverse, the result is zero then.
+ */
+SPECIFIER int FN(modInverseScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
 
-#ifdef DEFINE_STUFF
+/**
+ * Returns the number of scratch words montCtxInitScratch needs for an n word modulus.
+ */
+SPECIFIER size_t FN(montCtxScratchSize)(size_t n);
 
-SPECIFIER int FN(addDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result)
-{
-    *result = a + b;
-    return *result < a;
-}
+/**
+ * Sets up the Montgomery context like montCtxInit.
+ *
+ * modulus (in): The modulus, must be odd.
+ * mInv (out): -modulus^-1 mod 2^WORD_BITS.
+ * r2 (out): R^2 mod modulus. Must have the same number of words allocated as the modulus.
+ * scratch (in): The scratch space, must have at least montCtxScratchSize(GETNWORDS(modulus)) words.
+ */
+SPECIFIER void FN(montCtxInitScratch)(
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE *mInv,
+    BIGINT_TYPE *r2,
+    BIGINT_TYPE *scratch
+);
 
+/**
+ * Returns the number of scratch words barrettCtxInitScratch needs for an n word modulus.
+ */
+SPECIFIER size_t FN(barrettCtxScratchSize)(size_t n);
 
-SPECIFIER int FN(subDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result)
-{
-    *result = a - b;
-    return *result > a;
-}
+/**
+ * Sets up the Barrett context like barrettCtxInit.
+ *
+ * modulus (in): The modulus, must not be zero.
+ * mu (out): floor(b^2k / modulus). Must have k + 1 words allocated, where k is the number of nonzero words of the modulus.
+ * scratch (in): The scratch space, must have at least barrettCtxScratchSize(GETNWORDS(modulus)) words.
+ */
+SPECIFIER void FN(barrettCtxInitScratch)(
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *mu,
+    BIGINT_TYPE *scratch
+);
 
+/**
+ * Returns the number of scratch words modPowScratch needs for an nMod word modulus.
+ */
+SPECIFIER size_t FN(modPowScratchSize)(size_t nMod);
 
-SPECIFIER void FN(mulDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *resultHigh, WORD_TYPE *resultLow)
-{
-    /*
-        Split the numbers to two halves a_1 and a_0, to be able to do the multiplication.
-        To get the result do this:
-        Math: (a_1 H + a_0)(b_1 H + b_0) = a_1 b_1 H^2 + (a_0 b_1 + a_1 b_0) H + a_0 b_0
-    */
-    WORD_TYPE a_0 = a & HALF_WORD_MASK;
-    WORD_TYPE a_1 = a >> HALF_WORD_BITS;
-    WORD_TYPE b_0 = b & HALF_WORD_MASK;
-    WORD_TYPE b_1 = b >> HALF_WORD_BITS;
-    WORD_TYPE overlapping1 = a_0*b_1;
-    WORD_TYPE overlapping2 = a_1*b_0;
+/**
+ * Performs integer exponentiation modulo a given number just like modPow, but the caller provides the scratch space.
+ * It holds the Barrett context, the table of the precomputed powers and the space for the multiplications.
+ *
+ * base, exponent, modulo (in): The inputs.
+ * result (out): The result. Must have the same number of words allocated as the modulo. Must not be the same as the inputs.
+ * scratch (in): The scratch space, must have at least modPowScratchSize(GETNWORDS(modulo)) words.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ */
+SPECIFIER int FN(modPowScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
 
-    /* First the easy part. The initial values of the two halves.*/
-    *resultHigh = a_1*b_1;
-    *resultLow = a_0*b_0;
+/**
+ * Returns the number of scratch words modPowMontScratch needs for an nMod word modulus.
+ */
+SPECIFIER size_t FN(modPowMontScratchSize)(size_t nMod);
+
+/**
+ * Performs integer exponentiation like modPowMont, with caller provided scratch space.
+ *
+ * base, exponent, modulo (in): The inputs. For even modulo this function falls back to modPowScratch.
+ * result (out): The result. Must have the same number of words allocated as the modulo. Must not be the same as the inputs.
+ * scratch (in): The scratch space, must have at least modPowMontScratchSize(GETNWORDS(modulo)) words.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ */
+SPECIFIER int FN(modPowMontScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words modPowFixedWindowScratch needs for an nMod word modulus.
+ */
+SPECIFIER size_t FN(modPowFixedWindowScratchSize)(size_t nMod);
+
+/**
+ * Performs integer exponentiation like modPowFixedWindow, with caller provided scratch space.
+ *
+ * base, exponent, modulo (in): The inputs.
+ * result (out): The result. Must have the same number of words allocated as the modulo. Must not be the same as the inputs.
+ * scratch (in): The scratch space, must have at least modPowFixedWindowScratchSize(GETNWORDS(modulo)) words.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ */
+SPECIFIER int FN(modPowFixedWindowScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words modPowBatchScratch needs for an nMod word modulus and the given number of threads.
+ */
+SPECIFIER size_t FN(modPowBatchScratchSize)(size_t nMod, size_t threadCount);
+
+/**
+ * Performs many exponentiations with the same modulo like modPowBatch, with caller provided scratch space.
+ *
+ * bases, exponents (in): Arrays of n numbers.
+ * modulo (in): The modulo, shared by all of them.
+ * results (out): Array of n numbers. Each one must have the same number of words allocated as the modulo.
+ * n (in): The number of exponentiations.
+ * threadCount (in): The number of threads to use, must be the same as the one given to modPowBatchScratchSize.
+ * scratch (in): The scratch space, must have at least modPowBatchScratchSize(GETNWORDS(modulo), threadCount) words.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(modPowBatchScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *results,
+    size_t n,
+    size_t threadCount,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words multiModPowScratch needs for an nMod word modulus and k bases.
+ */
+SPECIFIER size_t FN(multiModPowScratchSize)(size_t nMod, size_t k);
+
+/**
+ * Computes a product of powers like multiModPow, with caller provided scratch space.
+ *
+ * bases, exponents (in): Arrays of k numbers.
+ * k (in): The number of bases.
+ * modulo (in): The modulo.
+ * result (out): The result. Must have the same number of words allocated as the modulo. Must not be the same as the inputs.
+ * scratch (in): The scratch space, must have at least multiModPowScratchSize(GETNWORDS(modulo), k) words.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(multiModPowScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    size_t k,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words modPowLanesScratch needs for nMod word moduli.
+ */
+SPECIFIER size_t FN(modPowLanesScratchSize)(size_t nMod);
+
+/**
+ * Performs MODPOW_LANES exponentiations at once like modPowLanes, with caller provided scratch space.
+ *
+ * bases, exponents, moduli (in): Arrays of MODPOW_LANES numbers. The moduli must have the same number of words.
+ * results (out): Array of MODPOW_LANES numbers. Each one must have the same number of words allocated as the moduli.
+ * scratch (in): The scratch space, must have at least modPowLanesScratchSize(GETNWORDS(&moduli[0])) words.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(modPowLanesScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *moduli,
+    BIGINT_TYPE *results,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words mrTestScratch needs for an n word number.
+ */
+SPECIFIER size_t FN(mrTestScratchSize)(size_t n);
+
+/**
+ * Performs Miller-Rabin primality test like mrTest, with caller provided scratch space.
+ *
+ * toTest (in): The number to test. This number must be odd and must be larger than 2.
+ * witnessToTest (in): The witness to test with.
+ * scratch (in): The scratch space, must have at least mrTestScratchSize(GETNWORDS(toTest)) words.
+ *
+ * Returns zero if `toTest` is composite. Returns non-zero if it may be prime.
+ */
+SPECIFIER int FN(mrTestScratch)(
+    const BIGINT_TYPE *toTest,
+    const BIGINT_TYPE *witnessToTest,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words isProbablePrimeScratch needs for an n word number.
+ */
+SPECIFIER size_t FN(isProbablePrimeScratchSize)(size_t n);
+
+/**
+ * Tests whether a number is prime like isProbablePrime, with caller provided scratch space.
+ *
+ * toTest (in): The number to test.
+ * rounds (in): The number of Miller-Rabin rounds for numbers above 64 bits.
+ * scratch (in): The scratch space, must have at least isProbablePrimeScratchSize(GETNWORDS(toTest)) words.
+ *
+ * Returns non-zero if `toTest` is prime (or probably prime above 64 bits), zero otherwise.
+ */
+SPECIFIER int FN(isProbablePrimeScratch)(
+    const BIGINT_TYPE *toTest,
+    int rounds,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words nextPrimeScratch needs for an n word start and the given number of threads.
+ */
+SPECIFIER size_t FN(nextPrimeScratchSize)(size_t n, size_t threadCount);
+
+/**
+ * Finds the next prime like nextPrime, with caller provided scratch space.
+ *
+ * start (in): The search starts here.
+ * rounds (in): The number of Miller-Rabin rounds for numbers above 64 bits.
+ * threadCount (in): The number of threads to use, must be the same as the one given to nextPrimeScratchSize.
+ * result (out): The prime. Must have the same amount of words allocated as the start.
+ * candidates (in): Work space of the threads: an array of threadCount numbers (at most MODPOW_BATCH_MAX_THREADS are used), each must
+ *     have the same amount of words allocated as the start.
+ * scratch (in): The scratch space, must have at least nextPrimeScratchSize(GETNWORDS(start), threadCount) words.
+ *
+ * Returns non-zero if there is no prime from the start that fits into its words.
+ */
+SPECIFIER int FN(nextPrimeScratch)(
+    const BIGINT_TYPE *start,
+    int rounds,
+    size_t threadCount,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *candidates,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words isPrimeBPSWScratch needs for an n word number.
+ */
+SPECIFIER size_t FN(isPrimeBPSWScratchSize)(size_t n);
+
+/**
+ * Tests whether a number is prime like isPrimeBPSW, with caller provided scratch space.
+ *
+ * toTest (in): The number to test.
+ * scratch (in): The scratch space, must have at least isPrimeBPSWScratchSize(GETNWORDS(toTest)) words.
+ *
+ * Returns non-zero if `toTest` is prime (or probably prime above 64 bits), zero otherwise.
+ */
+SPECIFIER int FN(isPrimeBPSWScratch)(
+    const BIGINT_TYPE *toTest,
+    BIGINT_TYPE *scratch
+);
+
+/**
+ * Returns the number of scratch words lcmScratch needs for an nA and an nB word input.
+ */
+SPECIFIER size_t FN(lcmScratchSize)(size_t nA, size_t nB);
+
+/**
+ * Computes the least common multiple like lcm.
+ *
+ * a, b (in): The two numbers.
+ * lcm (out): The result. Must have GETNWORDS(a) + GETNWORDS(b) words allocated.
+ * scratch (in): The scratch space, must have at least lcmScratchSize(GETNWORDS(a), GETNWORDS(b)) words.
+ */
+SPECIFIER void FN(lcmScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *lcm,
+    BIGINT_TYPE *scratch
+);
+
+
+#ifdef NUM_THEORY
+
+/**
+ * Calculates the greatest common divisor of the big integers.
+ *
+ * a, b (in): The two numbers of interest.
+ * gcd (out): Their GCD. Must be deinitialized by the caller.
+ *
+ * The number of words in GCD matches the number of words in b.
+ *
+ * Uses the binary GCD algorithm for small numbers and Lehmer's algorithm from GCD_LEHMER_THRESHOLD words.
+ */
+SPECIFIER void FN(gcdEuclidean)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *gcd
+);
+
+/**
+ * Solves the ax + by = gcd(a,b) equation on integer numbers.
+ *
+ * a, b (in): The two input parameters.
+ * x, y, gcd (out): The two unknown and the coefficient, they will be calculated by the algorithm. Must be deinitalized by the caller.
+ *
+ * The x, y and gcd is initialized by this function.
+ * The x will have the same amount of words as b.
+ * The y will have the same amount of words as a.
+ * The gcd will have the same amount of words as b.
+ *
+ */
+SPECIFIER void FN(gcdExtendedEuclidean)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *x,
+    BIGINT_TYPE *y,
+    BIGINT_TYPE *gcd
+);
+
+/**
+ * Computes the modular inverse: the x for which a*x ≡ 1 (mod modulus).
+ *
+ * a, modulus (in): The inputs. The modulus must not be zero.
+ * result (out): The inverse, less than the modulus. It will hold the same amount of words as the modulus holds, must be deinitialized by the user.
+ *
+ * Returns 0 on success. Returns -1 if a and the modulus are not coprime, so there is no inverse, the result is zero then.
+ */
+SPECIFIER int FN(modInverse)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *result
+);
+
+
+/**
+ * Sets up the Montgomery context for the given modulus.
+ *
+ * modulus (in): The modulus, must be odd.
+ * mInv (out): -modulus^-1 mod 2^WORD_BITS.
+ * r2 (out): R^2 mod modulus, where R = 2^(WORD_BITS*n) and n is the number of words in the modulus. It will hold the same amount of words as the modulus holds, must be deinitialized by the user.
+ */
+SPECIFIER void FN(montCtxInit)(
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE *mInv,
+    BIGINT_TYPE *r2
+);
+
+/**
+ * Sets up the Barrett context for the given modulus.
+ *
+ * modulus (in): The modulus, must not be zero.
+ * mu (out): floor(b^2k / modulus), where b = 2^WORD_BITS and k is the number of nonzero words of the modulus.
+ *           It will hold k + 1 words, must be deinitialized by the user.
+ */
+SPECIFIER void FN(barrettCtxInit)(
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *mu
+);
+
+/**
+ * Performs integer exponentiation modulo a given number.
+ * Uses sliding window exponentiation, with windows of at most MODPOW_WINDOW bits.
+ *
+ * base, exponent, modulo (in): The inputs.
+ * result (out): The result. It will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ */
+SPECIFIER int FN(modPow)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+);
+
+/**
+ * Performs integer exponentiation modulo a given number, like modPow, but does the calculations in Montgomery form.
+ * So there are no divisions in the inner loop.
+ *
+ * base, exponent, modulo (in): The inputs. The modulo should be odd, for even modulo this function falls back to modPow.
+ * result (out): The result. It will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ * (Only possible in the modPow fallback.)
+ */
+SPECIFIER int FN(modPowMont)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+);
+
+/**
+ * Performs integer exponentiation modulo a given number, with fixed windows of MODPOW_FIXED_WINDOW bits.
+ * The sequence of squarings and multiplications only depends on the number of words in the exponent, not on its bits.
+ * The table lookups read the whole table. So it's suitable for private key operations.
+ * For odd modulo the calculations are done in Montgomery form, otherwise Barrett reduction is used.
+ *
+ * base, exponent, modulo (in): The inputs.
+ * result (out): The result. It will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ *
+ * Returns non-zero if truncation occured during the calculation this also indicates the result is incorrect.
+ */
+SPECIFIER int FN(modPowFixedWindow)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+);
+
+/**
+ * Performs many exponentiations with the same modulo: results[i] = bases[i]^exponents[i] mod modulo.
+ * The Montgomery (odd modulo) or Barrett (even modulo) context is computed only once, then the exponentiations are done with
+ * sliding windows like modPow. They are distributed among threadCount threads (including the calling one) if threads are
+ * configured (see THREAD_TYPE), each thread has its own part of the scratch space.
+ *
+ * bases, exponents (in): Arrays of n numbers.
+ * modulo (in): The modulo, shared by all of them.
+ * results (out): Array of n numbers. Each one will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ * n (in): The number of exponentiations.
+ * threadCount (in): The number of threads to use. At most MODPOW_BATCH_MAX_THREADS are used.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(modPowBatch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *results,
+    size_t n,
+    size_t threadCount
+);
+
+/**
+ * Computes a product of powers: bases[0]^exponents[0] * bases[1]^exponents[1] * ... * bases[k-1]^exponents[k-1] mod modulo.
+ * Uses Straus' method: the exponents are scanned together in windows of MULTIMODPOW_WINDOW bits, so the squarings are shared
+ * and only the multiplications by the table entries grow with k. For a few bases it costs little more than a single modPow.
+ * For odd modulo the calculations are done in Montgomery form, otherwise Barrett reduction is used.
+ *
+ * bases, exponents (in): Arrays of k numbers.
+ * k (in): The number of bases.
+ * modulo (in): The modulo.
+ * result (out): The result. It will hold the same amount of words as the modulo holds, must be deinitialized by the user.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(multiModPow)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    size_t k,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+);
+
+/**
+ * Performs MODPOW_LANES independent exponentiations: results[i] = bases[i]^exponents[i] mod moduli[i].
+ * With USE_SIMD and a CPU that has AVX2 they run together in the lanes of the vector unit: the numbers are converted into an
+ * interleaved radix 2^26 form and the Montgomery multiplications work on all of them at once. The exponentiation uses fixed
+ * windows of MODPOW_LANES_WINDOW bits and reads the whole table, like modPowFixedWindow.
+ * Otherwise, or if a modulus is even, they are done one after the other like modPow.
+ *
+ * bases, exponents, moduli (in): Arrays of MODPOW_LANES numbers. The moduli must have the same number of words.
+ * results (out): Array of MODPOW_LANES numbers. Each one will hold the same amount of words as the moduli, must be deinitialized by the user.
+ *
+ * Always returns 0: the results are reduced modulo the modulus, so they fit into the words they are given.
+ */
+SPECIFIER int FN(modPowLanes)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *moduli,
+    BIGINT_TYPE *results
+);
+
+/**
+ * Performs Miller-Rabin primality test.
+ *
+ * toTest (in): The number to test. This number must be odd and must be larger than 2, otherwise the behavior of the function is not defined.
+ * witnessToTest (in): The witness to test with.
+ *
+ * Returns zero if `toTest` is composite. Returns non-zero if it may be prime.
+ */
+SPECIFIER int FN(mrTest)(
+    const BIGINT_TYPE *toTest,
+    const BIGINT_TYPE *witnessToTest
+);
+
+/**
+ * Tests whether a number is prime.
+ *
+ * It tries to divide by the small primes first, then performs Miller-Rabin tests with the small primes as witnesses.
+ * The answer is exact below 2^64. Above that `rounds` tests are done (at least 1, at most 32), the witnesses are
+ * always the same, so for numbers that may come from an adversary add mrTest calls with random witnesses too.
+ *
+ * toTest (in): The number to test. It can be any number, including 0, 1 and even numbers.
+ * rounds (in): The number of Miller-Rabin rounds for numbers above 64 bits.
+ *
+ * Returns non-zero if `toTest` is prime (or probably prime above 64 bits), zero otherwise.
+ */
+SPECIFIER int FN(isProbablePrime)(
+    const BIGINT_TYPE *toTest,
+    int rounds
+);
+
+/**
+ * Finds the smallest (probable) prime that is not less than the start. For a random prime pass a random start.
+ *
+ * The odd numbers from the start are sieved in intervals of NEXTPRIME_INTERVAL with the first NEXTPRIME_SIEVE_PRIMES odd
+ * primes, the remainders are kept for each small prime and updated by addition from interval to interval. Only the candidates
+ * that survive the sieve are tested with isProbablePrime. The intervals are distributed among threadCount threads (including
+ * the calling one) if threads are configured (see THREAD_TYPE). The result is the same for any number of threads.
+ *
+ * start (in): The search starts here.
+ * rounds (in): The number of Miller-Rabin rounds for numbers above 64 bits, see isProbablePrime.
+ * threadCount (in): The number of threads to use. At most MODPOW_BATCH_MAX_THREADS are used.
+ * result (out): The prime. It will hold the same amount of words as the start holds, must be deinitialized by the user.
+ *
+ * Returns non-zero if there is no prime from the start that fits into its words.
+ */
+SPECIFIER int FN(nextPrime)(
+    const BIGINT_TYPE *start,
+    int rounds,
+    size_t threadCount,
+    BIGINT_TYPE *result
+);
+
+/**
+ * Tests whether a number is prime with the Baillie-PSW test.
+ *
+ * After trial division by the small primes it does a strong probable prime test to base 2 (like mrTest) and a strong Lucas
+ * probable prime test with Selfridge's parameters. No composite number is known that passes both and there is none below 2^64.
+ * It costs about as much as three or four Miller-Rabin rounds, far less than the number of rounds needed for a similar confidence.
+ *
+ * toTest (in): The number to test. It can be any number, including 0, 1 and even numbers.
+ *
+ * Returns non-zero if `toTest` is prime (or probably prime above 64 bits), zero otherwise.
+ */
+SPECIFIER int FN(isPrimeBPSW)(
+    const BIGINT_TYPE *toTest
+);
+
+
+/**
+ * Performs multiplication just like mul, but it will allocate storage for the result instead of relying on the caller.
+ *
+ * a, b (in): The arguments to multiply.
+ * res (out): The result, the caller most clean it up.
+ */
+SPECIFIER void FN(mulEx)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *res
+);
+
+
+/**
+ *  Computes the least common multiple.
+ *
+ *  a,b (in): The two numbers.
+ *  lcm (out): The result. The caller must clean it up.
+ */
+SPECIFIER void FN(lcm)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *lcm
+);
+#endif
+
+
+#endif
+
+#ifdef DEFINE_STUFF
+
+SPECIFIER int FN(addDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result)
+{
+#if USE_CARRY_BUILTINS
+    return __builtin_add_overflow(a, b, result);
+#else
+    *result = a + b;
+    return *result < a;
+#endif
+}
+
+
+SPECIFIER int FN(subDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *result)
+{
+#if USE_CARRY_BUILTINS
+    return __builtin_sub_overflow(a, b, result);
+#else
+    *result = a - b;
+    return *result > a;
+#endif
+}
+
+
+SPECIFIER int FN(addCarry)(WORD_TYPE a, WORD_TYPE b, int carry, WORD_TYPE *result)
+{
+    /* At most one of the two additions can overflow. */
+    WORD_TYPE tmp;
+    int c = FN(addDigit)(a, b, &tmp);
+
+    return c | FN(addDigit)(tmp, (WORD_TYPE)carry, result);
+}
+
+
+SPECIFIER int FN(subBorrow)(WORD_TYPE a, WORD_TYPE b, int borrow, WORD_TYPE *result)
+{
+    WORD_TYPE tmp;
+    int c = FN(subDigit)(a, b, &tmp);
+
+    return c | FN(subDigit)(tmp, (WORD_TYPE)borrow, result);
+}
+
+
+#ifdef DOUBLE_WORD_TYPE
+
+SPECIFIER void FN(mulDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *resultHigh, WORD_TYPE *resultLow)
+{
+    DOUBLE_WORD_TYPE product = (DOUBLE_WORD_TYPE)a * b;
+
+    *resultHigh = (WORD_TYPE)(product >> WORD_BITS);
+    *resultLow = (WORD_TYPE)product;
+}
+
+
+SPECIFIER void FN(divDigit)(WORD_TYPE high, WORD_TYPE low, WORD_TYPE divisor, WORD_TYPE *quotient, WORD_TYPE *remainder)
+{
+    DOUBLE_WORD_TYPE dividend = ((DOUBLE_WORD_TYPE)high << WORD_BITS) | low;
+
+    *quotient = (WORD_TYPE)(dividend / divisor);
+    *remainder = (WORD_TYPE)(dividend % divisor);
+}
+
+#else
+
+SPECIFIER void FN(mulDigit)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE *resultHigh, WORD_TYPE *resultLow)
+{
+    /*
+        Split the numbers to two halves a_1 and a_0, to be able to do the multiplication.
+        To get the result do this:
+        Math: (a_1 H + a_0)(b_1 H + b_0) = a_1 b_1 H^2 + (a_0 b_1 + a_1 b_0) H + a_0 b_0
+    */
+    WORD_TYPE a_0 = a & HALF_WORD_MASK;
+    WORD_TYPE a_1 = a >> HALF_WORD_BITS;
+    WORD_TYPE b_0 = b & HALF_WORD_MASK;
+    WORD_TYPE b_1 = b >> HALF_WORD_BITS;
+    WORD_TYPE overlapping1 = a_0*b_1;
+    WORD_TYPE overlapping2 = a_1*b_0;
+
+    /* First the easy part. The initial values of the two halves.*/
+    *resultHigh = a_1*b_1;
+    *resultLow = a_0*b_0;
+
+    /* Now apply the intermediates:*/
+
+    *resultHigh += FN(addDigit)(*resultLow, overlapping1 << HALF_WORD_BITS, resultLow);
+    *resultHigh += FN(addDigit)(*resultLow, overlapping2 << HALF_WORD_BITS, resultLow);
+    FN(addDigit)(*resultHigh, overlapping1 >> HALF_WORD_BITS, resultHigh);
+    FN(addDigit)(*resultHigh, overlapping2 >> HALF_WORD_BITS, resultHigh);
+}
+
+
+SPECIFIER void FN(divDigit)(WORD_TYPE high, WORD_TYPE low, WORD_TYPE divisor, WORD_TYPE *quotient, WORD_TYPE *remainder)
+{
+    /*
+        Long division in half words, the dividend has four of them, the divisor has two. (Hacker's Delight, divlu)
+        The divisor is normalized first so its top bit is set, this way the estimation of each quotient half word
+        from the top half word of the divisor is off by at most 2.
+    */
+    unsigned shift = 0;
+    WORD_TYPE divHigh, divLow, lowHigh, lowLow;
+    WORD_TYPE q1, q0, rHat, mid;
+
+    while (!(divisor >> (WORD_BITS - 1)))
+    {
+        divisor <<= 1;
+        shift++;
+    }
+    if (shift)
+    {
+        high = (high << shift) | (low >> (WORD_BITS - shift));
+        low <<= shift;
+    }
+
+    divHigh = divisor >> HALF_WORD_BITS;
+    divLow = divisor & HALF_WORD_MASK;
+    lowHigh = low >> HALF_WORD_BITS;
+    lowLow = low & HALF_WORD_MASK;
+
+    q1 = high / divHigh;
+    rHat = high - q1*divHigh;
+    while (q1 >= HALF_WORD_BASE || q1*divLow > ((rHat << HALF_WORD_BITS) | lowHigh))
+    {
+        q1--;
+        rHat += divHigh;
+        if (rHat >= HALF_WORD_BASE) break;
+    }
+
+    /* The middle part of the remainder, it fits into a word. */
+    mid = (high << HALF_WORD_BITS) + lowHigh - q1*divisor;
+
+    q0 = mid / divHigh;
+    rHat = mid - q0*divHigh;
+    while (q0 >= HALF_WORD_BASE || q0*divLow > ((rHat << HALF_WORD_BITS) | lowLow))
+    {
+        q0--;
+        rHat += divHigh;
+        if (rHat >= HALF_WORD_BASE) break;
+    }
+
+    *quotient = (q1 << HALF_WORD_BITS) | q0;
+    *remainder = ((mid << HALF_WORD_BITS) + lowLow - q0*divisor) >> shift;
+}
+
+#endif
+
+
+#if USE_SIMD
+
+/*
+ * Vector kernels on the word arrays given by WORD_PTR. Each one has an SSE2 and an AVX2 version, the latter is chosen at run time
+ * if the CPU supports it. The words that don't fill a whole vector are processed one by one.
+ */
+
+#if WORD_BITS == 64
+    #define SIMD_SLL_128 _mm_sll_epi64
+    #define SIMD_SRL_128 _mm_srl_epi64
+    #define SIMD_SLL_256 _mm256_sll_epi64
+    #define SIMD_SRL_256 _mm256_srl_epi64
+#else
+    #define SIMD_SLL_128 _mm_sll_epi32
+    #define SIMD_SRL_128 _mm_srl_epi32
+    #define SIMD_SLL_256 _mm256_sll_epi32
+    #define SIMD_SRL_256 _mm256_srl_epi32
+#endif
+
+#define SIMD_AVX2 __attribute__((target("avx2")))
+
+/* r[i] = a[i] op b[i] for i < n, where op is 0 for and, 1 for or, 2 for xor. r can be the same as a or b. */
+SPECIFIER void FN(bitwiseWordsSse2)(WORD_TYPE *r, const WORD_TYPE *a, const WORD_TYPE *b, size_t n, int op)
+{
+    size_t step = sizeof(__m128i) / sizeof(WORD_TYPE);
+    size_t i;
+
+    for (i = 0; i + step <= n; i += step)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+
+        x = op == 0 ? _mm_and_si128(x, y) : op == 1 ? _mm_or_si128(x, y) : _mm_xor_si128(x, y);
+        _mm_storeu_si128((__m128i *)(r + i), x);
+    }
+    for (; i < n; i++)
+    {
+        r[i] = op == 0 ? a[i] & b[i] : op == 1 ? a[i] | b[i] : a[i] ^ b[i];
+    }
+}
+
+
+SPECIFIER SIMD_AVX2 void FN(bitwiseWordsAvx2)(WORD_TYPE *r, const WORD_TYPE *a, const WORD_TYPE *b, size_t n, int op)
+{
+    size_t step = sizeof(__m256i) / sizeof(WORD_TYPE);
+    size_t i;
+
+    for (i = 0; i + step <= n; i += step)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+        x = op == 0 ? _mm256_and_si256(x, y) : op == 1 ? _mm256_or_si256(x, y) : _mm256_xor_si256(x, y);
+        _mm256_storeu_si256((__m256i *)(r + i), x);
+    }
+    FN(bitwiseWordsSse2)(r + i, a + i, b + i, n - i, op);
+}
+
+
+SPECIFIER void FN(bitwiseWords)(WORD_TYPE *r, const WORD_TYPE *a, const WORD_TYPE *b, size_t n, int op)
+{
+    if (__builtin_cpu_supports("avx2"))
+    {
+        FN(bitwiseWordsAvx2)(r, a, b, n, op);
+    }
+    else
+    {
+        FN(bitwiseWordsSse2)(r, a, b, n, op);
+    }
+}
+
+
+/* Returns n decreased by the whole vectors of zero words at the top of a[0 .. n). */
+SPECIFIER size_t FN(skipZeroWordsSse2)(const WORD_TYPE *a, size_t n)
+{
+    size_t step = sizeof(__m128i) / sizeof(WORD_TYPE);
+    __m128i zero = _mm_setzero_si128();
+
+    while (n >= step)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + n - step));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF) break;
+        n -= step;
+    }
+
+    return n;
+}
+
+
+SPECIFIER SIMD_AVX2 size_t FN(skipZeroWordsAvx2)(const WORD_TYPE *a, size_t n)
+{
+    size_t step = sizeof(__m256i) / sizeof(WORD_TYPE);
+
+    while (n >= step)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + n - step));
+
+        if (!_mm256_testz_si256(x, x)) break;
+        n -= step;
+    }
+
+    return FN(skipZeroWordsSse2)(a, n);
+}
+
+
+SPECIFIER size_t FN(skipZeroWords)(const WORD_TYPE *a, size_t n)
+{
+    return __builtin_cpu_supports("avx2") ? FN(skipZeroWordsAvx2)(a, n) : FN(skipZeroWordsSse2)(a, n);
+}
+
+
+/* lshiftN on word arrays: r[i] = a[i] << shift | a[i - 1] >> (WORD_BITS - shift), going from the top. n must not be zero. */
+SPECIFIER WORD_TYPE FN(lshiftWordsSse2)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    size_t step = sizeof(__m128i) / sizeof(WORD_TYPE);
+    __m128i left = _mm_cvtsi32_si128((int)shift);
+    __m128i right = _mm_cvtsi32_si128((int)(WORD_BITS - shift));
+    WORD_TYPE out = a[n - 1] >> (WORD_BITS - shift);
+
+    /* The words below a vector are loaded by the same unaligned load, one word lower. */
+    while (n > step)
+    {
+        __m128i high, low;
+
+        n -= step;
+        high = _mm_loadu_si128((const __m128i *)(a + n));
+        low = _mm_loadu_si128((const __m128i *)(a + n - 1));
+        _mm_storeu_si128((__m128i *)(r + n), _mm_or_si128(SIMD_SLL_128(high, left), SIMD_SRL_128(low, right)));
+    }
+    while (n > 1)
+    {
+        n--;
+        r[n] = (a[n] << shift) | (a[n - 1] >> (WORD_BITS - shift));
+    }
+    r[0] = a[0] << shift;
+
+    return out;
+}
+
+
+SPECIFIER SIMD_AVX2 WORD_TYPE FN(lshiftWordsAvx2)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    size_t step = sizeof(__m256i) / sizeof(WORD_TYPE);
+    __m128i left = _mm_cvtsi32_si128((int)shift);
+    __m128i right = _mm_cvtsi32_si128((int)(WORD_BITS - shift));
+    WORD_TYPE out = a[n - 1] >> (WORD_BITS - shift);
+
+    while (n > step)
+    {
+        __m256i high, low;
+
+        n -= step;
+        high = _mm256_loadu_si256((const __m256i *)(a + n));
+        low = _mm256_loadu_si256((const __m256i *)(a + n - 1));
+        _mm256_storeu_si256((__m256i *)(r + n), _mm256_or_si256(SIMD_SLL_256(high, left), SIMD_SRL_256(low, right)));
+    }
+    FN(lshiftWordsSse2)(r, a, n, shift);
+
+    return out;
+}
+
+
+SPECIFIER WORD_TYPE FN(lshiftWords)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    return __builtin_cpu_supports("avx2") ? FN(lshiftWordsAvx2)(r, a, n, shift) : FN(lshiftWordsSse2)(r, a, n, shift);
+}
+
+
+/* rshiftN on word arrays: r[i] = a[i] >> shift | a[i + 1] << (WORD_BITS - shift), going from the bottom. n must not be zero. */
+SPECIFIER WORD_TYPE FN(rshiftWordsSse2)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    size_t step = sizeof(__m128i) / sizeof(WORD_TYPE);
+    __m128i right = _mm_cvtsi32_si128((int)shift);
+    __m128i left = _mm_cvtsi32_si128((int)(WORD_BITS - shift));
+    WORD_TYPE out = a[0] << (WORD_BITS - shift);
+    size_t i;
+
+    for (i = 0; i + step < n; i += step)
+    {
+        __m128i low = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i high = _mm_loadu_si128((const __m128i *)(a + i + 1));
+
+        _mm_storeu_si128((__m128i *)(r + i), _mm_or_si128(SIMD_SRL_128(low, right), SIMD_SLL_128(high, left)));
+    }
+    for (; i + 1 < n; i++)
+    {
+        r[i] = (a[i] >> shift) | (a[i + 1] << (WORD_BITS - shift));
+    }
+    r[n - 1] = a[n - 1] >> shift;
+
+    return out;
+}
+
+
+SPECIFIER SIMD_AVX2 WORD_TYPE FN(rshiftWordsAvx2)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    size_t step = sizeof(__m256i) / sizeof(WORD_TYPE);
+    __m128i right = _mm_cvtsi32_si128((int)shift);
+    __m128i left = _mm_cvtsi32_si128((int)(WORD_BITS - shift));
+    WORD_TYPE out = a[0] << (WORD_BITS - shift);
+    size_t i;
+
+    for (i = 0; i + step < n; i += step)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(a + i + 1));
+
+        _mm256_storeu_si256((__m256i *)(r + i), _mm256_or_si256(SIMD_SRL_256(low, right), SIMD_SLL_256(high, left)));
+    }
+    FN(rshiftWordsSse2)(r + i, a + i, n - i, shift);
+
+    return out;
+}
+
+
+SPECIFIER WORD_TYPE FN(rshiftWords)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, unsigned shift)
+{
+    return __builtin_cpu_supports("avx2") ? FN(rshiftWordsAvx2)(r, a, n, shift) : FN(rshiftWordsSse2)(r, a, n, shift);
+}
+
+#endif
+
+
+/* Returns the number of words in x without the leading zero words. */
+SPECIFIER size_t FN(significantWords)(const BIGINT_TYPE *x)
+{
+    size_t n = GETNWORDS(x);
+
+#if USE_SIMD
+    n = FN(skipZeroWords)(WORD_PTR(x), n);
+#endif
+    while (n > 0 && GETWORD(x, n - 1) == 0) n--;
+
+    return n;
+}
+
+
+SPECIFIER int FN(isZero)(const BIGINT_TYPE *x)
+{
+    return GETUSEDWORDS(x) == 0;
+}
+
+
+/*
+ * Word vector kernels. They work on n words of big integers starting at the given offsets, all the words must be in range.
+ * The multi-word loops are built from these, so this is the place to optimize for a platform.
+ */
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) + b[bOff .. bOff + n) + carry. Returns the carry out. r can be the same as a or b. */
+SPECIFIER int FN(addN)(
+    BIGINT_TYPE *r, size_t rOff,
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n, int carry
+)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE w;
+
+        carry = FN(addCarry)(GETWORD(a, aOff + i), GETWORD(b, bOff + i), carry, &w);
+        SETWORD(r, rOff + i, w);
+    }
+
+    return carry;
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) - b[bOff .. bOff + n) - borrow. Returns the borrow out. r can be the same as a or b. */
+SPECIFIER int FN(subN)(
+    BIGINT_TYPE *r, size_t rOff,
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n, int borrow
+)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE w;
+
+        borrow = FN(subBorrow)(GETWORD(a, aOff + i), GETWORD(b, bOff + i), borrow, &w);
+        SETWORD(r, rOff + i, w);
+    }
+
+    return borrow;
+}
+
+
+#if USE_MULX
+
+/*
+ * x86-64 versions of mul1, addMul1 and subMul1 on the word arrays given by WORD_PTR. MULX leaves the flags alone, so the carries of
+ * the products (ADCX, the carry flag) and of the accumulation (ADOX, the overflow flag) run as two independent chains. The loop
+ * counter is kept in rcx, LEA and JRCXZ don't touch the flags either.
+ */
+
+/* Non-zero if the CPU has BMI2 (MULX) and ADX (ADCX, ADOX). CPUID is slow, so the answer is kept. */
+SPECIFIER int FN(hasMulx)(void)
+{
+    static int supported = -1;
+
+    if (supported < 0)
+    {
+        unsigned eax, ebx = 0, ecx, edx;
+
+        if (__get_cpuid_max(0, NULL) >= 7)
+        {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        }
+        supported = (ebx & (1u << 8)) && (ebx & (1u << 19)); /* BMI2 and ADX. */
+    }
+
+    return supported;
+}
+
+
+SPECIFIER WORD_TYPE FN(mul1Mulx)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, WORD_TYPE w)
+{
+    WORD_TYPE carry = 0, low, high;
+
+    __asm__ __volatile__(
+        "xorl %k[low], %k[low]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulxq (%[a]), %[low], %[high]\n\t"
+        "adcxq %[carry], %[low]\n\t"
+        "movq %[low], (%[r])\n\t"
+        "movq %[high], %[carry]\n\t"
+        "leaq 8(%[a]), %[a]\n\t"
+        "leaq 8(%[r]), %[r]\n\t"
+        "leaq -1(%[n]), %[n]\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "movl $0, %k[low]\n\t"
+        "adcxq %[low], %[carry]\n\t"
+        : [carry] "+&r" (carry), [low] "=&r" (low), [high] "=&r" (high), [a] "+&r" (a), [r] "+&r" (r), [n] "+&c" (n)
+        : "d" (w)
+        : "cc", "memory"
+    );
+
+    return carry;
+}
+
+
+SPECIFIER WORD_TYPE FN(addMul1Mulx)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, WORD_TYPE w)
+{
+    WORD_TYPE carry = 0, low, high;
+
+    /* The final carry is the high word of the last product plus both flags, it fits because the whole sum has n + 1 words. */
+    __asm__ __volatile__(
+        "xorl %k[low], %k[low]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulxq (%[a]), %[low], %[high]\n\t"
+        "adcxq %[carry], %[low]\n\t"
+        "adoxq (%[r]), %[low]\n\t"
+        "movq %[low], (%[r])\n\t"
+        "movq %[high], %[carry]\n\t"
+        "leaq 8(%[a]), %[a]\n\t"
+        "leaq 8(%[r]), %[r]\n\t"
+        "leaq -1(%[n]), %[n]\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "movl $0, %k[low]\n\t"
+        "adcxq %[low], %[carry]\n\t"
+        "adoxq %[low], %[carry]\n\t"
+        : [carry] "+&r" (carry), [low] "=&r" (low), [high] "=&r" (high), [a] "+&r" (a), [r] "+&r" (r), [n] "+&c" (n)
+        : "d" (w)
+        : "cc", "memory"
+    );
+
+    return carry;
+}
+
+
+SPECIFIER WORD_TYPE FN(subMul1Mulx)(WORD_TYPE *r, const WORD_TYPE *a, size_t n, WORD_TYPE w)
+{
+    WORD_TYPE carry = 0, low, high;
+
+    /* r - p is computed as r + ~p + 1, the overflow flag is the inverted borrow and starts at 1 (1 + ~0 carries out).
+     * The overflow flag left at the end goes to the low byte of low. */
+    __asm__ __volatile__(
+        "xorl %k[low], %k[low]\n\t"
+        "movl $1, %k[low]\n\t"
+        "movq $-1, %[high]\n\t"
+        "adoxq %[high], %[low]\n\t"
+        "1:\n\t"
+        "jrcxz 2f\n\t"
+        "mulxq (%[a]), %[low], %[high]\n\t"
+        "adcxq %[carry], %[low]\n\t"
+        "notq %[low]\n\t"
+        "adoxq (%[r]), %[low]\n\t"
+        "movq %[low], (%[r])\n\t"
+        "movq %[high], %[carry]\n\t"
+        "leaq 8(%[a]), %[a]\n\t"
+        "leaq 8(%[r]), %[r]\n\t"
+        "leaq -1(%[n]), %[n]\n\t"
+        "jmp 1b\n\t"
+        "2:\n\t"
+        "movl $0, %k[low]\n\t"
+        "adcxq %[low], %[carry]\n\t"
+        "seto %b[low]\n\t"
+        : [carry] "+&r" (carry), [low] "=&r" (low), [high] "=&r" (high), [a] "+&r" (a), [r] "+&r" (r), [n] "+&c" (n)
+        : "d" (w)
+        : "cc", "memory"
+    );
+
+    return carry + 1 - low;
+}
+
+#endif
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) * w. Returns the high word of the product. */
+SPECIFIER WORD_TYPE FN(mul1)(BIGINT_TYPE *r, size_t rOff, const BIGINT_TYPE *a, size_t aOff, size_t n, WORD_TYPE w)
+{
+    size_t i;
+    WORD_TYPE carry = 0;
+
+#if USE_MULX
+    if (FN(hasMulx)()) return FN(mul1Mulx)(WORD_PTR(r) + rOff, WORD_PTR(a) + aOff, n, w);
+#endif
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE high, low;
+
+        /* The high word of a product is at most 2^WORD_BITS - 2, so adding a carry to it cannot overflow. */
+        FN(mulDigit)(GETWORD(a, aOff + i), w, &high, &low);
+        high += FN(addDigit)(low, carry, &low);
+        SETWORD(r, rOff + i, low);
+        carry = high;
+    }
+
+    return carry;
+}
+
+
+/* r[rOff .. rOff + n) += a[aOff .. aOff + n) * w. Returns the word carried out. */
+SPECIFIER WORD_TYPE FN(addMul1)(BIGINT_TYPE *r, size_t rOff, const BIGINT_TYPE *a, size_t aOff, size_t n, WORD_TYPE w)
+{
+    size_t i;
+    WORD_TYPE carry = 0;
+
+#if USE_MULX
+    if (FN(hasMulx)()) return FN(addMul1Mulx)(WORD_PTR(r) + rOff, WORD_PTR(a) + aOff, n, w);
+#endif
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE high, low, tmp;
+
+        /* Two carries can be added to the high word without overflow. */
+        FN(mulDigit)(GETWORD(a, aOff + i), w, &high, &low);
+        high += FN(addDigit)(low, carry, &low);
+        high += FN(addDigit)(GETWORD(r, rOff + i), low, &tmp);
+        SETWORD(r, rOff + i, tmp);
+        carry = high;
+    }
+
+    return carry;
+}
+
+
+/* r[rOff .. rOff + n) -= a[aOff .. aOff + n) * w. Returns the word borrowed from above. */
+SPECIFIER WORD_TYPE FN(subMul1)(BIGINT_TYPE *r, size_t rOff, const BIGINT_TYPE *a, size_t aOff, size_t n, WORD_TYPE w)
+{
+    size_t i;
+    WORD_TYPE carry = 0;
+
+#if USE_MULX
+    if (FN(hasMulx)()) return FN(subMul1Mulx)(WORD_PTR(r) + rOff, WORD_PTR(a) + aOff, n, w);
+#endif
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE high, low, tmp;
+
+        FN(mulDigit)(GETWORD(a, aOff + i), w, &high, &low);
+        high += FN(addDigit)(low, carry, &low);
+        high += FN(subDigit)(GETWORD(r, rOff + i), low, &tmp);
+        SETWORD(r, rOff + i, tmp);
+        carry = high;
+    }
+
+    return carry;
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) << shift, where 0 < shift < WORD_BITS. Returns the bits shifted out (in the low bits).
+ * Goes from the top, so it can work in place if rOff >= aOff. */
+SPECIFIER WORD_TYPE FN(lshiftN)(BIGINT_TYPE *r, size_t rOff, const BIGINT_TYPE *a, size_t aOff, size_t n, unsigned shift)
+{
+    if (!n) return 0;
+
+#if USE_SIMD
+    return FN(lshiftWords)(WORD_PTR(r) + rOff, WORD_PTR(a) + aOff, n, shift);
+#else
+    {
+        WORD_TYPE high = GETWORD(a, aOff + n - 1);
+        WORD_TYPE out = high >> (WORD_BITS - shift);
+
+        while (--n > 0)
+        {
+            WORD_TYPE low = GETWORD(a, aOff + n - 1);
+
+            SETWORD(r, rOff + n, (high << shift) | (low >> (WORD_BITS - shift)));
+            high = low;
+        }
+        SETWORD(r, rOff, high << shift);
+
+        return out;
+    }
+#endif
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) >> shift, where 0 < shift < WORD_BITS. Returns the bits shifted out (in the high bits).
+ * Goes from the bottom, so it can work in place if rOff <= aOff. */
+SPECIFIER WORD_TYPE FN(rshiftN)(BIGINT_TYPE *r, size_t rOff, const BIGINT_TYPE *a, size_t aOff, size_t n, unsigned shift)
+{
+    if (!n) return 0;
+
+#if USE_SIMD
+    return FN(rshiftWords)(WORD_PTR(r) + rOff, WORD_PTR(a) + aOff, n, shift);
+#else
+    {
+        size_t i;
+        WORD_TYPE low = GETWORD(a, aOff);
+        WORD_TYPE out = low << (WORD_BITS - shift);
+
+        for (i = 0; i + 1 < n; i++)
+        {
+            WORD_TYPE high = GETWORD(a, aOff + i + 1);
+
+            SETWORD(r, rOff + i, (low >> shift) | (high << (WORD_BITS - shift)));
+            low = high;
+        }
+        SETWORD(r, rOff + n - 1, low >> shift);
+
+        return out;
+    }
+#endif
+}
+
+
+SPECIFIER int FN(add)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
+{
+    size_t i;
+    int carry;
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA > nB ? nA : nB;
+    size_t nMin = nA < nB ? nA : nB;
+    const BIGINT_TYPE *longer = nA > nB ? a : b;
+
+    SETNWORDS(result, n);
+
+    carry = FN(addN)(result, 0, a, 0, b, 0, nMin, 0);
+    for (i = nMin; i < n; i++)
+    {
+        WORD_TYPE rWord;
+
+        carry = FN(addDigit)(GETWORD(longer, i), (WORD_TYPE)carry, &rWord);
+        SETWORD(result, i, rWord);
+    }
+
+    return carry;
+}
+
+
+SPECIFIER int FN(sub)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
+{
+    size_t i;
+    int borrow;
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA > nB ? nA : nB;
+    size_t nMin = nA < nB ? nA : nB;
+
+    SETNWORDS(result, n);
+
+    /* The shorter input is zero extended. */
+    borrow = FN(subN)(result, 0, a, 0, b, 0, nMin, 0);
+    for (i = nMin; i < n; i++)
+    {
+        WORD_TYPE rWord;
+
+        borrow = FN(subBorrow)(i < nA ? GETWORD(a, i) : 0, i < nB ? GETWORD(b, i) : 0, borrow, &rWord);
+        SETWORD(result, i, rWord);
+    }
+
+    return borrow;
+}
+
+
+SPECIFIER int FN(mul)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
+{
+    size_t i, k;
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+    size_t nR = GETNWORDS(result);
+    int truncate = 0;
+
+    ZERO_BIGINT(result);
+
+    /* long multiplication algorithm, a row for each word of a. */
+    for (i = 0; i < nA; i++)
+    {
+        WORD_TYPE aWord = GETWORD(a, i);
+        WORD_TYPE carry;
+        size_t len;
+
+        if (!aWord || !nB) continue;
+
+        if (i >= nR || nB > nR - i)
+        {
+            /* Some of the partial products would go beyond the last word. */
+            truncate = 1;
+            if (i >= nR) continue;
+        }
+        len = nB < nR - i ? nB : nR - i;
+
+        carry = FN(addMul1)(result, i, b, 0, len, aWord);
+        for (k = i + len; k < nR && carry; k++)
+        {
+            WORD_TYPE tmp;
+
+            carry = (WORD_TYPE)FN(addDigit)(GETWORD(result, k), carry, &tmp);
+            SETWORD(result, k, tmp);
+        }
+        if (carry)
+        {
+            /* We would carry to higher than the last word. */
+            truncate = 1;
+        }
+    }
+    return truncate;
+}
+
+
+/* Internal helpers for the divide and conquer multiplication algorithms.
+ * They work on word ranges of big integers (given by a bigint and an offset),
+ * words beyond the end of the bigint read as zero.
+ */
+
+SPECIFIER WORD_TYPE FN(getWordPadded)(const BIGINT_TYPE *x, size_t i)
+{
+    return i < GETNWORDS(x) ? GETWORD(x, i) : 0;
+}
+
+
+/* The number of words of x[off .. off + n) that are actually stored in x. */
+SPECIFIER size_t FN(storedLength)(const BIGINT_TYPE *x, size_t off, size_t n)
+{
+    size_t nX = GETNWORDS(x);
+
+    (void)x; /* GETNWORDS can be a constant. */
+
+    if (off >= nX) return 0;
+    return nX - off < n ? nX - off : n;
+}
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n) * b[bOff .. bOff + n) using the schoolbook method. */
+SPECIFIER void FN(mulRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff
+)
+{
+    size_t i;
+    size_t aLen = FN(storedLength)(a, aOff, n);
+    size_t bLen = FN(storedLength)(b, bOff, n);
+
+    for (i = 0; i < 2*n; i++)
+    {
+        SETWORD(r, rOff + i, 0);
+    }
+
+    for (i = 0; i < aLen; i++)
+    {
+        WORD_TYPE aWord = GETWORD(a, aOff + i);
+
+        if (!aWord) continue;
+        SETWORD(r, rOff + i + bLen, FN(addMul1)(r, rOff + i, b, bOff, bLen, aWord));
+    }
+}
+
+
+/* r[rOff .. rOff + len) <<= 1 in place. Returns the bit shifted out. */
+SPECIFIER int FN(doubleRange)(BIGINT_TYPE *r, size_t rOff, size_t len)
+{
+    return (int)FN(lshiftN)(r, rOff, r, rOff, len, 1);
+}
+
+
+/* r[rOff .. rOff + len) >>= 1 in place. */
+SPECIFIER void FN(halveRange)(BIGINT_TYPE *r, size_t rOff, size_t len)
+{
+    FN(rshiftN)(r, rOff, r, rOff, len, 1);
+}
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n)^2 using the schoolbook method, computing every cross product only once. */
+SPECIFIER void FN(sqrRange)(const BIGINT_TYPE *a, size_t aOff, size_t n, BIGINT_TYPE *r, size_t rOff)
+{
+    size_t i;
+    size_t aLen = FN(storedLength)(a, aOff, n);
+    WORD_TYPE carry = 0;
+
+    for (i = 0; i < 2*n; i++)
+    {
+        SETWORD(r, rOff + i, 0);
+    }
+
+    /* Sum of a_i a_j where i < j. */
+    for (i = 0; i < aLen; i++)
+    {
+        WORD_TYPE aWord = GETWORD(a, aOff + i);
+
+        if (!aWord) continue;
+        SETWORD(r, rOff + i + aLen, FN(addMul1)(r, rOff + 2*i + 1, a, aOff + i + 1, aLen - i - 1, aWord));
+    }
+
+    /* Double it, then add the squares a_i^2. */
+    FN(doubleRange)(r, rOff, 2*n);
+
+    carry = 0;
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE aWord = FN(getWordPadded)(a, aOff + i);
+        WORD_TYPE high, low, tmp;
+        int c;
+
+        FN(mulDigit)(aWord, aWord, &high, &low);
+        c = FN(addDigit)(GETWORD(r, rOff + 2*i), low, &tmp);
+        c += FN(addDigit)(tmp, carry, &tmp);
+        SETWORD(r, rOff + 2*i, tmp);
+        carry = FN(addDigit)(GETWORD(r, rOff + 2*i + 1), high, &tmp);
+        carry += FN(addDigit)(tmp, c, &tmp);
+        SETWORD(r, rOff + 2*i + 1, tmp);
+    }
+}
+
+
+/* out[outOff .. outOff + n) = |x[xOff .. xOff + n) - y[yOff .. yOff + yLen)|. Returns non-zero if x < y. */
+SPECIFIER int FN(absDiffRange)(
+    const BIGINT_TYPE *x, size_t xOff,
+    const BIGINT_TYPE *y, size_t yOff, size_t yLen,
+    size_t n,
+    BIGINT_TYPE *out, size_t outOff
+)
+{
+    size_t i;
+    int borrow = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE yWord = i < yLen ? FN(getWordPadded)(y, yOff + i) : 0;
+        WORD_TYPE rWord;
+
+        borrow = FN(subBorrow)(FN(getWordPadded)(x, xOff + i), yWord, borrow, &rWord);
+        SETWORD(out, outOff + i, rWord);
+    }
+
+    if (borrow)
+    {
+        /* Negative result, take the two's complement to get the absolute value. */
+        int carry = 1;
+
+        for (i = 0; i < n; i++)
+        {
+            WORD_TYPE w;
+
+            carry = FN(addDigit)((WORD_TYPE)~GETWORD(out, outOff + i), carry, &w);
+            SETWORD(out, outOff + i, w);
+        }
+    }
+
+    return borrow;
+}
+
+
+/* r[rOff .. rOff + rLen) += x[xOff .. xOff + xLen) (or -= if subtract is non-zero). xLen <= rLen. Returns the carry (borrow). */
+SPECIFIER int FN(addToRange)(
+    BIGINT_TYPE *r, size_t rOff, size_t rLen,
+    const BIGINT_TYPE *x, size_t xOff, size_t xLen,
+    int subtract
+)
+{
+    size_t i;
+    int carry = 0;
+
+    for (i = 0; i < rLen && (i < xLen || carry); i++)
+    {
+        WORD_TYPE xWord = i < xLen ? FN(getWordPadded)(x, xOff + i) : 0;
+        WORD_TYPE rWord;
+
+        if (subtract)
+        {
+            carry = FN(subBorrow)(GETWORD(r, rOff + i), xWord, carry, &rWord);
+        }
+        else
+        {
+            carry = FN(addCarry)(GETWORD(r, rOff + i), xWord, carry, &rWord);
+        }
+        SETWORD(r, rOff + i, rWord);
+    }
+
+    return carry;
+}
+
+
+/* r[rOff .. rOff + len) /= 3 in place. The number must be divisible by 3. */
+SPECIFIER void FN(divExact3Range)(BIGINT_TYPE *r, size_t rOff, size_t len)
+{
+    /*
+        Exact division: multiply each word by the inverse of 3 modulo 2^WORD_BITS starting from the lowest word,
+        the high word of quotientWord*3 is borrowed from the next word.
+    */
+    WORD_TYPE inverse = (WORD_TYPE)~(WORD_TYPE)0 / 3 * 2 + 1;
+    WORD_TYPE borrow = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        WORD_TYPE s, q, high, low;
+        int b = FN(subDigit)(GETWORD(r, rOff + i), borrow, &s);
+
+        q = s * inverse;
+        SETWORD(r, rOff + i, q);
+        FN(mulDigit)(q, 3, &high, &low);
+        borrow = high + b;
+    }
+}
+
+
+/* dst[dstOff .. dstOff + n) = src[srcOff .. srcOff + srcLen) padded with zeroes. */
+SPECIFIER void FN(copyRange)(BIGINT_TYPE *dst, size_t dstOff, size_t n, const BIGINT_TYPE *src, size_t srcOff, size_t srcLen)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(dst, dstOff + i, i < srcLen ? FN(getWordPadded)(src, srcOff + i) : 0);
+    }
+}
+
+
+/*
+ * Number theoretic transform multiplication.
+ *
+ * The product is computed as a convolution of the words modulo three word sized primes of the form c*2^k + 1,
+ * then the coefficients are recombined using the Chinese remainder theorem.
+ * The modular arithmetic is done in Montgomery form, so only mulDigit is needed, no double word type.
+ * The primes are smaller than 2^(WORD_BITS - 1), so sums of two residues never overflow.
+ */
+
+/* Returns a*b/2^WORD_BITS mod p. pInv = -p^-1 mod 2^WORD_BITS. */
+SPECIFIER WORD_TYPE FN(nttMontMul)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE p, WORD_TYPE pInv)
+{
+    WORD_TYPE high, low, mHigh, mLow, t;
+
+    FN(mulDigit)(a, b, &high, &low);
+    FN(mulDigit)(low * pInv, p, &mHigh, &mLow);
+
+    /* low + mLow is zero modulo 2^WORD_BITS, it carries unless both are zero. */
+    t = high + mHigh + (low != 0);
+
+    return t >= p ? t - p : t;
+}
+
+
+SPECIFIER WORD_TYPE FN(nttAddMod)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE p)
+{
+    WORD_TYPE s = a + b;
+
+    return s >= p ? s - p : s;
+}
+
+
+SPECIFIER WORD_TYPE FN(nttSubMod)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE p)
+{
+    return a >= b ? a - b : a + (p - b);
+}
+
+
+/* Computes the constants needed for Montgomery multiplication modulo p: -p^-1 and 2^(2*WORD_BITS) mod p. */
+SPECIFIER void FN(nttMontSetup)(WORD_TYPE p, WORD_TYPE *pInv, WORD_TYPE *r2)
+{
+    WORD_TYPE x = p;
+    size_t i;
+
+    /* Newton iteration, each step doubles the number of correct low bits. p*p = 1 mod 8 for odd p. */
+    for (i = 3; i < WORD_BITS; i *= 2)
+    {
+        x *= 2 - p*x;
+    }
+    *pInv = (WORD_TYPE)0 - x;
+
+    /* (2^WORD_BITS - p) mod p is 2^WORD_BITS mod p, double it WORD_BITS times. */
+    *r2 = ((WORD_TYPE)0 - p) % p;
+    for (i = 0; i < WORD_BITS; i++)
+    {
+        *r2 = FN(nttAddMod)(*r2, *r2, p);
+    }
+}
+
+
+/* Returns a*b mod p. */
+SPECIFIER WORD_TYPE FN(nttMulMod)(WORD_TYPE a, WORD_TYPE b, WORD_TYPE p, WORD_TYPE pInv, WORD_TYPE r2)
+{
+    return FN(nttMontMul)(FN(nttMontMul)(a, b, p, pInv), r2, p, pInv);
+}
+
+
+/* Returns base^exponent mod p. */
+SPECIFIER WORD_TYPE FN(nttPowMod)(WORD_TYPE base, WORD_TYPE exponent, WORD_TYPE p, WORD_TYPE pInv, WORD_TYPE r2)
+{
+    WORD_TYPE result = 1;
+
+    base %= p;
+    while (exponent)
+    {
+        if (exponent & 1) result = FN(nttMulMod)(result, base, p, pInv, r2);
+        base = FN(nttMulMod)(base, base, p, pInv, r2);
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+
+/* Transforms x[xOff .. xOff + len) in place. tw holds the powers of the root of unity in Montgomery form. */
+SPECIFIER void FN(nttTransform)(BIGINT_TYPE *x, size_t xOff, size_t len, const BIGINT_TYPE *tw, size_t twOff, WORD_TYPE p, WORD_TYPE pInv)
+{
+    size_t i, j, bit, half, step, start;
+
+    /* Bit reversal permutation. */
+    for (i = 1, j = 0; i < len; i++)
+    {
+        for (bit = len >> 1; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            WORD_TYPE tmp = GETWORD(x, xOff + i);
+
+            SETWORD(x, xOff + i, GETWORD(x, xOff + j));
+            SETWORD(x, xOff + j, tmp);
+        }
+    }
+
+    /* Cooley-Tukey butterflies. */
+    for (half = 1, step = len / 2; half < len; half *= 2, step /= 2)
+    {
+        for (start = 0; start < len; start += 2*half)
+        {
+            for (i = 0; i < half; i++)
+            {
+                WORD_TYPE u = GETWORD(x, xOff + start + i);
+                WORD_TYPE v = FN(nttMontMul)(GETWORD(x, xOff + start + i + half), GETWORD(tw, twOff + i*step), p, pInv);
+
+                SETWORD(x, xOff + start + i, FN(nttAddMod)(u, v, p));
+                SETWORD(x, xOff + start + i + half, FN(nttSubMod)(u, v, p));
+            }
+        }
+    }
+}
+
+
+/* Returns the transform length used for n word ranges, 0 if the NTT cannot be used for this size. */
+SPECIFIER size_t FN(nttLength)(size_t n)
+{
+#ifdef NTT_PRIME_1
+    size_t len = 1;
+    size_t logLen = 0;
+
+    while (len < 2*n)
+    {
+        if (logLen == NTT_MAX_LOG) return 0;
+        len *= 2;
+        logLen++;
+    }
+
+    return len;
+#else
+    (void)n;
+    return 0;
+#endif
+}
+
+
+/* The amount of scratch nttRange needs for n word ranges. */
+SPECIFIER size_t FN(nttRangeScratchSize)(size_t n)
+{
+    size_t len = FN(nttLength)(n);
+
+    return 4*len + len/2;
+}
+
+
+/* Computes the cyclic convolution of the two ranges modulo p into s[resOff .. resOff + len). */
+SPECIFIER void FN(nttConvolve)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    size_t len,
+    WORD_TYPE p, WORD_TYPE root,
+    BIGINT_TYPE *s, size_t resOff, size_t tmpOff, size_t twOff
+)
+{
+    WORD_TYPE pInv, r2, w, scale;
+    size_t i;
+    int square = a == b && aOff == bOff;
+
+    FN(nttMontSetup)(p, &pInv, &r2);
+
+    /* Powers of the len-th root of unity in Montgomery form. */
+    w = FN(nttMontMul)(FN(nttPowMod)(root, (p - 1) / len, p, pInv, r2), r2, p, pInv);
+    SETWORD(s, twOff, ((WORD_TYPE)0 - p) % p);
+    for (i = 1; i < len / 2; i++)
+    {
+        SETWORD(s, twOff + i, FN(nttMontMul)(GETWORD(s, twOff + i - 1), w, p, pInv));
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        SETWORD(s, resOff + i, i < n ? FN(getWordPadded)(a, aOff + i) % p : 0);
+        if (!square) SETWORD(s, tmpOff + i, i < n ? FN(getWordPadded)(b, bOff + i) % p : 0);
+    }
+
+    /* When squaring only one transform is needed. */
+    FN(nttTransform)(s, resOff, len, s, twOff, p, pInv);
+    if (!square) FN(nttTransform)(s, tmpOff, len, s, twOff, p, pInv);
+    for (i = 0; i < len; i++)
+    {
+        WORD_TYPE x = GETWORD(s, resOff + i);
+
+        SETWORD(s, resOff + i, FN(nttMontMul)(x, square ? x : GETWORD(s, tmpOff + i), p, pInv));
+    }
+
+    /* The inverse transform is the forward transform with the order of the outputs reversed (except the first). */
+    FN(nttTransform)(s, resOff, len, s, twOff, p, pInv);
+    for (i = 1; i < len - i; i++)
+    {
+        WORD_TYPE tmp = GETWORD(s, resOff + i);
+
+        SETWORD(s, resOff + i, GETWORD(s, resOff + len - i));
+        SETWORD(s, resOff + len - i, tmp);
+    }
+
+    /* Divide by len and undo the 2^-WORD_BITS factor of the pointwise Montgomery products. */
+    scale = FN(nttMontMul)(FN(nttPowMod)(len, p - 2, p, pInv, r2), r2, p, pInv);
+    scale = FN(nttMontMul)(scale, r2, p, pInv);
+    for (i = 0; i < len; i++)
+    {
+        SETWORD(s, resOff + i, FN(nttMontMul)(GETWORD(s, resOff + i), scale, p, pInv));
+    }
+}
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n) * b[bOff .. bOff + n). Uses s[sOff ..) as scratch. nttLength(n) must be non-zero. */
+SPECIFIER void FN(nttRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+#ifdef NTT_PRIME_1
+    /*
+        Scratch layout: residues modulo the three primes (len words each), the transform of b (len words),
+        powers of the root of unity (len/2 words).
+
+        Garner's algorithm recombines each coefficient:
+        x = v_1 + p_1 v_2 + p_1 p_2 v_3, where
+        v_1 = x mod p_1
+        v_2 = (x - v_1) / p_1 mod p_2
+        v_3 = (x - v_1 - p_1 v_2) / (p_1 p_2) mod p_3
+    */
+    size_t len = FN(nttLength)(n);
+    size_t res1 = sOff, res2 = sOff + len, res3 = sOff + 2*len;
+    WORD_TYPE p1 = NTT_PRIME_1, p2 = NTT_PRIME_2, p3 = NTT_PRIME_3;
+    WORD_TYPE pInv2, r22, pInv3, r23;
+    WORD_TYPE inv1, inv12, p1Mod3;
+    WORD_TYPE p12High, p12Low;
+    WORD_TYPE carryLow = 0, carryHigh = 0;
+    size_t i;
+
+    FN(nttConvolve)(a, aOff, b, bOff, n, len, p1, NTT_ROOT_1, s, res1, sOff + 3*len, sOff + 4*len);
+    FN(nttConvolve)(a, aOff, b, bOff, n, len, p2, NTT_ROOT_2, s, res2, sOff + 3*len, sOff + 4*len);
+    FN(nttConvolve)(a, aOff, b, bOff, n, len, p3, NTT_ROOT_3, s, res3, sOff + 3*len, sOff + 4*len);
+
+    FN(nttMontSetup)(p2, &pInv2, &r22);
+    FN(nttMontSetup)(p3, &pInv3, &r23);
+    inv1 = FN(nttPowMod)(p1 % p2, p2 - 2, p2, pInv2, r22);
+    p1Mod3 = p1 % p3;
+    inv12 = FN(nttPowMod)(FN(nttMulMod)(p1Mod3, p2 % p3, p3, pInv3, r23), p3 - 2, p3, pInv3, r23);
+    FN(mulDigit)(p1, p2, &p12High, &p12Low);
+
+    for (i = 0; i < 2*n; i++)
+    {
+        WORD_TYPE v1 = GETWORD(s, res1 + i);
+        WORD_TYPE v2, v3, x12Mod3;
+        WORD_TYPE x0, x1, x2, high, low;
+        int carry;
+
+        v2 = FN(nttMulMod)(FN(nttSubMod)(GETWORD(s, res2 + i), v1 % p2, p2), inv1, p2, pInv2, r22);
+        x12Mod3 = FN(nttAddMod)(v1 % p3, FN(nttMulMod)(p1Mod3, v2 % p3, p3, pInv3, r23), p3);
+        v3 = FN(nttMulMod)(FN(nttSubMod)(GETWORD(s, res3 + i), x12Mod3, p3), inv12, p3, pInv3, r23);
+
+        /* x = v_1 + p_1 v_2 + p_1 p_2 v_3 in three words. */
+        FN(mulDigit)(p1, v2, &x1, &x0);
+        x1 += FN(addDigit)(x0, v1, &x0);
+        FN(mulDigit)(p12Low, v3, &high, &low);
+        carry = FN(addDigit)(x0, low, &x0);
+        x2 = FN(addDigit)(x1, high, &x1);
+        x2 += FN(addDigit)(x1, carry, &x1);
+        FN(mulDigit)(p12High, v3, &high, &low);
+        x2 += high + FN(addDigit)(x1, low, &x1);
+
+        /* Add the carry from the previous coefficients, store the low word and carry the rest. */
+        carry = FN(addDigit)(x0, carryLow, &x0);
+        x2 += FN(addDigit)(x1, carry, &x1);
+        x2 += FN(addDigit)(x1, carryHigh, &x1);
+        SETWORD(r, rOff + i, x0);
+        carryLow = x1;
+        carryHigh = x2;
+    }
+#else
+    (void)a; (void)aOff; (void)b; (void)bOff; (void)n; (void)r; (void)rOff; (void)s; (void)sOff;
+#endif
+}
+
+
+SPECIFIER size_t FN(mulRangeScratchSize)(size_t n);
+
+/* The amount of scratch karatsubaRange needs for n word ranges. */
+SPECIFIER size_t FN(karatsubaRangeScratchSize)(size_t n)
+{
+    size_t h = (n + 1) / 2;
+    size_t sub = FN(mulRangeScratchSize)(h);
+
+    return 4*h + (sub > 2*h + 1 ? sub : 2*h + 1);
+}
+
+
+/* The amount of scratch toom3Range needs for n word ranges. */
+SPECIFIER size_t FN(toom3RangeScratchSize)(size_t n)
+{
+    size_t k = (n + 2) / 3 + 1;
+
+    return 8*k + FN(mulRangeScratchSize)(k);
+}
+
+
+/* The amount of scratch mulRangeDispatch needs for n word ranges. */
+SPECIFIER size_t FN(mulRangeScratchSize)(size_t n)
+{
+    if (n >= NTT_THRESHOLD && FN(nttLength)(n)) return FN(nttRangeScratchSize)(n);
+    if (n >= TOOM3_THRESHOLD && n >= 5) return FN(toom3RangeScratchSize)(n);
+    if (n >= KARATSUBA_THRESHOLD && n >= 2) return FN(karatsubaRangeScratchSize)(n);
+    return 0;
+}
+
+
+SPECIFIER void FN(mulRangeDispatch)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+);
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n) * b[bOff .. bOff + n). Uses s[sOff ..) as scratch. n must be at least 2. */
+SPECIFIER void FN(karatsubaRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    /*
+        Split the numbers into a low part of h words and a high part of l words: a = a_1 B + a_0, where B = 2^(h*WORD_BITS).
+        Math: ab = a_1 b_1 B^2 + (a_1 b_0 + a_0 b_1) B + a_0 b_0
+        The middle term is computed using only one multiplication:
+        a_1 b_0 + a_0 b_1 = a_0 b_0 + a_1 b_1 - (a_0 - a_1)(b_0 - b_1)
+
+        Scratch layout: |a_0 - a_1| (h words), |b_0 - b_1| (h words), their product (2h words),
+        then the middle term (2h + 1 words) which shares its space with the scratch of the recursive calls.
+
+        When squaring, all three products are squares and |a_0 - a_1| is computed only once.
+    */
+    size_t h = (n + 1) / 2;
+    size_t l = n - h;
+    size_t tOff = sOff + 4*h;
+    size_t midLen = 2*n - h < 2*h + 1 ? 2*n - h : 2*h + 1;
+    int square = a == b && aOff == bOff;
+    int negative;
+
+    /* a_0 b_0 and a_1 b_1 goes to their final places. */
+    FN(mulRangeDispatch)(a, aOff, b, bOff, h, r, rOff, s, sOff + 4*h);
+    FN(mulRangeDispatch)(a, aOff + h, b, bOff + h, l, r, rOff + 2*h, s, sOff + 4*h);
+
+    negative = FN(absDiffRange)(a, aOff, a, aOff + h, l, h, s, sOff);
+    if (square)
+    {
+        negative = 0;
+        FN(mulRangeDispatch)(s, sOff, s, sOff, h, s, sOff + 2*h, s, sOff + 4*h);
+    }
+    else
+    {
+        negative ^= FN(absDiffRange)(b, bOff, b, bOff + h, l, h, s, sOff + h);
+        FN(mulRangeDispatch)(s, sOff, s, sOff + h, h, s, sOff + 2*h, s, sOff + 4*h);
+    }
+
+    /* Middle term: a_0 b_0 + a_1 b_1 -+ |a_0 - a_1||b_0 - b_1| */
+    FN(copyRange)(s, tOff, 2*h + 1, r, rOff, 2*h);
+    FN(addToRange)(s, tOff, 2*h + 1, r, rOff + 2*h, 2*l, 0);
+    FN(addToRange)(s, tOff, 2*h + 1, s, sOff + 2*h, 2*h, !negative);
+
+    /* The middle term fits into midLen words, because the whole product fits into 2n words. */
+    FN(addToRange)(r, rOff + h, 2*n - h, s, tOff, midLen, 0);
+}
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n) * b[bOff .. bOff + n). Uses s[sOff ..) as scratch. n must be at least 5. */
+SPECIFIER void FN(toom3Range)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    /*
+        Split the numbers into three parts: a = a_2 B^2 + a_1 B + a_0, where B = 2^(k*WORD_BITS).
+        The product is a polynomial of B: ab = c_4 B^4 + c_3 B^3 + c_2 B^2 + c_1 B + c_0.
+        Evaluate it at 0, 1, -1, 2 and infinity, then interpolate the coefficients:
+
+        r_0 = a_0 b_0 = c_0
+        r_1 = (a_0 + a_1 + a_2)(b_0 + b_1 + b_2)
+        r_m1 = (a_0 - a_1 + a_2)(b_0 - b_1 + b_2)
+        r_2 = (a_0 + 2a_1 + 4a_2)(b_0 + 2b_1 + 4b_2)
+        r_inf = a_2 b_2 = c_4
+
+        c_1 + c_3 = (r_1 - r_m1) / 2
+        c_2 = (r_1 + r_m1) / 2 - c_0 - c_4
+        c_3 = (r_2 - c_0 - 4c_2 - 16c_4 - 2(c_1 + c_3)) / 6
+        c_1 = (c_1 + c_3) - c_3
+
+        All coefficients are non-negative and every subtraction above keeps the intermediate values non-negative,
+        so only r_m1 needs a sign, which is tracked separately.
+
+        Scratch layout, K = k + 1 is the length of the evaluated values:
+        evalA (K words), evalB (K words), r_1 (2K words), r_m1 (2K words), r_2 (2K words), then the scratch of the recursive calls.
+        c_0 and c_4 are computed right into their final place in r.
+
+        When squaring, b is not evaluated and all five products are squares.
+    */
+    size_t k = (n + 2) / 3;
+    size_t l = n - 2*k;
+    size_t K = k + 1;
+    size_t evalA = sOff;
+    size_t evalB = sOff + K;
+    size_t r1 = sOff + 2*K;
+    size_t rm1 = sOff + 4*K;
+    size_t r2 = sOff + 6*K;
+    size_t rec = sOff + 8*K;
+    size_t i;
+    int square = a == b && aOff == bOff;
+    int negative;
+
+    /* c_0 and c_4 */
+    FN(mulRangeDispatch)(a, aOff, b, bOff, k, r, rOff, s, rec);
+    FN(mulRangeDispatch)(a, aOff + 2*k, b, bOff + 2*k, l, r, rOff + 4*k, s, rec);
+    for (i = 2*k; i < 4*k; i++)
+    {
+        SETWORD(r, rOff + i, 0);
+    }
+
+    /* Evaluate at 1, the r_2 space holds the values until they are multiplied. */
+    FN(copyRange)(s, evalA, K, a, aOff, k);
+    FN(addToRange)(s, evalA, K, a, aOff + 2*k, l, 0);
+    FN(copyRange)(s, r2, K, s, evalA, K);
+    FN(addToRange)(s, r2, K, a, aOff + k, k, 0);
+    if (!square)
+    {
+        FN(copyRange)(s, evalB, K, b, bOff, k);
+        FN(addToRange)(s, evalB, K, b, bOff + 2*k, l, 0);
+        FN(copyRange)(s, r2 + K, K, s, evalB, K);
+        FN(addToRange)(s, r2 + K, K, b, bOff + k, k, 0);
+    }
+    FN(mulRangeDispatch)(s, r2, s, square ? r2 : r2 + K, K, s, r1, s, rec);
+
+    /* Evaluate at -1 */
+    negative = FN(absDiffRange)(s, evalA, a, aOff + k, k, K, s, evalA);
+    if (square)
+    {
+        negative = 0;
+    }
+    else
+    {
+        negative ^= FN(absDiffRange)(s, evalB, b, bOff + k, k, K, s, evalB);
+    }
+    FN(mulRangeDispatch)(s, evalA, s, square ? evalA : evalB, K, s, rm1, s, rec);
+
+    /* Evaluate at 2 */
+    FN(copyRange)(s, evalA, K, a, aOff + 2*k, l);
+    FN(doubleRange)(s, evalA, K);
+    FN(addToRange)(s, evalA, K, a, aOff + k, k, 0);
+    FN(doubleRange)(s, evalA, K);
+    FN(addToRange)(s, evalA, K, a, aOff, k, 0);
+    if (!square)
+    {
+        FN(copyRange)(s, evalB, K, b, bOff + 2*k, l);
+        FN(doubleRange)(s, evalB, K);
+        FN(addToRange)(s, evalB, K, b, bOff + k, k, 0);
+        FN(doubleRange)(s, evalB, K);
+        FN(addToRange)(s, evalB, K, b, bOff, k, 0);
+    }
+    FN(mulRangeDispatch)(s, evalA, s, square ? evalA : evalB, K, s, r2, s, rec);
+
+    /* Interpolation. The evaluation space (2K words) holds c_1 + c_3, r_1 becomes c_2. */
+    FN(copyRange)(s, evalA, 2*K, s, r1, 2*K);
+    FN(addToRange)(s, evalA, 2*K, s, rm1, 2*K, !negative);
+    FN(addToRange)(s, r1, 2*K, s, rm1, 2*K, negative);
+    FN(halveRange)(s, evalA, 2*K);
+    FN(halveRange)(s, r1, 2*K);
+    FN(addToRange)(s, r1, 2*K, r, rOff, 2*k, 1);
+    FN(addToRange)(s, r1, 2*K, r, rOff + 4*k, 2*l, 1);
+
+    /* r_2 becomes c_3, the r_m1 space is used for the temporaries. */
+    FN(addToRange)(s, r2, 2*K, r, rOff, 2*k, 1);
+    FN(copyRange)(s, rm1, 2*K, s, r1, 2*K);
+    FN(doubleRange)(s, rm1, 2*K);
+    FN(doubleRange)(s, rm1, 2*K);
+    FN(addToRange)(s, r2, 2*K, s, rm1, 2*K, 1);
+    FN(copyRange)(s, rm1, 2*K, r, rOff + 4*k, 2*l);
+    for (i = 0; i < 4; i++)
+    {
+        FN(doubleRange)(s, rm1, 2*K);
+    }
+    FN(addToRange)(s, r2, 2*K, s, rm1, 2*K, 1);
+    FN(addToRange)(s, r2, 2*K, s, evalA, 2*K, 1);
+    FN(addToRange)(s, r2, 2*K, s, evalA, 2*K, 1);
+    FN(halveRange)(s, r2, 2*K);
+    FN(divExact3Range)(s, r2, 2*K);
+
+    /* c_1 */
+    FN(addToRange)(s, evalA, 2*K, s, r2, 2*K, 1);
+
+    /* Add the middle coefficients to their place. The words beyond the end of the product are zero. */
+    FN(addToRange)(r, rOff + k, 2*n - k, s, evalA, 2*K < 2*n - k ? 2*K : 2*n - k, 0);
+    FN(addToRange)(r, rOff + 2*k, 2*n - 2*k, s, r1, 2*K < 2*n - 2*k ? 2*K : 2*n - 2*k, 0);
+    FN(addToRange)(r, rOff + 3*k, 2*n - 3*k, s, r2, 2*K < 2*n - 3*k ? 2*K : 2*n - 3*k, 0);
+}
+
+
+/* r[rOff .. rOff + 2n) = a[aOff .. aOff + n) * b[bOff .. bOff + n), chooses the algorithm based on n.
+ * If the two ranges are the same, the squaring variants are used. */
+SPECIFIER void FN(mulRangeDispatch)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    size_t n,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    if (n >= NTT_THRESHOLD && FN(nttLength)(n))
+    {
+        FN(nttRange)(a, aOff, b, bOff, n, r, rOff, s, sOff);
+    }
+    else if (n >= TOOM3_THRESHOLD && n >= 5)
+    {
+        FN(toom3Range)(a, aOff, b, bOff, n, r, rOff, s, sOff);
+    }
+    else if (n >= KARATSUBA_THRESHOLD && n >= 2)
+    {
+        FN(karatsubaRange)(a, aOff, b, bOff, n, r, rOff, s, sOff);
+    }
+    else if (a == b && aOff == bOff)
+    {
+        FN(sqrRange)(a, aOff, n, r, rOff);
+    }
+    else
+    {
+        FN(mulRange)(a, aOff, b, bOff, n, r, rOff);
+    }
+}
+
+
+/* Copies the len word product from the beginning of the scratch to the result. Returns non-zero on truncation. */
+SPECIFIER int FN(storeProduct)(const BIGINT_TYPE *scratch, size_t len, BIGINT_TYPE *result)
+{
+    size_t i;
+    size_t nR = GETNWORDS(result);
+
+    for (i = 0; i < nR; i++)
+    {
+        SETWORD(result, i, i < len ? GETWORD(scratch, i) : 0);
+    }
+    for (; i < len; i++)
+    {
+        if (GETWORD(scratch, i) != 0) return 1;
+    }
+
+    return 0;
+}
+
+
+/* The number of words the algorithms of mulScratch work on for an nA and an nB word number. If the longer one is more than twice
+ * as long as the shorter, it's cut into chunks of the shorter one's size, otherwise the shorter one is zero extended. */
+SPECIFIER size_t FN(mulChunkSize)(size_t nA, size_t nB)
+{
+    size_t nLong = nA > nB ? nA : nB;
+    size_t nShort = nA < nB ? nA : nB;
+
+    return nLong > 2*nShort ? nShort : nLong;
+}
+
+
+/* The scratch needed to multiply two n word ranges with any of the algorithms used at the top level, the 2n word product included. */
+SPECIFIER size_t FN(mulTopScratchSize)(size_t n)
+{
+    size_t size = 0;
+    size_t algoSize;
+
+    algoSize = n >= 2 ? FN(karatsubaRangeScratchSize)(n) : 0;
+    if (algoSize > size) size = algoSize;
+    algoSize = n >= 5 ? FN(toom3RangeScratchSize)(n) : 0;
+    if (algoSize > size) size = algoSize;
+    algoSize = FN(nttLength)(n) ? FN(nttRangeScratchSize)(n) : 0;
+    if (algoSize > size) size = algoSize;
+
+    return 2*n + size;
+}
+
+
+SPECIFIER size_t FN(mulScratchSize)(size_t nA, size_t nB)
+{
+    size_t nLong = nA > nB ? nA : nB;
+    size_t nShort = nA < nB ? nA : nB;
+    size_t size, chunked;
+
+    if (nShort < KARATSUBA_THRESHOLD) return 0;
+
+    /* The algorithms go by the used words, those can make unbalanced numbers balanced, so both cases are covered. */
+    size = FN(mulTopScratchSize)(nLong < 2*nShort ? nLong : 2*nShort);
+    if (nLong > 2*nShort)
+    {
+        /* The full product, then a chunk product with its scratch. */
+        chunked = nLong + nShort + FN(mulTopScratchSize)(nShort);
+        if (chunked > size) size = chunked;
+    }
+
+    return size;
+}
+
+
+/* Multiplies with a range algorithm (karatsubaRange, toom3Range or nttRange) on mulChunkSize(nA, nB) word ranges.
+ * For unbalanced numbers the chunks of the longer one are multiplied by the shorter one and the partial products are summed,
+ * so the cost grows linearly with the length of the longer one. Returns non-zero on truncation. */
+SPECIFIER int FN(mulWithRange)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch,
+    void (*algo)(const BIGINT_TYPE *, size_t, const BIGINT_TYPE *, size_t, size_t, BIGINT_TYPE *, size_t, BIGINT_TYPE *, size_t)
+)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+    size_t nLong = nA > nB ? nA : nB;
+    size_t nShort = nA < nB ? nA : nB;
+    size_t n = FN(mulChunkSize)(nA, nB);
+    size_t nP = nLong + nShort;
+    const BIGINT_TYPE *longer = nA > nB ? a : b;
+    const BIGINT_TYPE *shorter = nA > nB ? b : a;
+    size_t i, off;
+
+    if (n == nLong)
+    {
+        /* The full product goes to the beginning of the scratch space, then it's copied to the result. */
+        algo(a, 0, b, 0, n, scratch, 0, scratch, 2*n);
+        return FN(storeProduct)(scratch, 2*n, result);
+    }
+
+    for (i = 0; i < nP; i++)
+    {
+        SETWORD(scratch, i, 0);
+    }
+    for (off = 0; off < nLong; off += n)
+    {
+        /* The last chunk is zero extended. Its product fits into the rest of the full product anyway. */
+        algo(longer, off, shorter, 0, n, scratch, nP, scratch, nP + 2*n);
+        FN(addToRange)(scratch, off, nP - off, scratch, nP, 2*n < nP - off ? 2*n : nP - off, 0);
+    }
+
+    return FN(storeProduct)(scratch, nP, result);
+}
+
+
+SPECIFIER int FN(mulKaratsuba)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+
+    if (FN(mulChunkSize)(nA, nB) < 2 || !FN(mulScratchSize)(nA, nB))
+    {
+        return FN(mul)(a, b, result);
+    }
+
+    return FN(mulWithRange)(a, b, result, scratch, FN(karatsubaRange));
+}
+
+
+SPECIFIER int FN(mulToom3)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+
+    if (FN(mulChunkSize)(nA, nB) < 5 || !FN(mulScratchSize)(nA, nB))
+    {
+        return FN(mulKaratsuba)(a, b, result, scratch);
+    }
+
+    return FN(mulWithRange)(a, b, result, scratch, FN(toom3Range));
+}
+
+
+SPECIFIER int FN(mulNtt)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+
+    if (!FN(nttLength)(FN(mulChunkSize)(nA, nB)) || !FN(mulScratchSize)(nA, nB))
+    {
+        return FN(mulToom3)(a, b, result, scratch);
+    }
+
+    return FN(mulWithRange)(a, b, result, scratch, FN(nttRange));
+}
+
+
+SPECIFIER int FN(sqr)(const BIGINT_TYPE *a, BIGINT_TYPE *result)
+{
+    size_t i, j;
+    size_t n = GETNWORDS(a);
+    size_t nR = GETNWORDS(result);
+    WORD_TYPE carry;
+    int truncate = 0;
+
+    ZERO_BIGINT(result);
+
+    /*
+        Everything added here is non-negative, so anything that would go beyond the last word of the result means truncation.
+    */
+
+    /* Sum of a_i a_j where i < j. */
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE aWord = GETWORD(a, i);
+
+        carry = 0;
+        for (j = i + 1; j < n; j++)
+        {
+            size_t k = i + j;
+            WORD_TYPE high, low, tmp;
+
+            FN(mulDigit)(aWord, GETWORD(a, j), &high, &low);
+            if (k >= nR)
+            {
+                if (high || low || carry) truncate = 1;
+                carry = 0;
+                continue;
+            }
+            high += FN(addDigit)(low, carry, &low);
+            high += FN(addDigit)(GETWORD(result, k), low, &tmp);
+            SETWORD(result, k, tmp);
+            carry = high;
+        }
+        if (i + n < nR)
+        {
+            SETWORD(result, i + n, carry);
+        }
+        else if (carry)
+        {
+            truncate = 1;
+        }
+    }
+
+    /* Double it. */
+    truncate |= FN(doubleRange)(result, 0, nR);
+
+    /* Add the squares a_i^2. */
+    carry = 0;
+    for (i = 0; i < n; i++)
+    {
+        size_t k = 2*i;
+        WORD_TYPE aWord = GETWORD(a, i);
+        WORD_TYPE high, low, tmp;
+        int c;
+
+        FN(mulDigit)(aWord, aWord, &high, &low);
+        if (k >= nR)
+        {
+            if (high || low || carry) truncate = 1;
+            carry = 0;
+            continue;
+        }
+        c = FN(addDigit)(GETWORD(result, k), low, &tmp);
+        c += FN(addDigit)(tmp, carry, &tmp);
+        SETWORD(result, k, tmp);
+        if (k + 1 >= nR)
+        {
+            if (high || c) truncate = 1;
+            carry = 0;
+            continue;
+        }
+        carry = FN(addDigit)(GETWORD(result, k + 1), high, &tmp);
+        carry += FN(addDigit)(tmp, c, &tmp);
+        SETWORD(result, k + 1, tmp);
+    }
+
+    /* The carry would go to word 2n. If the result has that word, the carry is zero. */
+    if (carry) truncate = 1;
+
+    return truncate;
+}
+
+
+SPECIFIER int FN(mulScratch)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result, BIGINT_TYPE *scratch)
+{
+    /* The algorithm is chosen by the actual size of the numbers, the leading zero words don't count. */
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+    size_t n = FN(mulChunkSize)(nA, nB);
+
+    if (!scratch || !FN(mulScratchSize)(nA, nB))
+    {
+        return a == b ? FN(sqr)(a, result) : FN(mul)(a, b, result);
+    }
+    if (n >= NTT_THRESHOLD && FN(nttLength)(n))
+    {
+        return FN(mulNtt)(a, b, result, scratch);
+    }
+    if (n >= TOOM3_THRESHOLD)
+    {
+        return FN(mulToom3)(a, b, result, scratch);
+    }
+    return FN(mulKaratsuba)(a, b, result, scratch);
+}
+
+
+SPECIFIER int FN(sqrScratch)(const BIGINT_TYPE *a, BIGINT_TYPE *result, BIGINT_TYPE *scratch)
+{
+    return FN(mulScratch)(a, a, result, scratch);
+}
+
+
+SPECIFIER void FN(shl)(const BIGINT_TYPE *in, BIGINT_TYPE *out, unsigned shiftAmount)
+{
+    size_t dIndex = shiftAmount / WORD_BITS;
+    unsigned dShift = shiftAmount % WORD_BITS;
+    size_t n = GETNWORDS(in);
+    size_t nUsed = GETUSEDWORDS(in);
+    size_t m; /* The number of words of the input that are shifted. */
+    size_t top; /* The words of the output from here are zero. */
+    size_t i;
+
+    SETNWORDS(out, n);
+
+    if (dIndex > n) dIndex = n;
+    m = nUsed < n - dIndex ? nUsed : n - dIndex;
+    top = dIndex + m;
+
+    /* Going from the top, so it works in place. The leading zero words of the input are not shifted, only cleared in the output. */
+    if (dShift)
+    {
+        WORD_TYPE bitsOut = FN(lshiftN)(out, dIndex, in, 0, m, dShift);
+
+        if (top < n)
+        {
+            SETWORD(out, top, bitsOut);
+            top++;
+        }
+    }
+    else
+    {
+        /* Zero shift case can be simplified. Also we cam avoid out of range shifts. */
+        for (i = top; i --> dIndex;)
+        {
+            SETWORD(out, i, GETWORD(in, i - dIndex));
+        }
+    }
+    for (i = top; i < n; i++)
+    {
+        SETWORD(out, i, 0);
+    }
+    for (i = 0; i < dIndex; i++)
+    {
+        SETWORD(out, i, 0);
+    }
+}
+
+
+SPECIFIER void FN(shr)(const BIGINT_TYPE *in, BIGINT_TYPE *out, unsigned shiftAmount)
+{
+    size_t dIndex = shiftAmount / WORD_BITS;
+    unsigned dShift = shiftAmount % WORD_BITS;
+    size_t n = GETNWORDS(in);
+    size_t nUsed = GETUSEDWORDS(in);
+    size_t m; /* The number of words of the output that can be nonzero. */
+    size_t i;
+
+    SETNWORDS(out, n);
+
+    m = nUsed > dIndex ? nUsed - dIndex : 0;
+    if (dIndex > n) dIndex = n;
+
+    /* Going from the bottom, so it works in place. */
+    if (dShift)
+    {
+        FN(rshiftN)(out, 0, in, dIndex, m, dShift);
+    }
+    else
+    {
+        /* Zero shift case can be simplified. Also we cam avoid out of range shifts. */
+        for (i = 0; i < m; i++)
+        {
+            SETWORD(out, i, GETWORD(in, i + dIndex));
+        }
+    }
+    for (i = m; i < n; i++)
+    {
+        SETWORD(out, i, 0);
+    }
+}
+
+
+SPECIFIER void FN(and)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+{
+    size_t i;
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA < nB ? nA : nB;
+    size_t nMax = nA > nB ? nA : nB;
+
+#if USE_SIMD
+    FN(bitwiseWords)(WORD_PTR(out), WORD_PTR(a), WORD_PTR(b), n, 0);
+#else
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(out, i, GETWORD(a, i) & GETWORD(b, i));
+    }
+#endif
+    for (i = n; i < nMax; i++)
+    {
+        SETWORD(out, i, 0);
+    }
+
+    SETNWORDS(out, nMax);
+}
+
+
+SPECIFIER void FN(or)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+{
+    size_t i;
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA < nB ? nA : nB;
+    size_t nMax = nA > nB ? nA : nB;
+    const BIGINT_TYPE *longer = nA > nB ? a : b;
+
+#if USE_SIMD
+    FN(bitwiseWords)(WORD_PTR(out), WORD_PTR(a), WORD_PTR(b), n, 1);
+#else
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(out, i, GETWORD(a, i) | GETWORD(b, i));
+    }
+#endif
+    for (i = n; i < nMax; i++)
+    {
+        SETWORD(out, i, GETWORD(longer, i));
+    }
+
+    SETNWORDS(out, nMax);
+}
+
+
+SPECIFIER void FN(xor)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+{
+    size_t i;
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA < nB ? nA : nB;
+    size_t nMax = nA > nB ? nA : nB;
+    const BIGINT_TYPE *longer = nA > nB ? a : b;
+
+#if USE_SIMD
+    FN(bitwiseWords)(WORD_PTR(out), WORD_PTR(a), WORD_PTR(b), n, 2);
+#else
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(out, i, GETWORD(a, i) ^ GETWORD(b, i));
+    }
+#endif
+    for (i = n; i < nMax; i++)
+    {
+        SETWORD(out, i, GETWORD(longer, i));
+    }
+
+    SETNWORDS(out, nMax);
+}
+
+
+SPECIFIER int FN(lessThan)(const BIGINT_TYPE *a, const BIGINT_TYPE *b)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+
+    /* The longer one is larger, otherwise compare from the top. */
+    if (nA != nB) return nA < nB;
+
+    while (nA --> 0)
+    {
+        WORD_TYPE aWord = GETWORD(a, nA);
+        WORD_TYPE bWord = GETWORD(b, nA);
+
+        if (aWord < bWord) return 1;
+        if (aWord > bWord) return 0;
+    }
+    return 0;
+}
+
+
+SPECIFIER int FN(equal)(const BIGINT_TYPE *a, const BIGINT_TYPE *b)
+{
+    size_t nA = GETUSEDWORDS(a);
+    size_t nB = GETUSEDWORDS(b);
+
+    if (nA != nB) return 0;
+
+    while (nA --> 0)
+    {
+        if (GETWORD(a, nA) != GETWORD(b, nA)) return 0;
+    }
+    return 1;
+}
+
+
+/* Returns the word x[off + i] shifted left by shift bits, with the bits coming from the word below. */
+SPECIFIER WORD_TYPE FN(getShiftedWord)(const BIGINT_TYPE *x, size_t off, size_t i, unsigned shift)
+{
+    WORD_TYPE word = GETWORD(x, off + i) << shift;
+
+    if (shift && i > 0)
+    {
+        word |= GETWORD(x, off + i - 1) >> (WORD_BITS - shift);
+    }
+
+    return word;
+}
+
+
+/* divMod on word ranges: the dividend is x[xOff .. xOff + nD), the divisor is d[dOff .. dOff + nS).
+ * The quotient goes to q[qOff .. qOff + nD) (q can be NULL), the remainder to r[rOff .. rOff + nS).
+ * The outputs must not overlap with the inputs. */
+SPECIFIER void FN(divModRange)(
+    const BIGINT_TYPE *x, size_t xOff, size_t nD,
+    const BIGINT_TYPE *d, size_t dOff, size_t nS,
+    BIGINT_TYPE *q, size_t qOff,
+    BIGINT_TYPE *r, size_t rOff
+)
+{
+    /*
+        Knuth's algorithm D. The quotient words are estimated as if both numbers were shifted left so the top bit of the divisor
+        is set (only the top words are shifted, on the fly, the quotient is the same). Each quotient word is estimated from the
+        top two words of the partial remainder and the top word of the divisor. After a correction step using the second word
+        of the divisor, the estimate is either correct or one too large, the latter is detected and fixed after the multiply
+        and subtract step, which is done on the unshifted numbers.
+
+        The partial remainder is kept in the remainder, its top word (which becomes zero after each step) in a local variable.
+    */
+    size_t n = nS;
+    size_t i, j;
+    unsigned shift = 0;
+    WORD_TYPE divTop, divSecond;
+
+    if (q)
+    {
+        for (i = 0; i < nD; i++)
+        {
+            SETWORD(q, qOff + i, 0);
+        }
+    }
+    for (i = 0; i < nS; i++)
+    {
+        SETWORD(r, rOff + i, 0);
+    }
+
+    while (n > 0 && GETWORD(d, dOff + n - 1) == 0) n--;
+
+    if (n == 0)
+    {
+        /* Zero division, behave like the bit by bit algorithm would: the remainder is the dividend, the quotient is all 1 bits. */
+        for (i = 0; i < nS && i < nD; i++)
+        {
+            SETWORD(r, rOff + i, GETWORD(x, xOff + i));
+        }
+        if (q)
+        {
+            for (i = 0; i < nD; i++)
+            {
+                SETWORD(q, qOff + i, (WORD_TYPE)~(WORD_TYPE)0);
+            }
+        }
+        return;
+    }
+
+    /* The leading zero words of the dividend would only produce zero quotient words. */
+    while (nD > 0 && GETWORD(x, xOff + nD - 1) == 0) nD--;
+
+    if (nD < n)
+    {
+        /* The dividend is smaller than the divisor. */
+        for (i = 0; i < nD; i++)
+        {
+            SETWORD(r, rOff + i, GETWORD(x, xOff + i));
+        }
+        return;
+    }
+
+    divTop = GETWORD(d, dOff + n - 1);
+    while (!(divTop >> (WORD_BITS - 1)))
+    {
+        divTop <<= 1;
+        shift++;
+    }
+    divTop = FN(getShiftedWord)(d, dOff, n - 1, shift);
+    divSecond = n >= 2 ? FN(getShiftedWord)(d, dOff, n - 2, shift) : 0;
+
+    /* Start with the top n - 1 words of the dividend. */
+    for (i = 0; i + 1 < n; i++)
+    {
+        SETWORD(r, rOff + i, GETWORD(x, xOff + nD - n + 1 + i));
+    }
+
+    j = nD - n + 1;
+    while (j --> 0)
+    {
+        WORD_TYPE top = GETWORD(r, rOff + n - 1);
+        WORD_TYPE shiftedTop, next, third;
+        WORD_TYPE qHat, rHat;
+        int rHatOverflow = 0;
+        int negative;
+
+        /* Bring down the next word of the dividend. */
+        for (i = n - 1; i > 0; i--)
+        {
+            SETWORD(r, rOff + i, GETWORD(r, rOff + i - 1));
+        }
+        SETWORD(r, rOff, GETWORD(x, xOff + j));
+
+        /* The top three words of the shifted partial remainder. It's less than divisor*WORD, so nothing is shifted out of top. */
+        shiftedTop = shift ? (top << shift) | (GETWORD(r, rOff + n - 1) >> (WORD_BITS - shift)) : top;
+        next = FN(getShiftedWord)(r, rOff, n - 1, shift);
+        third = n >= 2 ? FN(getShiftedWord)(r, rOff, n - 2, shift) : 0;
+
+        /* Estimate the quotient word. */
+        if (shiftedTop >= divTop)
+        {
+            /* The estimate would not fit into a word, start from the largest word. rHat = top:next - qHat*divTop */
+            qHat = (WORD_TYPE)~(WORD_TYPE)0;
+            rHatOverflow = FN(addDigit)(next, divTop, &rHat);
+        }
+        else
+        {
+            FN(divDigit)(shiftedTop, next, divTop, &qHat, &rHat);
+        }
+
+        if (n >= 2)
+        {
+            /* Decrease the estimate while qHat*divSecond > rHat:third. */
+            while (!rHatOverflow)
+            {
+                WORD_TYPE high, low;
+
+                FN(mulDigit)(qHat, divSecond, &high, &low);
+                if (high < rHat || (high == rHat && low <= third)) break;
+
+                qHat--;
+                rHatOverflow = FN(addDigit)(rHat, divTop, &rHat);
+            }
+        }
+
+        /* Multiply and subtract. */
+        negative = FN(subDigit)(top, FN(subMul1)(r, rOff, d, dOff, n, qHat), &top);
+        if (negative)
+        {
+            /* The estimate was one too large, add the divisor back. */
+            qHat--;
+            FN(addN)(r, rOff, r, rOff, d, dOff, n, 0);
+        }
+
+        if (q) SETWORD(q, qOff + j, qHat);
+    }
+}
+
+
+SPECIFIER void FN(divMod)(
+    const BIGINT_TYPE *dividend,
+    const BIGINT_TYPE *divisor,
+    BIGINT_TYPE *quotient,
+    BIGINT_TYPE *remainder
+)
+{
+    size_t nD = GETNWORDS(dividend);
+    size_t nS = GETNWORDS(divisor);
+
+    if (quotient)
+    {
+        SETNWORDS(quotient, nD);
+    }
+    SETNWORDS(remainder, nS);
+
+    FN(divModRange)(dividend, 0, nD, divisor, 0, nS, quotient, 0, remainder, 0);
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) * b[bOff .. bOff + n) / R mod modulus, where n is the number of words in the modulus.
+ * b == NULL means b = 1, that's used for the conversion from Montgomery form. The output must not overlap with the inputs.
+ * The sequence of operations doesn't depend on the values. */
+SPECIFIER void FN(montMulRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    BIGINT_TYPE *r, size_t rOff
+)
+{
+    /*
+        The partial result t is kept in r, plus two extra words on the top in local variables.
+        In each step a word of b is multiplied by a and added to t, then a multiple of the modulus is added
+        to make the lowest word zero and t is shifted down by one word. t stays below 2*modulus all the time.
+    */
+    size_t n = GETNWORDS(modulus);
+    size_t i, j;
+    WORD_TYPE tTop = 0;
+    WORD_TYPE mask;
+    int tTop2;
+    int borrow = 0;
+
+    for (j = 0; j < n; j++)
+    {
+        SETWORD(r, rOff + j, 0);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE bWord = b ? FN(getWordPadded)(b, bOff + i) : (WORD_TYPE)(i == 0);
+        WORD_TYPE carry = 0;
+        WORD_TYPE high, low, m;
+
+        /* t += a*b[i] */
+        for (j = 0; j < n; j++)
+        {
+            FN(mulDigit)(FN(getWordPadded)(a, aOff + j), bWord, &high, &low);
+            high += FN(addDigit)(low, carry, &low);
+            high += FN(addDigit)(low, GETWORD(r, rOff + j), &low);
+            SETWORD(r, rOff + j, low);
+            carry = high;
+        }
+        tTop2 = FN(addDigit)(tTop, carry, &tTop);
+
+        /* t = (t + m*modulus) / 2^WORD_BITS */
+        m = (WORD_TYPE)(GETWORD(r, rOff) * mInv);
+        FN(mulDigit)(m, GETWORD(modulus, 0), &high, &low);
+        high += FN(addDigit)(low, GETWORD(r, rOff), &low);
+        carry = high;
+        for (j = 1; j < n; j++)
+        {
+            FN(mulDigit)(m, GETWORD(modulus, j), &high, &low);
+            high += FN(addDigit)(low, carry, &low);
+            high += FN(addDigit)(low, GETWORD(r, rOff + j), &low);
+            SETWORD(r, rOff + j - 1, low);
+            carry = high;
+        }
+        tTop2 += FN(addDigit)(tTop, carry, &low);
+        SETWORD(r, rOff + n - 1, low);
+        tTop = tTop2;
+    }
+
+    /* Final subtraction, if t >= modulus. First only the borrow is computed, then the modulus is subtracted with a mask. */
+    for (j = 0; j < n; j++)
+    {
+        WORD_TYPE tmp;
+
+        borrow = FN(subBorrow)(GETWORD(r, rOff + j), GETWORD(modulus, j), borrow, &tmp);
+    }
+    mask = (WORD_TYPE)0 - (WORD_TYPE)(tTop | !borrow);
+
+    borrow = 0;
+    for (j = 0; j < n; j++)
+    {
+        WORD_TYPE tmp;
+
+        borrow = FN(subBorrow)(GETWORD(r, rOff + j), GETWORD(modulus, j) & mask, borrow, &tmp);
+        SETWORD(r, rOff + j, tmp);
+    }
+}
+
+
+SPECIFIER void FN(montMul)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    BIGINT_TYPE *result
+)
+{
+    SETNWORDS(result, GETNWORDS(modulus));
+    FN(montMulRange)(a, 0, b, 0, modulus, mInv, result, 0);
+}
+
+
+SPECIFIER void FN(montToDomain)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    const BIGINT_TYPE *r2,
+    BIGINT_TYPE *result
+)
+{
+    SETNWORDS(result, GETNWORDS(modulus));
+    FN(montMulRange)(a, 0, r2, 0, modulus, mInv, result, 0);
+}
+
+
+SPECIFIER void FN(montFromDomain)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE mInv,
+    BIGINT_TYPE *result
+)
+{
+    SETNWORDS(result, GETNWORDS(modulus));
+    FN(montMulRange)(a, 0, NULL, 0, modulus, mInv, result, 0);
+}
+
+
+/* The number of nonzero words of the modulus, at least 1. */
+SPECIFIER size_t FN(barrettK)(const BIGINT_TYPE *modulus)
+{
+    size_t k = GETNWORDS(modulus);
+
+    while (k > 1 && GETWORD(modulus, k - 1) == 0) k--;
+
+    return k;
+}
+
+
+/*
+ * Barrett reduction (HAC 14.42). With k = nonzero words of the modulus, b = 2^WORD_BITS and mu = floor(b^2k / m):
+ *
+ * q3 = floor(floor(x / b^(k-1)) * mu / b^(k+1)) is an estimate of the quotient, at most a few less than the real one.
+ * r = (x - q3*m) mod b^(k+1), then m is subtracted while r >= m.
+ *
+ * Only the high half of the first product and the low half of the second product is needed.
+ */
+
+/* result[resOff .. resOff + n) = x mod modulus, where x is the xLen word range at xOff and n is the number of words in the modulus.
+ * mu is the k + 1 word range at muOff. Uses 3k + 3 words of scratch at sOff. */
+SPECIFIER void FN(barrettReduceRange)(
+    const BIGINT_TYPE *x, size_t xOff, size_t xLen,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu, size_t muOff,
+    BIGINT_TYPE *result, size_t resOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    size_t k = FN(barrettK)(modulus);
+    size_t n = GETNWORDS(modulus);
+    size_t q = sOff; /* q1*mu, its top k + 1 words is q3. */
+    size_t r = sOff; /* The remainder, overwrites the low half of q1*mu, which is not needed. */
+    size_t t = sOff + 2*k + 2; /* q3*m mod b^(k+1) */
+    size_t i, j;
+    int borrow = 0;
+
+    /* High half of q1*mu, the partial products below column k - 1 are left out, they can change q3 by 1 at most. */
+    for (i = 0; i < 2*k + 2; i++)
+    {
+        SETWORD(s, q + i, 0);
+    }
+    for (i = 0; i <= k; i++)
+    {
+        WORD_TYPE q1Word = k - 1 + i < xLen ? GETWORD(x, xOff + k - 1 + i) : 0;
+        WORD_TYPE carry = 0;
+
+        if (!q1Word) continue;
+
+        for (j = i < k - 1 ? k - 1 - i : 0; j <= k; j++)
+        {
+            WORD_TYPE high, low, tmp;
+
+            FN(mulDigit)(q1Word, GETWORD(mu, muOff + j), &high, &low);
+            high += FN(addDigit)(low, carry, &low);
+            high += FN(addDigit)(GETWORD(s, q + i + j), low, &tmp);
+            SETWORD(s, q + i + j, tmp);
+            carry = high;
+        }
+        SETWORD(s, q + i + k + 1, carry);
+    }
+
+    /* Low half of q3*m. */
+    for (i = 0; i <= k; i++)
+    {
+        SETWORD(s, t + i, 0);
+    }
+    for (i = 0; i <= k; i++)
+    {
+        WORD_TYPE q3Word = GETWORD(s, q + k + 1 + i);
+        WORD_TYPE carry = 0;
+
+        if (!q3Word) continue;
+
+        for (j = 0; i + j <= k; j++)
+        {
+            WORD_TYPE high, low, tmp;
+
+            FN(mulDigit)(q3Word, FN(getWordPadded)(modulus, j), &high, &low);
+            high += FN(addDigit)(low, carry, &low);
+            high += FN(addDigit)(GETWORD(s, t + i + j), low, &tmp);
+            SETWORD(s, t + i + j, tmp);
+            carry = high;
+        }
+    }
+
+    /* r = x - q3*m mod b^(k+1) */
+    for (i = 0; i <= k; i++)
+    {
+        WORD_TYPE tmp;
+
+        borrow = FN(subBorrow)(i < xLen ? GETWORD(x, xOff + i) : 0, GETWORD(s, t + i), borrow, &tmp);
+        SETWORD(s, r + i, tmp);
+    }
+
+    /* Fix up the estimate. */
+    for (;;)
+    {
+        int less = 0;
+
+        i = k + 1;
+        while (i --> 0)
+        {
+            WORD_TYPE rWord = GETWORD(s, r + i);
+            WORD_TYPE mWord = FN(getWordPadded)(modulus, i);
+
+            if (rWord != mWord)
+            {
+                less = rWord < mWord;
+                break;
+            }
+        }
+        if (less) break;
+
+        borrow = 0;
+        for (i = 0; i <= k; i++)
+        {
+            WORD_TYPE tmp;
+
+            borrow = FN(subBorrow)(GETWORD(s, r + i), FN(getWordPadded)(modulus, i), borrow, &tmp);
+            SETWORD(s, r + i, tmp);
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(result, resOff + i, i <= k ? GETWORD(s, r + i) : 0);
+    }
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + n) * b[bOff .. bOff + n) mod modulus, where n is the number of words in the modulus.
+ * Without mu (zero modulus) the product is truncated to n words, just like divMod would do.
+ * Uses barrettScratchSize(n) words of scratch at sOff. The output can overlap with the inputs. */
+SPECIFIER void FN(modMulRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu, size_t muOff,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    size_t n = GETNWORDS(modulus);
+
+    /* The product goes to the beginning of the scratch, the rest is used by the multiplication and the reduction. */
+    FN(mulRangeDispatch)(a, aOff, b, bOff, n, s, sOff, s, sOff + 2*n);
+    if (mu)
+    {
+        FN(barrettReduceRange)(s, sOff, 2*n, modulus, mu, muOff, r, rOff, s, sOff + 2*n);
+    }
+    else
+    {
+        FN(copyRange)(r, rOff, n, s, sOff, n);
+    }
+}
+
+
+SPECIFIER size_t FN(barrettScratchSize)(size_t n)
+{
+    size_t mulSize = FN(mulRangeScratchSize)(n);
+
+    return 2*n + (mulSize > 3*n + 3 ? mulSize : 3*n + 3);
+}
+
+
+SPECIFIER void FN(barrettReduce)(
+    const BIGINT_TYPE *x,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    FN(barrettReduceRange)(x, 0, GETNWORDS(x), modulus, mu, 0, result, 0, scratch, 0);
+    SETNWORDS(result, GETNWORDS(modulus));
+}
+
+
+SPECIFIER void FN(modMulBarrett)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    const BIGINT_TYPE *modulus,
+    const BIGINT_TYPE *mu,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    SETNWORDS(result, GETNWORDS(modulus));
+    FN(modMulRange)(a, 0, b, 0, modulus, mu, 0, result, 0, scratch, 0);
+}
+
+
+/* Returns the number of words in x[off .. off + n) without the leading zero words. */
+SPECIFIER size_t FN(significantWordsRange)(const BIGINT_TYPE *x, size_t off, size_t n)
+{
+    while (n > 0 && GETWORD(x, off + n - 1) == 0) n--;
+
+    return n;
+}
+
+
+/* Compares a[aOff .. aOff + n) with b[bOff .. bOff + n). Returns negative, zero or positive like memcmp. */
+SPECIFIER int FN(compareRange)(const BIGINT_TYPE *a, size_t aOff, const BIGINT_TYPE *b, size_t bOff, size_t n)
+{
+    while (n --> 0)
+    {
+        WORD_TYPE aWord = GETWORD(a, aOff + n);
+        WORD_TYPE bWord = GETWORD(b, bOff + n);
+
+        if (aWord != bWord) return aWord < bWord ? -1 : 1;
+    }
+
+    return 0;
+}
+
+
+/* Returns non-zero if x[off .. off + n) is 1. */
+SPECIFIER int FN(isOneRange)(const BIGINT_TYPE *x, size_t off, size_t n)
+{
+    return FN(significantWordsRange)(x, off, n) == 1 && GETWORD(x, off) == 1;
+}
+
+
+/* Returns the number of trailing zero bits of the number at off. It must not be zero. */
+SPECIFIER size_t FN(trailingZerosRange)(const BIGINT_TYPE *x, size_t off)
+{
+    size_t count = 0;
+    WORD_TYPE word;
+
+    while ((word = GETWORD(x, off)) == 0)
+    {
+        off++;
+        count += WORD_BITS;
+    }
+    while (!(word & 1))
+    {
+        word >>= 1;
+        count++;
+    }
+
+    return count;
+}
+
+
+/* x[off .. off + n) >>= amount, in place. */
+SPECIFIER void FN(shrRange)(BIGINT_TYPE *x, size_t off, size_t n, size_t amount)
+{
+    size_t words = amount / WORD_BITS;
+    unsigned bits = (unsigned)(amount % WORD_BITS);
+    size_t i;
+
+    if (words > n) words = n;
+
+    if (bits)
+    {
+        FN(rshiftN)(x, off, x, off + words, n - words, bits);
+    }
+    else
+    {
+        for (i = 0; i + words < n; i++)
+        {
+            SETWORD(x, off + i, GETWORD(x, off + i + words));
+        }
+    }
+    for (i = n - words; i < n; i++)
+    {
+        SETWORD(x, off + i, 0);
+    }
+}
+
+
+/* x[off .. off + n) <<= amount, in place. The bits shifted out are lost. */
+SPECIFIER void FN(shlRange)(BIGINT_TYPE *x, size_t off, size_t n, size_t amount)
+{
+    size_t words = amount / WORD_BITS;
+    unsigned bits = (unsigned)(amount % WORD_BITS);
+    size_t i;
+
+    if (words > n) words = n;
+
+    if (bits)
+    {
+        FN(lshiftN)(x, off + words, x, off, n - words, bits);
+    }
+    else
+    {
+        for (i = n; i --> words;)
+        {
+            SETWORD(x, off + i, GETWORD(x, off + i - words));
+        }
+    }
+    for (i = 0; i < words; i++)
+    {
+        SETWORD(x, off + i, 0);
+    }
+}
+
+
+/* r[rOff .. rOff + n) = a[aOff .. aOff + aLen) * b[bOff .. bOff + n) mod b^n. The output must not overlap with the inputs. */
+SPECIFIER void FN(mulLowRange)(
+    const BIGINT_TYPE *a, size_t aOff, size_t aLen,
+    const BIGINT_TYPE *b, size_t bOff, size_t n,
+    BIGINT_TYPE *r, size_t rOff
+)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(r, rOff + i, 0);
+    }
+    for (i = 0; i < aLen && i < n; i++)
+    {
+        WORD_TYPE aWord = GETWORD(a, aOff + i);
+
+        if (aWord) FN(addMul1)(r, rOff + i, b, bOff, n - i, aWord);
+    }
+}
+
+
+/* Binary GCD of two words. */
+SPECIFIER WORD_TYPE FN(gcdWord)(WORD_TYPE u, WORD_TYPE v)
+{
+    unsigned shift = 0;
+
+    if (!u) return v;
+    if (!v) return u;
+
+    while (!((u | v) & 1))
+    {
+        u >>= 1;
+        v >>= 1;
+        shift++;
+    }
+    while (!(u & 1)) u >>= 1;
+
+    do
+    {
+        while (!(v & 1)) v >>= 1;
+        if (u > v)
+        {
+            WORD_TYPE tmp = u;
+            u = v;
+            v = tmp;
+        }
+        v -= u;
+    } while (v);
+
+    return u << shift;
+}
+
+
+/* Binary (Stein's) GCD, uses only shifts and subtractions. u and v are n word ranges in s, both are overwritten.
+ * Returns the offset of the one that holds the GCD. */
+SPECIFIER size_t FN(gcdBinaryRange)(BIGINT_TYPE *s, size_t u, size_t v, size_t n)
+{
+    size_t nFull = n;
+    size_t shift, uZeros, swap;
+
+    if (!FN(significantWordsRange)(s, u, n)) return v;
+    if (!FN(significantWordsRange)(s, v, n)) return u;
+
+    /* gcd(2^k u, 2^k v) = 2^k gcd(u, v) */
+    shift = FN(trailingZerosRange)(s, v);
+    uZeros = FN(trailingZerosRange)(s, u);
+    if (uZeros < shift) shift = uZeros;
+    FN(shrRange)(s, u, n, uZeros);
+
+    /* gcd(u, v) = gcd(u, v - u) and the factors of 2 can be removed from the even one, as u is odd.
+     * The numbers only get smaller, so the words above the larger one are zero in both, they are left out. */
+    do
+    {
+        FN(shrRange)(s, v, n, FN(trailingZerosRange)(s, v));
+        if (FN(compareRange)(s, v, s, u, n) < 0)
+        {
+            swap = u;
+            u = v;
+            v = swap;
+        }
+        n = FN(significantWordsRange)(s, v, n);
+        FN(subN)(s, v, s, v, s, u, n, 0);
+    } while (FN(significantWordsRange)(s, v, n));
+
+    FN(shlRange)(s, u, nFull, shift);
+    return u;
+}
+
+
+/* r = a*x + b*y on n word ranges. The cofactors a and b are in two's complement, at most one of them is negative and the result must
+ * not be negative. */
+SPECIFIER void FN(linearCombination)(
+    const BIGINT_TYPE *x, size_t xOff, WORD_TYPE a,
+    const BIGINT_TYPE *y, size_t yOff, WORD_TYPE b,
+    BIGINT_TYPE *r, size_t rOff,
+    size_t n
+)
+{
+    size_t i;
+    WORD_TYPE signBit = (WORD_TYPE)1 << (WORD_BITS - 1);
+    WORD_TYPE carryX = 0, carryY = 0;
+    int negative;
+    int carry = 0;
+
+    if (a & signBit)
+    {
+        const BIGINT_TYPE *tmpBig = x;
+        size_t tmpOff = xOff;
+        WORD_TYPE tmp = a;
+
+        x = y;
+        xOff = yOff;
+        y = tmpBig;
+        yOff = tmpOff;
+        a = b;
+        b = tmp;
+    }
+    negative = (b & signBit) != 0;
+    if (negative) b = (WORD_TYPE)0 - b;
+
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE highX, lowX, highY, lowY, tmp;
+
+        FN(mulDigit)(a, GETWORD(x, xOff + i), &highX, &lowX);
+        highX += FN(addDigit)(lowX, carryX, &lowX);
+        carryX = highX;
+
+        FN(mulDigit)(b, GETWORD(y, yOff + i), &highY, &lowY);
+        highY += FN(addDigit)(lowY, carryY, &lowY);
+        carryY = highY;
+
+        if (negative)
+        {
+            carry = FN(subBorrow)(lowX, lowY, carry, &tmp);
+        }
+        else
+        {
+            carry = FN(addCarry)(lowX, lowY, carry, &tmp);
+        }
+        SETWORD(r, rOff + i, tmp);
+    }
+}
+
+
+/*
+ * Lehmer's GCD (Knuth 4.5.2 algorithm L).
+ *
+ * The Euclidean algorithm is simulated on the leading WORD_BITS - 1 bits of the numbers (taken from their top two words),
+ * as long as the quotients are surely the same as the quotients of the full numbers would be. The steps are collected into
+ * the cofactor matrix (A B; C D), then it's applied on the full numbers in one pass.
+ * With this precision the cofactors and the x + A, y + C ... sums fit in a word, the cofactors are in two's complement.
+ *
+ * When the quotient is too large to be simulated, a full division step is done.
+ */
+
+/* Simulates the Euclidean steps on the leading bits of the n word ranges u >= v in s, v must not be zero.
+ * If no step could be done, b is set to zero. */
+SPECIFIER void FN(lehmerSimulate)(
+    const BIGINT_TYPE *s, size_t u, size_t v, size_t n,
+    WORD_TYPE *aOut, WORD_TYPE *bOut, WORD_TYPE *cOut, WORD_TYPE *dOut
+)
+{
+    size_t nU = FN(significantWordsRange)(s, u, n);
+    WORD_TYPE top = GETWORD(s, u + nU - 1);
+    size_t bitLength = nU * WORD_BITS;
+    size_t pos, index;
+    unsigned shift;
+    WORD_TYPE x, y;
+    WORD_TYPE a = 1, b = 0, c = 0, d = 1;
+
+    while (!(top >> (WORD_BITS - 1)))
+    {
+        top <<= 1;
+        bitLength--;
+    }
+
+    /* x, y = the bits [pos, pos + WORD_BITS - 1) of u and v. For small numbers these are the numbers themselves. */
+    pos = bitLength > WORD_BITS - 1 ? bitLength - (WORD_BITS - 1) : 0;
+    index = pos / WORD_BITS;
+    shift = (unsigned)(pos % WORD_BITS);
+    x = GETWORD(s, u + index) >> shift;
+    y = GETWORD(s, v + index) >> shift;
+    if (shift && index + 1 < nU)
+    {
+        x |= GETWORD(s, u + index + 1) << (WORD_BITS - shift);
+        y |= GETWORD(s, v + index + 1) << (WORD_BITS - shift);
+    }
+
+    for (;;)
+    {
+        WORD_TYPE q, tmp;
+        WORD_TYPE yc = y + c;
+        WORD_TYPE yd = y + d;
+
+        if (yc == 0 || yd == 0) break;
+        q = (x + a) / yc;
+        if (q != (x + b) / yd) break;
+
+        tmp = a - q*c; a = c; c = tmp;
+        tmp = b - q*d; b = d; d = tmp;
+        tmp = x - q*y; x = y; y = tmp;
+    }
+
+    *aOut = a;
+    *bOut = b;
+    *cOut = c;
+    *dOut = d;
+}
+
+
+/* Lehmer's GCD. u, v, t, w are n word ranges in s, all of them are overwritten.
+ * Returns the offset of the one that holds the GCD. */
+SPECIFIER size_t FN(gcdLehmerRange)(BIGINT_TYPE *s, size_t u, size_t v, size_t t, size_t w, size_t n)
+{
+    size_t nFull = n;
+    size_t swap, i;
+
+    if (FN(compareRange)(s, u, s, v, n) < 0)
+    {
+        swap = u;
+        u = v;
+        v = swap;
+    }
+
+    /* u >= v all the time and they only get smaller, the words above u are left out. (Those can be stale in the temporaries.) */
+    for (;;)
+    {
+        WORD_TYPE a, b, c, d;
+
+        n = FN(significantWordsRange)(s, u, n);
+        if (FN(significantWordsRange)(s, v, n) <= 1) break;
+
+        FN(lehmerSimulate)(s, u, v, n, &a, &b, &c, &d);
+
+        if (b == 0)
+        {
+            /* No step could be simulated, do a division step. */
+            FN(divModRange)(s, u, n, s, v, n, NULL, 0, s, t);
+            swap = u;
+            u = v;
+            v = t;
+            t = swap;
+        }
+        else
+        {
+            FN(linearCombination)(s, u, a, s, v, b, s, t, n);
+            FN(linearCombination)(s, u, c, s, v, d, s, w, n);
+            swap = u;
+            u = t;
+            t = swap;
+            swap = v;
+            v = w;
+            w = swap;
+        }
+    }
+
+    /* Finish with single words. */
+    if (FN(significantWordsRange)(s, v, n))
+    {
+        WORD_TYPE g;
+
+        FN(divModRange)(s, u, n, s, v, n, NULL, 0, s, t);
+        g = FN(gcdWord)(GETWORD(s, v), GETWORD(s, t));
+        SETWORD(s, u, g);
+        n = 1;
+    }
+    for (i = n; i < nFull; i++)
+    {
+        SETWORD(s, u + i, 0);
+    }
+
+    return u;
+}
+
+
+/* Computes gcd(a, b) into the scratch at sOff, uses gcdScratchSize(nA, nB) words there.
+ * Returns the offset of the GCD, it has max(nA, nB) words. */
+SPECIFIER size_t FN(gcdRange)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *s, size_t sOff)
+{
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA > nB ? nA : nB;
+    size_t u = sOff;
+    size_t v = sOff + n;
+    size_t nUsed;
+
+    FN(copyRange)(s, u, n, a, 0, nA);
+    FN(copyRange)(s, v, n, b, 0, nB);
+
+    /* The binary algorithm is faster for small numbers, but it needs a step for each bit. */
+    nUsed = FN(significantWordsRange)(s, u, n);
+    if (FN(significantWordsRange)(s, v, n) > nUsed) nUsed = FN(significantWordsRange)(s, v, n);
+
+    if (nUsed >= GCD_LEHMER_THRESHOLD)
+    {
+        return FN(gcdLehmerRange)(s, u, v, sOff + 2*n, sOff + 3*n, n);
+    }
+    return FN(gcdBinaryRange)(s, u, v, n);
+}
+
+
+SPECIFIER size_t FN(gcdScratchSize)(size_t nA, size_t nB)
+{
+    return 4 * (nA > nB ? nA : nB);
+}
+
+
+SPECIFIER void FN(gcdScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *gcd,
+    BIGINT_TYPE *scratch
+)
+{
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t res = FN(gcdRange)(a, b, scratch, 0);
+
+    SETNWORDS(gcd, nB);
+    FN(copyRange)(gcd, 0, nB, scratch, res, nA > nB ? nA : nB);
+}
+
+
+/* Extended Lehmer GCD on ranges of s. num[0], num[1] are the offsets of the two numbers, cofs[0], cofs[1] the offsets of their
+ * cofactors (the coefficients of one of the original numbers), two's complement. cofs2 is an optional second cofactor sequence.
+ * Index 2 and 3 of the arrays are temporaries. The numbers have n words, the cofactors n + 1.
+ * q must have n words and prod n + 1.
+ *
+ * At the end num[0] holds the GCD, cofs[0] and cofs2[0] its cofactors. */
+SPECIFIER void FN(gcdExtLehmerRange)(
+    BIGINT_TYPE *s,
+    size_t num[4],
+    size_t cofs[4],
+    size_t cofs2[4],
+    size_t n,
+    size_t q,
+    size_t prod
+)
+{
+    size_t *seqs[3];
+    size_t nSeqs = cofs2 ? 3 : 2;
+    size_t nNum = n; /* The numbers only get smaller, the words above num[0] are left out. */
+    size_t i;
+
+    seqs[0] = num;
+    seqs[1] = cofs;
+    seqs[2] = cofs2;
+
+    /* The first step of the Euclidean algorithm swaps them, if the first one is smaller. */
+    if (FN(compareRange)(s, num[0], s, num[1], n) < 0)
+    {
+        for (i = 0; i < nSeqs; i++)
+        {
+            size_t swap = seqs[i][0];
+
+            seqs[i][0] = seqs[i][1];
+            seqs[i][1] = swap;
+        }
+    }
+
+    for (;;)
+    {
+        WORD_TYPE a, b, c, d;
+
+        nNum = FN(significantWordsRange)(s, num[0], nNum);
+        if (!FN(significantWordsRange)(s, num[1], nNum)) break;
+
+        FN(lehmerSimulate)(s, num[0], num[1], nNum, &a, &b, &c, &d);
+
+        if (b == 0)
+        {
+            /* Division step: [0] = [1], [1] = [0] - q*[1] */
+            FN(divModRange)(s, num[0], nNum, s, num[1], nNum, s, q, s, num[2]);
+            for (i = 1; i < nSeqs; i++)
+            {
+                FN(mulLowRange)(s, q, FN(significantWordsRange)(s, q, nNum), s, seqs[i][1], n + 1, s, prod);
+                FN(subN)(s, seqs[i][2], s, seqs[i][0], s, prod, n + 1, 0);
+            }
+            for (i = 0; i < nSeqs; i++)
+            {
+                size_t swap = seqs[i][0];
+
+                seqs[i][0] = seqs[i][1];
+                seqs[i][1] = seqs[i][2];
+                seqs[i][2] = swap;
+            }
+        }
+        else
+        {
+            /* The same linear combination applies to the numbers and the cofactors. The latter are computed modulo their word count. */
+            for (i = 0; i < nSeqs; i++)
+            {
+                size_t len = i ? n + 1 : nNum;
+                size_t swap;
+
+                FN(linearCombination)(s, seqs[i][0], a, s, seqs[i][1], b, s, seqs[i][2], len);
+                FN(linearCombination)(s, seqs[i][0], c, s, seqs[i][1], d, s, seqs[i][3], len);
+                swap = seqs[i][0];
+                seqs[i][0] = seqs[i][2];
+                seqs[i][2] = swap;
+                swap = seqs[i][1];
+                seqs[i][1] = seqs[i][3];
+                seqs[i][3] = swap;
+            }
+        }
+    }
+
+    for (i = nNum; i < n; i++)
+    {
+        SETWORD(s, num[0] + i, 0);
+    }
+}
+
+
+SPECIFIER size_t FN(gcdExtendedScratchSize)(size_t nA, size_t nB)
+{
+    size_t n = nA > nB ? nA : nB;
+
+    /* 4 numbers, 2*4 cofactors, q and prod */
+    return 4*n + 8*(n + 1) + n + (n + 1);
+}
+
+
+SPECIFIER void FN(gcdExtendedScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *x,
+    BIGINT_TYPE *y,
+    BIGINT_TYPE *gcd,
+    BIGINT_TYPE *scratch
+)
+{
+    /* The numbers need n words, the cofactors are signed, and their magnitude is at most max(a, b). */
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA > nB ? nA : nB;
+    size_t m = n + 1;
+    size_t num[4], xs[4], ys[4];
+    size_t q = 4*n + 8*m;
+    size_t prod = q + n;
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        num[i] = i*n;
+        xs[i] = 4*n + i*m;
+        ys[i] = 4*n + 4*m + i*m;
+    }
+
+    /* a = 1*a + 0*b, b = 0*a + 1*b */
+    FN(copyRange)(scratch, num[0], n, a, 0, nA);
+    FN(copyRange)(scratch, num[1], n, b, 0, nB);
+    FN(copyRange)(scratch, xs[0], m, NULL, 0, 0);
+    FN(copyRange)(scratch, xs[1], m, NULL, 0, 0);
+    FN(copyRange)(scratch, ys[0], m, NULL, 0, 0);
+    FN(copyRange)(scratch, ys[1], m, NULL, 0, 0);
+    SETWORD(scratch, xs[0], 1);
+    SETWORD(scratch, ys[1], 1);
+
+    FN(gcdExtLehmerRange)(scratch, num, xs, ys, n, q, prod);
+
+    SETNWORDS(x, nB);
+    SETNWORDS(y, nA);
+    SETNWORDS(gcd, nB);
+    FN(copyRange)(gcd, 0, nB, scratch, num[0], n);
+    FN(copyRange)(x, 0, nB, scratch, xs[0], m);
+    FN(copyRange)(y, 0, nA, scratch, ys[0], m);
+}
+
+
+SPECIFIER size_t FN(modInverseScratchSize)(size_t nA, size_t nM)
+{
+    size_t n = nA > nM ? nA : nM;
+
+    /* 4 numbers, 4 cofactors, q and prod */
+    return 4*n + 4*(n + 1) + n + (n + 1);
+}
+
+
+SPECIFIER int FN(modInverseScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    /* Only the cofactors of a are tracked. */
+    size_t nA = GETNWORDS(a);
+    size_t nM = GETNWORDS(modulus);
+    size_t n = nA > nM ? nA : nM;
+    size_t m = n + 1;
+    size_t num[4], cofs[4];
+    size_t q = 4*n + 4*m;
+    size_t prod = q + n;
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        num[i] = i*n;
+        cofs[i] = 4*n + i*m;
+    }
+
+    /* modulus = 0*a + k*modulus, a = 1*a + 0*modulus */
+    FN(copyRange)(scratch, num[0], n, modulus, 0, nM);
+    FN(copyRange)(scratch, num[1], n, a, 0, nA);
+    FN(copyRange)(scratch, cofs[0], m, NULL, 0, 0);
+    FN(copyRange)(scratch, cofs[1], m, NULL, 0, 0);
+    SETWORD(scratch, cofs[1], 1);
+
+    FN(gcdExtLehmerRange)(scratch, num, cofs, NULL, n, q, prod);
+
+    SETNWORDS(result, nM);
+    ZERO_BIGINT(result);
+    if (!FN(isOneRange)(scratch, num[0], n))
+    {
+        return -1;
+    }
+
+    /* The cofactor is in (-modulus, modulus), make it positive. */
+    if (GETWORD(scratch, cofs[0] + n) >> (WORD_BITS - 1))
+    {
+        FN(copyRange)(scratch, num[1], n, modulus, 0, nM);
+        FN(addN)(scratch, cofs[0], scratch, cofs[0], scratch, num[1], n, 0);
+    }
+    FN(copyRange)(result, 0, nM, scratch, cofs[0], n);
+    if (!FN(lessThan)(result, modulus))
+    {
+        /* The modulus is 1, everything is 0. */
+        ZERO_BIGINT(result);
+    }
+
+    return 0;
+}
+
+
+/* Computes the Montgomery context: mInv and r2[r2Off .. r2Off + n). Uses montCtxScratchSize(n) words of scratch at sOff. */
+SPECIFIER void FN(montSetupRange)(
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE *mInv,
+    BIGINT_TYPE *r2, size_t r2Off,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    size_t n = GETNWORDS(modulus);
+    WORD_TYPE m0 = GETWORD(modulus, 0);
+    WORD_TYPE inv = m0; /* Correct to 3 bits for odd numbers. */
+    unsigned bits;
+
+    /* Newton iteration, each step doubles the number of correct bits. */
+    for (bits = 3; bits < WORD_BITS; bits *= 2)
+    {
+        inv = (WORD_TYPE)(inv * (2 - m0 * inv));
+    }
+    *mInv = (WORD_TYPE)0 - inv;
+
+    /* R^2 = 2^(2*WORD_BITS*n) */
+    FN(copyRange)(s, sOff, 2*n, NULL, 0, 0);
+    SETWORD(s, sOff + 2*n, 1);
+    FN(divModRange)(s, sOff, 2*n + 1, modulus, 0, n, NULL, 0, r2, r2Off);
+}
+
+
+SPECIFIER size_t FN(montCtxScratchSize)(size_t n)
+{
+    return 2*n + 1;
+}
+
+
+SPECIFIER void FN(montCtxInitScratch)(
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE *mInv,
+    BIGINT_TYPE *r2,
+    BIGINT_TYPE *scratch
+)
+{
+    SETNWORDS(r2, GETNWORDS(modulus));
+    FN(montSetupRange)(modulus, mInv, r2, 0, scratch, 0);
+}
+
+
+/* Computes the Barrett mu into mu[muOff .. muOff + k + 1). Uses barrettCtxScratchSize(n) words of scratch at sOff. */
+SPECIFIER void FN(barrettMuRange)(
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *mu, size_t muOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    size_t k = FN(barrettK)(modulus);
+    size_t power = sOff;
+    size_t quotient = power + 2*k + 1;
+    size_t remainder = quotient + 2*k + 1;
+    size_t i;
+    int overflow = 0;
+
+    /* b^2k */
+    FN(copyRange)(s, power, 2*k, NULL, 0, 0);
+    SETWORD(s, power + 2*k, 1);
+    FN(divModRange)(s, power, 2*k + 1, modulus, 0, GETNWORDS(modulus), s, quotient, s, remainder);
+
+    /* The quotient only overflows k + 1 words if the modulus is b^(k-1), then b^(k+1) - 1 is used, which is still good enough. */
+    for (i = k + 1; i < 2*k + 1; i++)
+    {
+        if (GETWORD(s, quotient + i)) overflow = 1;
+    }
+
+    for (i = 0; i <= k; i++)
+    {
+        SETWORD(mu, muOff + i, overflow ? (WORD_TYPE)~(WORD_TYPE)0 : GETWORD(s, quotient + i));
+    }
+}
+
+
+SPECIFIER size_t FN(barrettCtxScratchSize)(size_t n)
+{
+    /* b^2k, the quotient and the remainder */
+    return 2*(2*n + 1) + n;
+}
+
+
+SPECIFIER void FN(barrettCtxInitScratch)(
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *mu,
+    BIGINT_TYPE *scratch
+)
+{
+    SETNWORDS(mu, FN(barrettK)(modulus) + 1);
+    FN(barrettMuRange)(modulus, mu, 0, scratch, 0);
+}
+
+
+/* Returns the i-th bit of the number at off. */
+SPECIFIER int FN(getBit)(const BIGINT_TYPE *x, size_t off, size_t i)
+{
+    return (int)((GETWORD(x, off + i / WORD_BITS) >> (i % WORD_BITS)) & 1);
+}
+
+
+/* Modular multiplication for the exponentiations: Montgomery multiplication if mont is set, modMulRange otherwise.
+ * Uses barrettScratchSize(n) words of scratch at sOff. The output can overlap with the inputs. */
+SPECIFIER void FN(fixedWindowMulRange)(
+    const BIGINT_TYPE *a, size_t aOff,
+    const BIGINT_TYPE *b, size_t bOff,
+    const BIGINT_TYPE *modulus,
+    int mont,
+    WORD_TYPE mInv,
+    const BIGINT_TYPE *mu, size_t muOff,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    size_t n = GETNWORDS(modulus);
+
+    if (mont)
+    {
+        FN(montMulRange)(a, aOff, b, bOff, modulus, mInv, s, sOff);
+        FN(copyRange)(r, rOff, n, s, sOff, n);
+    }
+    else
+    {
+        FN(modMulRange)(a, aOff, b, bOff, modulus, mu, muOff, r, rOff, s, sOff);
+    }
+}
+
+
+/* r[rOff .. rOff + n) = base^exponent mod modulo, where the base and the exponent are the given ranges and n is the number of
+ * words in the modulo. The multiplications are done by fixedWindowMulRange with the context at ctxOff: R^2 mod modulo if mont
+ * is set, otherwise the Barrett mu (ctx is NULL for zero modulo). The context is only read, so it can be shared between threads.
+ * Uses slidingWindowScratchSize(n) words of scratch at sOff. The output must not overlap with the inputs. */
+SPECIFIER void FN(slidingWindowRange)(
+    const BIGINT_TYPE *base, size_t baseOff, size_t baseLen,
+    const BIGINT_TYPE *exponent, size_t expOff, size_t expLen,
+    const BIGINT_TYPE *modulo,
+    int mont,
+    WORD_TYPE mInv,
+    const BIGINT_TYPE *ctx, size_t ctxOff,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    /*
+        Left to right sliding window exponentiation. The odd powers base^1, base^3 ... base^(2^MODPOW_WINDOW - 1) are
+        precomputed into a table. Then the exponent is scanned from the top: a zero bit costs a squaring, otherwise a window
+        of at most MODPOW_WINDOW bits is taken which ends in a 1 bit. That costs a squaring for each bit and a single
+        multiplication by the table entry.
+
+        Scratch layout: the table, then the space for the modular multiplications.
+    */
+    size_t nMod = GETNWORDS(modulo);
+    size_t tableSize = (size_t)1 << (MODPOW_WINDOW - 1);
+    size_t table = sOff;
+    size_t mulOff = table + tableSize * nMod;
+    size_t bit, i;
+    int started = 0;
+
+    /* table[i] = base^(2i + 1), meanwhile the square of the base is kept in r. */
+    if (mont)
+    {
+        FN(divModRange)(base, baseOff, baseLen, modulo, 0, nMod, NULL, 0, r, rOff);
+        FN(montMulRange)(r, rOff, ctx, ctxOff, modulo, mInv, s, table);
+    }
+    else
+    {
+        FN(divModRange)(base, baseOff, baseLen, modulo, 0, nMod, NULL, 0, s, table);
+    }
+    FN(fixedWindowMulRange)(s, table, s, table, modulo, mont, mInv, ctx, ctxOff, r, rOff, s, mulOff);
+    for (i = 1; i < tableSize; i++)
+    {
+        FN(fixedWindowMulRange)(
+            s, table + (i - 1)*nMod, r, rOff, modulo, mont, mInv, ctx, ctxOff, s, table + i*nMod, s, mulOff
+        );
+    }
+
+    /* The result stays 1 for zero exponent. In Montgomery form that's R mod modulo. */
+    if (mont)
+    {
+        FN(montMulRange)(ctx, ctxOff, NULL, 0, modulo, mInv, r, rOff);
+    }
+    else
+    {
+        for (i = 0; i < nMod; i++)
+        {
+            SETWORD(r, rOff + i, (WORD_TYPE)(i == 0));
+        }
+    }
+
+    bit = expLen * WORD_BITS;
+    while (bit > 0)
+    {
+        size_t low, width;
+        size_t value = 0;
+
+        if (!FN(getBit)(exponent, expOff, bit - 1))
+        {
+            if (started)
+            {
+                FN(fixedWindowMulRange)(r, rOff, r, rOff, modulo, mont, mInv, ctx, ctxOff, r, rOff, s, mulOff);
+            }
+            bit--;
+            continue;
+        }
+
+        /* The window is the bits in [low, bit). */
+        low = bit > MODPOW_WINDOW ? bit - MODPOW_WINDOW : 0;
+        while (!FN(getBit)(exponent, expOff, low)) low++;
+        width = bit - low;
+
+        for (i = bit; i --> low;)
+        {
+            value = (value << 1) | (size_t)FN(getBit)(exponent, expOff, i);
+        }
+
+        if (started)
+        {
+            for (i = 0; i < width; i++)
+            {
+                FN(fixedWindowMulRange)(r, rOff, r, rOff, modulo, mont, mInv, ctx, ctxOff, r, rOff, s, mulOff);
+            }
+            FN(fixedWindowMulRange)(
+                r, rOff, s, table + (value >> 1)*nMod, modulo, mont, mInv, ctx, ctxOff, r, rOff, s, mulOff
+            );
+        }
+        else
+        {
+            /* Nothing to square yet. */
+            FN(copyRange)(r, rOff, nMod, s, table + (value >> 1)*nMod, nMod);
+            started = 1;
+        }
+        bit = low;
+    }
+
+    if (mont)
+    {
+        FN(montMulRange)(r, rOff, NULL, 0, modulo, mInv, s, mulOff);
+        FN(copyRange)(r, rOff, nMod, s, mulOff, nMod);
+    }
+}
+
+
+SPECIFIER size_t FN(slidingWindowScratchSize)(size_t nMod)
+{
+    return ((size_t)1 << (MODPOW_WINDOW - 1)) * nMod + FN(barrettScratchSize)(nMod);
+}
+
+
+/* r[rOff .. rOff + n) = base^exponent mod modulo, where the exponent is the expLen word range at expOff and n is the number of
+ * words in the modulo. Uses modPowScratchSize(n) words of scratch at sOff. The output must not overlap with the inputs. */
+SPECIFIER void FN(modPowRange)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent, size_t expOff, size_t expLen,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *r, size_t rOff,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    /* Scratch layout: mu, then the space for the sliding window exponentiation. */
+    size_t muOff = sOff;
+    size_t windowOff = muOff + GETNWORDS(modulo) + 1;
+    const BIGINT_TYPE *mu = NULL;
+
+    /* The modulus is the same all the time, so the products are reduced by Barrett reduction.
+     * The zero modulus is treated like divMod does: the numbers are just truncated to its size. */
+    if (!FN(isZero)(modulo))
+    {
+        /* The window scratch is not used yet, it's fine as a temporary. */
+        FN(barrettMuRange)(modulo, s, muOff, s, windowOff);
+        mu = s;
+    }
+
+    FN(slidingWindowRange)(base, 0, GETNWORDS(base), exponent, expOff, expLen, modulo, 0, 0, mu, muOff, r, rOff, s, windowOff);
+}
+
+
+SPECIFIER size_t FN(modPowScratchSize)(size_t nMod)
+{
+    return (nMod + 1) + FN(slidingWindowScratchSize)(nMod);
+}
+
+
+SPECIFIER int FN(modPowScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    SETNWORDS(result, GETNWORDS(modulo));
+    FN(modPowRange)(base, exponent, 0, GETNWORDS(exponent), modulo, result, 0, scratch, 0);
+
+    return 0;
+}
+
+
+SPECIFIER size_t FN(modPowMontScratchSize)(size_t nMod)
+{
+    /* r2, the base, the accumulator, a temporary, then 2n + 1 for the context setup. The even modulo falls back to modPowScratch. */
+    size_t montSize = 6*nMod + 1;
+    size_t fallbackSize = FN(modPowScratchSize)(nMod);
+
+    return montSize > fallbackSize ? montSize : fallbackSize;
+}
+
+
+SPECIFIER int FN(modPowMontScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    size_t n = GETNWORDS(modulo);
+    size_t r2 = 0;
+    size_t montBase = n;
+    size_t acc = 2*n;
+    size_t other = 3*n;
+    size_t nExp = GETNWORDS(exponent);
+    WORD_TYPE mInv;
+    int canStart = 0;
+
+    if (!(GETWORD(modulo, 0) & 1))
+    {
+        return FN(modPowScratch)(base, exponent, modulo, result, scratch);
+    }
+
+    SETNWORDS(result, n);
+    FN(montSetupRange)(modulo, &mInv, scratch, r2, scratch, 4*n);
+
+    /* Convert the reduced base to Montgomery form. */
+    FN(divModRange)(base, 0, GETNWORDS(base), modulo, 0, n, NULL, 0, scratch, other);
+    FN(montMulRange)(scratch, other, scratch, r2, modulo, mInv, scratch, montBase);
+
+    /* 1 in Montgomery form is R mod modulo. */
+    FN(montMulRange)(scratch, r2, NULL, 0, modulo, mInv, scratch, acc);
+
+    while (nExp --> 0)
+    {
+        size_t m = WORD_BITS;
+        WORD_TYPE expWord = GETWORD(exponent, nExp);
+
+        while (m --> 0)
+        {
+            size_t swap;
+            int bit = (int)((expWord >> m) & 1);
+
+            if (bit) canStart = 1;
+            if (!canStart) continue;
+
+            FN(montMulRange)(scratch, acc, scratch, acc, modulo, mInv, scratch, other);
+            swap = acc; acc = other; other = swap;
+
+            if (bit)
+            {
+                FN(montMulRange)(scratch, acc, scratch, montBase, modulo, mInv, scratch, other);
+                swap = acc; acc = other; other = swap;
+            }
+        }
+    }
+
+    FN(montMulRange)(scratch, acc, NULL, 0, modulo, mInv, result, 0);
+
+    return 0;
+}
+
+
+SPECIFIER size_t FN(modPowFixedWindowScratchSize)(size_t nMod)
+{
+    /* The context (r2 or mu), the table, the accumulator, the selected entry and the multiplications. */
+    return (nMod + 1) + (((size_t)1 << MODPOW_FIXED_WINDOW) + 2) * nMod + FN(barrettScratchSize)(nMod);
+}
+
+
+SPECIFIER int FN(modPowFixedWindowScratch)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    /*
+        Fixed window exponentiation. The table holds base^0 ... base^(2^MODPOW_FIXED_WINDOW - 1).
+        The exponent is split into windows of MODPOW_FIXED_WINDOW bits from the top, each one costs the same number of squarings
+        and a multiplication by the table entry, even if the window is zero. The table entry is selected by reading through the
+        whole table with masks.
+
+        For odd modulus the numbers are kept in Montgomery form, otherwise Barrett reduction is used.
+
+        Scratch layout: the context, the table, the accumulator, the selected table entry, then the space for the multiplications.
+    */
+    size_t nMod = GETNWORDS(modulo);
+    size_t tableSize = (size_t)1 << MODPOW_FIXED_WINDOW;
+    size_t ctx = 0;
+    size_t table = nMod + 1;
+    size_t acc = table + tableSize * nMod;
+    size_t sel = acc + nMod;
+    size_t mulOff = sel + nMod;
+    size_t nBits = GETNWORDS(exponent) * WORD_BITS;
+    size_t window = (nBits + MODPOW_FIXED_WINDOW - 1) / MODPOW_FIXED_WINDOW;
+    size_t i, j;
+    int mont = (int)(GETWORD(modulo, 0) & 1);
+    WORD_TYPE mInv = 0;
+    const BIGINT_TYPE *mu = NULL;
+
+    SETNWORDS(result, nMod);
+    FN(divModRange)(base, 0, GETNWORDS(base), modulo, 0, nMod, NULL, 0, result, 0);
+
+    /* The table is not filled yet, the context setup can use it as a temporary. */
+    if (mont)
+    {
+        /* table[0] = R mod m, table[1] = base*R mod m */
+        FN(montSetupRange)(modulo, &mInv, scratch, ctx, scratch, table);
+        FN(montMulRange)(scratch, ctx, NULL, 0, modulo, mInv, scratch, table);
+        FN(montMulRange)(result, 0, scratch, ctx, modulo, mInv, scratch, table + nMod);
+    }
+    else
+    {
+        /* The zero modulus is treated like divMod does: the numbers are just truncated to its size. */
+        if (!FN(isZero)(modulo))
+        {
+            FN(barrettMuRange)(modulo, scratch, ctx, scratch, table);
+            mu = scratch;
+        }
+
+        /* table[0] = 1 mod m, table[1] = base mod m */
+        for (i = 0; i < nMod; i++)
+        {
+            SETWORD(scratch, table + i, (WORD_TYPE)(i == 0));
+        }
+        FN(modMulRange)(scratch, table, scratch, table, modulo, mu, ctx, scratch, table, scratch, mulOff);
+        FN(copyRange)(scratch, table + nMod, nMod, result, 0, nMod);
+    }
+
+    for (i = 2; i < tableSize; i++)
+    {
+        FN(fixedWindowMulRange)(
+            scratch, table + (i - 1)*nMod, scratch, table + nMod, modulo, mont, mInv, mu, ctx, scratch, table + i*nMod, scratch, mulOff
+        );
+    }
+
+    FN(copyRange)(scratch, acc, nMod, scratch, table, nMod);
+
+    /* The top window is a partial one, if the number of bits is not divisible by the window size. */
+    while (window --> 0)
+    {
+        size_t bit = window * MODPOW_FIXED_WINDOW;
+        size_t value = 0;
+
+        for (i = 0; i < MODPOW_FIXED_WINDOW; i++)
+        {
+            FN(fixedWindowMulRange)(scratch, acc, scratch, acc, modulo, mont, mInv, mu, ctx, scratch, acc, scratch, mulOff);
+        }
+
+        for (i = bit + MODPOW_FIXED_WINDOW; i --> bit;)
+        {
+            value = (value << 1) | (size_t)(i < nBits ? FN(getBit)(exponent, 0, i) : 0);
+        }
+
+        /* Read the whole table, keep only the needed entry. */
+        for (i = 0; i < nMod; i++)
+        {
+            SETWORD(scratch, sel + i, 0);
+        }
+        for (j = 0; j < tableSize; j++)
+        {
+            WORD_TYPE mask = (WORD_TYPE)0 - (WORD_TYPE)(j == value);
+
+            for (i = 0; i < nMod; i++)
+            {
+                SETWORD(scratch, sel + i, GETWORD(scratch, sel + i) | (GETWORD(scratch, table + j*nMod + i) & mask));
+            }
+        }
+
+        FN(fixedWindowMulRange)(scratch, acc, scratch, sel, modulo, mont, mInv, mu, ctx, scratch, acc, scratch, mulOff);
+    }
+
+    if (mont)
+    {
+        FN(montMulRange)(scratch, acc, NULL, 0, modulo, mInv, result, 0);
+    }
+    else
+    {
+        FN(copyRange)(result, 0, nMod, scratch, acc, nMod);
+    }
+
+    return 0;
+}
+
+
+/* The work of a modPowBatch thread: the exponentiations first, first + step, first + 2*step ... */
+typedef struct
+{
+    const BIGINT_TYPE *bases;
+    const BIGINT_TYPE *exponents;
+    const BIGINT_TYPE *modulo;
+    BIGINT_TYPE *results;
+    size_t n;
+    size_t first;
+    size_t step;
+    int mont;
+    WORD_TYPE mInv;
+    const BIGINT_TYPE *ctx;
+    BIGINT_TYPE *scratch;
+    size_t sOff;
+} FN(ModPowBatchJob);
+
+
+SPECIFIER void FN(modPowBatchRun)(FN(ModPowBatchJob) *job)
+{
+    size_t i;
+
+    for (i = job->first; i < job->n; i += job->step)
+    {
+        const BIGINT_TYPE *exponent = &job->exponents[i];
+
+        SETNWORDS(&job->results[i], GETNWORDS(job->modulo));
+        FN(slidingWindowRange)(
+            &job->bases[i], 0, GETNWORDS(&job->bases[i]), exponent, 0, GETNWORDS(exponent), job->modulo, job->mont, job->mInv, job->ctx, 0,
+            &job->results[i], 0, job->scratch, job->sOff
+        );
+    }
+}
+
+
+#ifdef THREAD_TYPE
+
+SPECIFIER THREAD_ENTRY(FN(modPowBatchThread), arg)
+{
+    FN(modPowBatchRun)((FN(ModPowBatchJob)*)arg);
+    THREAD_RETURN;
+}
+
+#endif
+
+
+/* Returns the number of threads modPowBatch and nextPrime actually use for the requested count. */
+SPECIFIER size_t FN(threadsToUse)(size_t threadCount)
+{
+#ifdef THREAD_TYPE
+    if (threadCount > MODPOW_BATCH_MAX_THREADS) threadCount = MODPOW_BATCH_MAX_THREADS;
+    return threadCount ? threadCount : 1;
+#else
+    (void)threadCount;
+    return 1;
+#endif
+}
+
+
+SPECIFIER size_t FN(modPowBatchScratchSize)(size_t nMod, size_t threadCount)
+{
+    /* The shared context (r2 or mu), then the sliding window scratch of each thread. */
+    return (nMod + 1) + FN(threadsToUse)(threadCount) * FN(slidingWindowScratchSize)(nMod);
+}
+
+
+SPECIFIER int FN(modPowBatchScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *results,
+    size_t n,
+    size_t threadCount,
+    BIGINT_TYPE *scratch
+)
+{
+    size_t nMod = GETNWORDS(modulo);
+    size_t threads = FN(threadsToUse)(threadCount);
+    size_t ctx = 0;
+    size_t threadScratch = nMod + 1;
+    size_t t;
+    FN(ModPowBatchJob) jobs[MODPOW_BATCH_MAX_THREADS];
+#ifdef THREAD_TYPE
+    THREAD_TYPE handles[MODPOW_BATCH_MAX_THREADS];
+    int running[MODPOW_BATCH_MAX_THREADS];
+#endif
+
+    if (threads > n) threads = n;
+    if (!threads) return 0;
+
+    jobs[0].bases = bases;
+    jobs[0].exponents = exponents;
+    jobs[0].modulo = modulo;
+    jobs[0].results = results;
+    jobs[0].n = n;
+    jobs[0].first = 0;
+    jobs[0].step = threads;
+    jobs[0].mont = (int)(GETWORD(modulo, 0) & 1);
+    jobs[0].mInv = 0;
+    jobs[0].ctx = NULL;
+    jobs[0].scratch = scratch;
+    jobs[0].sOff = threadScratch;
+
+    /* The context is computed once, the scratch of the threads is not used yet, so it's fine as a temporary. */
+    if (jobs[0].mont)
+    {
+        FN(montSetupRange)(modulo, &jobs[0].mInv, scratch, ctx, scratch, threadScratch);
+        jobs[0].ctx = scratch;
+    }
+    else if (!FN(isZero)(modulo))
+    {
+        FN(barrettMuRange)(modulo, scratch, ctx, scratch, threadScratch);
+        jobs[0].ctx = scratch;
+    }
+
+    for (t = 1; t < threads; t++)
+    {
+        jobs[t] = jobs[0];
+        jobs[t].first = t;
+        jobs[t].sOff = threadScratch + t * FN(slidingWindowScratchSize)(nMod);
+    }
+
+#ifdef THREAD_TYPE
+    /* The calling thread does the first part. If a thread can't be started, its part is done by the calling thread too. */
+    for (t = 1; t < threads; t++)
+    {
+        running[t] = THREAD_START(handles[t], FN(modPowBatchThread), &jobs[t]) == 0;
+    }
+    FN(modPowBatchRun)(&jobs[0]);
+    for (t = 1; t < threads; t++)
+    {
+        if (running[t])
+        {
+            THREAD_JOIN(handles[t]);
+        }
+        else
+        {
+            FN(modPowBatchRun)(&jobs[t]);
+        }
+    }
+#else
+    FN(modPowBatchRun)(&jobs[0]);
+#endif
+
+    return 0;
+}
+
+
+SPECIFIER size_t FN(multiModPowScratchSize)(size_t nMod, size_t k)
+{
+    /* The context (r2 or mu), the tables, the accumulator and the multiplications. */
+    return (nMod + 1) + k * (((size_t)1 << MULTIMODPOW_WINDOW) - 1) * nMod + nMod + FN(barrettScratchSize)(nMod);
+}
+
+
+SPECIFIER int FN(multiModPowScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    size_t k,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *scratch
+)
+{
+    /*
+        Straus' method. Each base has a table of its powers base^1 ... base^(2^MULTIMODPOW_WINDOW - 1).
+        The exponents are split into windows of MULTIMODPOW_WINDOW bits from the top, all of them at the same positions.
+        For each window the accumulator is squared MULTIMODPOW_WINDOW times, then multiplied by the table entry of each base
+        whose window is not zero.
+
+        Scratch layout: the context, the tables, the accumulator, then the space for the multiplications.
+    */
+    size_t nMod = GETNWORDS(modulo);
+    size_t entries = ((size_t)1 << MULTIMODPOW_WINDOW) - 1;
+    size_t ctx = 0;
+    size_t table = nMod + 1;
+    size_t acc = table + k * entries * nMod;
+    size_t mulOff = acc + nMod;
+    size_t nBits = 0;
+    size_t window, i, j;
+    int mont = (int)(GETWORD(modulo, 0) & 1);
+    int started = 0;
+    WORD_TYPE mInv = 0;
+    const BIGINT_TYPE *mu = NULL;
+
+    SETNWORDS(result, nMod);
+
+    /* The tables are not filled yet, the context setup can use them as a temporary. */
+    if (mont)
+    {
+        FN(montSetupRange)(modulo, &mInv, scratch, ctx, scratch, table);
+    }
+    else if (!FN(isZero)(modulo))
+    {
+        /* The zero modulus is treated like divMod does: the numbers are just truncated to its size. */
+        FN(barrettMuRange)(modulo, scratch, ctx, scratch, table);
+        mu = scratch;
+    }
+
+    for (i = 0; i < k; i++)
+    {
+        size_t t = table + i * entries * nMod;
+        size_t nExpBits = GETNWORDS(&exponents[i]) * WORD_BITS;
+
+        if (nExpBits > nBits) nBits = nExpBits;
+
+        if (mont)
+        {
+            FN(divModRange)(&bases[i], 0, GETNWORDS(&bases[i]), modulo, 0, nMod, NULL, 0, result, 0);
+            FN(montMulRange)(result, 0, scratch, ctx, modulo, mInv, scratch, t);
+        }
+        else
+        {
+            FN(divModRange)(&bases[i], 0, GETNWORDS(&bases[i]), modulo, 0, nMod, NULL, 0, scratch, t);
+        }
+        for (j = 1; j < entries; j++)
+        {
+            FN(fixedWindowMulRange)(
+                scratch, t + (j - 1)*nMod, scratch, t, modulo, mont, mInv, mu, ctx, scratch, t + j*nMod, scratch, mulOff
+            );
+        }
+    }
+
+    /* The result is 1 until the first nonzero window. In Montgomery form that's R mod modulo. */
+    if (mont)
+    {
+        FN(montMulRange)(scratch, ctx, NULL, 0, modulo, mInv, scratch, acc);
+    }
+    else
+    {
+        for (i = 0; i < nMod; i++)
+        {
+            SETWORD(scratch, acc + i, (WORD_TYPE)(i == 0));
+        }
+    }
+
+    window = (nBits + MULTIMODPOW_WINDOW - 1) / MULTIMODPOW_WINDOW;
+    while (window --> 0)
+    {
+        size_t bit = window * MULTIMODPOW_WINDOW;
+
+        if (started)
+        {
+            for (i = 0; i < MULTIMODPOW_WINDOW; i++)
+            {
+                FN(fixedWindowMulRange)(scratch, acc, scratch, acc, modulo, mont, mInv, mu, ctx, scratch, acc, scratch, mulOff);
+            }
+        }
+
+        for (i = 0; i < k; i++)
+        {
+            size_t nExpBits = GETNWORDS(&exponents[i]) * WORD_BITS;
+            size_t value = 0;
+            size_t entry;
+
+            for (j = bit + MULTIMODPOW_WINDOW; j --> bit;)
+            {
+                value = (value << 1) | (size_t)(j < nExpBits ? FN(getBit)(&exponents[i], 0, j) : 0);
+            }
+            if (!value) continue;
+
+            entry = table + (i * entries + value - 1) * nMod;
+            if (started)
+            {
+                FN(fixedWindowMulRange)(scratch, acc, scratch, entry, modulo, mont, mInv, mu, ctx, scratch, acc, scratch, mulOff);
+            }
+            else
+            {
+                /* Nothing to multiply yet. */
+                FN(copyRange)(scratch, acc, nMod, scratch, entry, nMod);
+                started = 1;
+            }
+        }
+    }
+
+    if (mont)
+    {
+        FN(montMulRange)(scratch, acc, NULL, 0, modulo, mInv, result, 0);
+    }
+    else
+    {
+        FN(copyRange)(result, 0, nMod, scratch, acc, nMod);
+    }
+
+    return 0;
+}
+
+
+#if USE_SIMD
+
+/*
+ * The vector engine of modPowLanes. The MODPOW_LANES numbers are stored interleaved in radix 2^LANE_LIMB_BITS: limb j of lane l
+ * is the 64 bit element j*MODPOW_LANES + l of an array of vectors, so a vector holds the same limb of all numbers.
+ * The products of 26 bit limbs have 52 bits, so the 64 bit elements can accumulate many of them without propagating the carries.
+ * The arrays are in the scratch bigint, they are accessed by unaligned loads and stores.
+ */
+
+#define LANE_LIMB_BITS 26
+#define LANE_LIMB_MASK (((WORD_TYPE)1 << LANE_LIMB_BITS) - 1)
+/* The number of words in a vector. */
+#define LANE_VECTOR_WORDS (256 / WORD_BITS)
+/* A Montgomery multiplication accumulates 2*limbs products into an element, that must fit into 64 bits. */
+#define LANE_MAX_LIMBS 2000
+#define LANE_LOAD(v, j) _mm256_loadu_si256((const __m256i *)((v) + (j) * LANE_VECTOR_WORDS))
+#define LANE_STORE(v, j, x) _mm256_storeu_si256((__m256i *)((v) + (j) * LANE_VECTOR_WORDS), (x))
+
+/* Returns the number of limbs for an n word modulus. R = 2^(LANE_LIMB_BITS*limbs) is larger than twice the modulus. */
+SPECIFIER size_t FN(laneLimbs)(size_t n)
+{
+    return (n * WORD_BITS + 1 + LANE_LIMB_BITS - 1) / LANE_LIMB_BITS;
+}
+
+
+/* Sets limb j of lane l in the vector array v. */
+SPECIFIER void FN(laneSet)(WORD_TYPE *v, size_t j, size_t l, WORD_TYPE limb)
+{
+    size_t i = (j * MODPOW_LANES + l) * (64 / WORD_BITS);
+
+    v[i] = limb;
+#if WORD_BITS == 32
+    v[i + 1] = 0;
+#endif
+}
+
+
+/* Returns limb j of lane l in the vector array v. The limb must be normalized, so it fits into a word. */
+SPECIFIER WORD_TYPE FN(laneGet)(const WORD_TYPE *v, size_t j, size_t l)
+{
+    return v[(j * MODPOW_LANES + l) * (64 / WORD_BITS)];
+}
+
+
+/* Puts the n word range at xOff into lane l of the vector array v of limbs limbs. */
+SPECIFIER void FN(laneFromRange)(WORD_TYPE *v, size_t l, size_t limbs, const BIGINT_TYPE *x, size_t xOff, size_t n)
+{
+    size_t j;
+
+    for (j = 0; j < limbs; j++)
+    {
+        size_t bit = j * LANE_LIMB_BITS;
+        size_t w = bit / WORD_BITS;
+        unsigned shift = (unsigned)(bit % WORD_BITS);
+        WORD_TYPE limb = 0;
+
+        if (w < n)
+        {
+            limb = GETWORD(x, xOff + w) >> shift;
+            if (shift + LANE_LIMB_BITS > WORD_BITS && w + 1 < n)
+            {
+                limb |= GETWORD(x, xOff + w + 1) << (WORD_BITS - shift);
+            }
+        }
+        FN(laneSet)(v, j, l, limb & LANE_LIMB_MASK);
+    }
+}
+
+
+/* Stores lane l of the vector array v of limbs limbs into the n word range at xOff. The number must fit. */
+SPECIFIER void FN(laneToRange)(const WORD_TYPE *v, size_t l, size_t limbs, BIGINT_TYPE *x, size_t xOff, size_t n)
+{
+    size_t i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        SETWORD(x, xOff + i, 0);
+    }
+    for (j = 0; j < limbs; j++)
+    {
+        WORD_TYPE limb = FN(laneGet)(v, j, l);
+        size_t bit = j * LANE_LIMB_BITS;
+        size_t w = bit / WORD_BITS;
+        unsigned shift = (unsigned)(bit % WORD_BITS);
+
+        if (w < n)
+        {
+            SETWORD(x, xOff + w, GETWORD(x, xOff + w) | (limb << shift));
+        }
+        if (shift + LANE_LIMB_BITS > WORD_BITS && w + 1 < n)
+        {
+            SETWORD(x, xOff + w + 1, GETWORD(x, xOff + w + 1) | (limb >> (WORD_BITS - shift)));
+        }
+    }
+}
+
+
+/* Montgomery multiplication in all lanes: r = a*b/R mod m. The inputs must be normalized and less than m, so is the result.
+ * t is a temporary of 2*limbs vectors. r can be the same as a or b. */
+SPECIFIER SIMD_AVX2 void FN(laneMontMulAvx2)(
+    WORD_TYPE *r,
+    const WORD_TYPE *a,
+    const WORD_TYPE *b,
+    const WORD_TYPE *m,
+    const WORD_TYPE *mInv,
+    WORD_TYPE *t,
+    size_t limbs
+)
+{
+    __m256i mask = _mm256_set1_epi64x(LANE_LIMB_MASK);
+    __m256i bias = _mm256_set1_epi64x((WORD_TYPE)1 << LANE_LIMB_BITS);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i inv = LANE_LOAD(mInv, 0);
+    __m256i carry, borrow, keep;
+    size_t i, j;
+
+    for (i = 0; i < 2*limbs; i++)
+    {
+        LANE_STORE(t, i, zero);
+    }
+
+    /* Operand scanning, the low limb of the partial result is cleared by q*m in each step, then its carry is moved up. */
+    for (i = 0; i < limbs; i++)
+    {
+        __m256i ai = LANE_LOAD(a, i);
+        __m256i low = _mm256_add_epi64(LANE_LOAD(t, i), _mm256_mul_epu32(ai, LANE_LOAD(b, 0)));
+        __m256i q = _mm256_and_si256(_mm256_mul_epu32(low, inv), mask);
+
+        low = _mm256_add_epi64(low, _mm256_mul_epu32(q, LANE_LOAD(m, 0)));
+        LANE_STORE(t, i + 1, _mm256_add_epi64(LANE_LOAD(t, i + 1), _mm256_srli_epi64(low, LANE_LIMB_BITS)));
+        for (j = 1; j < limbs; j++)
+        {
+            __m256i x = _mm256_add_epi64(LANE_LOAD(t, i + j), _mm256_mul_epu32(ai, LANE_LOAD(b, j)));
+
+            LANE_STORE(t, i + j, _mm256_add_epi64(x, _mm256_mul_epu32(q, LANE_LOAD(m, j))));
+        }
+    }
+
+    /* The result is in the upper half, less than 2m < R. Normalize it. */
+    carry = zero;
+    for (j = 0; j < limbs; j++)
+    {
+        __m256i x = _mm256_add_epi64(LANE_LOAD(t, limbs + j), carry);
+
+        carry = _mm256_srli_epi64(x, LANE_LIMB_BITS);
+        LANE_STORE(t, limbs + j, _mm256_and_si256(x, mask));
+    }
+
+    /* Subtract m, keep the difference in the lanes where there is no borrow. */
+    borrow = zero;
+    for (j = 0; j < limbs; j++)
+    {
+        __m256i x = _mm256_sub_epi64(_mm256_add_epi64(LANE_LOAD(t, limbs + j), bias), _mm256_add_epi64(LANE_LOAD(m, j), borrow));
+
+        borrow = _mm256_xor_si256(_mm256_srli_epi64(x, LANE_LIMB_BITS), one);
+        LANE_STORE(r, j, _mm256_and_si256(x, mask));
+    }
+    keep = _mm256_cmpeq_epi64(borrow, zero);
+    for (j = 0; j < limbs; j++)
+    {
+        LANE_STORE(r, j, _mm256_blendv_epi8(LANE_LOAD(t, limbs + j), LANE_LOAD(r, j), keep));
+    }
+}
+
+
+/* r = table[digits[l]] in each lane l. Reads the whole table, so the access pattern doesn't depend on the digits. */
+SPECIFIER SIMD_AVX2 void FN(laneSelectAvx2)(WORD_TYPE *r, const WORD_TYPE *table, size_t entries, size_t limbs, const size_t *digits)
+{
+    __m256i index = _mm256_set_epi64x(digits[3], digits[2], digits[1], digits[0]);
+    size_t e, j;
+
+    for (j = 0; j < limbs; j++)
+    {
+        LANE_STORE(r, j, _mm256_setzero_si256());
+    }
+    for (e = 0; e < entries; e++)
+    {
+        __m256i mask = _mm256_cmpeq_epi64(index, _mm256_set1_epi64x(e));
+
+        for (j = 0; j < limbs; j++)
+        {
+            LANE_STORE(r, j, _mm256_or_si256(LANE_LOAD(r, j), _mm256_and_si256(LANE_LOAD(table, e*limbs + j), mask)));
+        }
+    }
+}
+
+#endif
+
+
+SPECIFIER size_t FN(modPowLanesScratchSize)(size_t nMod)
+{
+    size_t fallbackSize = FN(modPowScratchSize)(nMod);
+#if USE_SIMD
+    /* The moduli, mInv, R^2, the table, the accumulator, the selected entry and the product. */
+    size_t limbs = FN(laneLimbs)(nMod);
+    size_t laneSize = ((((size_t)1 << MODPOW_LANES_WINDOW) + 6) * limbs + 1) * LANE_VECTOR_WORDS;
+
+    return laneSize > fallbackSize ? laneSize : fallbackSize;
+#else
+    return fallbackSize;
+#endif
+}
+
+
+SPECIFIER int FN(modPowLanesScratch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *moduli,
+    BIGINT_TYPE *results,
+    BIGINT_TYPE *scratch
+)
+{
+    /*
+        Fixed window exponentiation in Montgomery form, like modPowFixedWindow, in the vector lanes. The numbers are converted
+        into the interleaved radix 2^26 form, the exponentiations are done together, then the results are converted back.
+        The lanes do the same squarings, the shorter exponents are padded by zeros.
+
+        Scratch layout: the moduli, mInv, R^2, the table, the accumulator, the selected entry, the product.
+        During the setup the table is used as a bigint temporary.
+    */
+    size_t nMod = GETNWORDS(&moduli[0]);
+    size_t l;
+#if USE_SIMD
+    size_t limbs = FN(laneLimbs)(nMod);
+    size_t entries = (size_t)1 << MODPOW_LANES_WINDOW;
+    int useLanes = limbs <= LANE_MAX_LIMBS && __builtin_cpu_supports("avx2");
+
+    for (l = 0; l < MODPOW_LANES; l++)
+    {
+        if (!(GETWORD(&moduli[l], 0) & 1)) useLanes = 0;
+    }
+
+    if (useLanes)
+    {
+        WORD_TYPE *m = WORD_PTR(scratch);
+        WORD_TYPE *mInv = m + limbs * LANE_VECTOR_WORDS;
+        WORD_TYPE *r2 = mInv + LANE_VECTOR_WORDS;
+        WORD_TYPE *table = r2 + limbs * LANE_VECTOR_WORDS;
+        WORD_TYPE *acc = table + entries * limbs * LANE_VECTOR_WORDS;
+        WORD_TYPE *sel = acc + limbs * LANE_VECTOR_WORDS;
+        WORD_TYPE *t = sel + limbs * LANE_VECTOR_WORDS;
+        size_t tmp = (size_t)(table - m);
+        size_t nR = (2 * limbs * LANE_LIMB_BITS) / WORD_BITS + 1;
+        size_t digits[MODPOW_LANES];
+        size_t nBits = 0;
+        size_t window, e, i, j;
+        int started = 0;
+
+        for (l = 0; l < MODPOW_LANES; l++)
+        {
+            WORD_TYPE m0 = GETWORD(&moduli[l], 0) & LANE_LIMB_MASK;
+            WORD_TYPE inv = m0; /* Correct to 3 bits for odd numbers. */
+            unsigned bits;
+            size_t nExpBits = GETNWORDS(&exponents[l]) * WORD_BITS;
+
+            if (nExpBits > nBits) nBits = nExpBits;
+
+            /* -m^-1 mod 2^LANE_LIMB_BITS by Newton iteration. */
+            for (bits = 3; bits < LANE_LIMB_BITS; bits *= 2)
+            {
+                inv = (inv * (2 - m0 * inv)) & LANE_LIMB_MASK;
+            }
+            FN(laneSet)(mInv, 0, l, ((WORD_TYPE)0 - inv) & LANE_LIMB_MASK);
+            FN(laneFromRange)(m, l, limbs, &moduli[l], 0, nMod);
+
+            /* R^2 = 2^(2*LANE_LIMB_BITS*limbs) mod m */
+            FN(copyRange)(scratch, tmp, nR, NULL, 0, 0);
+            SETWORD(scratch, tmp + (2 * limbs * LANE_LIMB_BITS) / WORD_BITS, (WORD_TYPE)1 << ((2 * limbs * LANE_LIMB_BITS) % WORD_BITS));
+            FN(divModRange)(scratch, tmp, nR, &moduli[l], 0, nMod, NULL, 0, scratch, tmp + nR);
+            FN(laneFromRange)(r2, l, limbs, scratch, tmp + nR, nMod);
+
+            /* The reduced base goes to the accumulator for now. */
+            FN(divModRange)(&bases[l], 0, GETNWORDS(&bases[l]), &moduli[l], 0, nMod, NULL, 0, scratch, tmp);
+            FN(laneFromRange)(acc, l, limbs, scratch, tmp, nMod);
+
+            /* 1 in the selected entry for the conversion. */
+            for (j = 0; j < limbs; j++)
+            {
+                FN(laneSet)(sel, j, l, (WORD_TYPE)(j == 0));
+            }
+        }
+
+        /* table[e] = base^e in Montgomery form. */
+        FN(laneMontMulAvx2)(table, r2, sel, m, mInv, t, limbs);
+        FN(laneMontMulAvx2)(table + limbs * LANE_VECTOR_WORDS, acc, r2, m, mInv, t, limbs);
+        for (e = 2; e < entries; e++)
+        {
+            FN(laneMontMulAvx2)(
+                table + e * limbs * LANE_VECTOR_WORDS, table + (e - 1) * limbs * LANE_VECTOR_WORDS,
+                table + limbs * LANE_VECTOR_WORDS, m, mInv, t, limbs
+            );
+        }
+        for (i = 0; i < limbs * LANE_VECTOR_WORDS; i++)
+        {
+            acc[i] = table[i];
+        }
+
+        window = (nBits + MODPOW_LANES_WINDOW - 1) / MODPOW_LANES_WINDOW;
+        while (window --> 0)
+        {
+            size_t bit = window * MODPOW_LANES_WINDOW;
+            size_t any = 0;
+
+            for (l = 0; l < MODPOW_LANES; l++)
+            {
+                size_t nExpBits = GETNWORDS(&exponents[l]) * WORD_BITS;
+
+                digits[l] = 0;
+                for (i = bit + MODPOW_LANES_WINDOW; i --> bit;)
+                {
+                    digits[l] = (digits[l] << 1) | (size_t)(i < nExpBits ? FN(getBit)(&exponents[l], 0, i) : 0);
+                }
+                any |= digits[l];
+            }
+            if (!started && !any) continue;
+
+            if (started)
+            {
+                for (i = 0; i < MODPOW_LANES_WINDOW; i++)
+                {
+                    FN(laneMontMulAvx2)(acc, acc, acc, m, mInv, t, limbs);
+                }
+            }
+            FN(laneSelectAvx2)(sel, table, entries, limbs, digits);
+            FN(laneMontMulAvx2)(acc, acc, sel, m, mInv, t, limbs);
+            started = 1;
+        }
+
+        /* Back from Montgomery form. */
+        for (l = 0; l < MODPOW_LANES; l++)
+        {
+            for (j = 0; j < limbs; j++)
+            {
+                FN(laneSet)(sel, j, l, (WORD_TYPE)(j == 0));
+            }
+        }
+        FN(laneMontMulAvx2)(acc, acc, sel, m, mInv, t, limbs);
+
+        for (l = 0; l < MODPOW_LANES; l++)
+        {
+            SETNWORDS(&results[l], nMod);
+            FN(laneToRange)(acc, l, limbs, &results[l], 0, nMod);
+        }
 
-    /* Now apply the intermediates:*/
+        return 0;
+    }
+#endif
 
-    *resultHigh += FN(addDigit)(*resultLow, overlapping1 << HALF_WORD_BITS, resultLow);
-    *resultHigh += FN(addDigit)(*resultLow, overlapping2 << HALF_WORD_BITS, resultLow);
-    FN(addDigit)(*resultHigh, overlapping1 >> HALF_WORD_BITS, resultHigh);
-    FN(addDigit)(*resultHigh, overlapping2 >> HALF_WORD_BITS, resultHigh);
+    /* No vector unit or not all moduli are odd: one after the other. */
+    for (l = 0; l < MODPOW_LANES; l++)
+    {
+        SETNWORDS(&results[l], nMod);
+        FN(modPowRange)(&bases[l], &exponents[l], 0, GETNWORDS(&exponents[l]), &moduli[l], &results[l], 0, scratch, 0);
+    }
+
+    return 0;
 }
 
 
-SPECIFIER int FN(isZero)(const BIGINT_TYPE *x)
+/* Miller-Rabin test of the odd p > 2 with the witness w[wOff .. wOff + wLen). Returns non-zero if p may be prime.
+ * Uses mrTestRangeScratchSize(n) words of scratch at sOff, where n is the number of words in p. */
+SPECIFIER int FN(mrTestRange)(
+    const BIGINT_TYPE *p,
+    const BIGINT_TYPE *w, size_t wOff, size_t wLen,
+    BIGINT_TYPE *s, size_t sOff
+)
 {
-	size_t n = GETNWORDS(x);
+    /*
+        Let p - 1 = 2^k d, where d is odd. p passes the test if a^d ≡ 1 (mod p) or a^(2^i d) ≡ -1 (mod p) for some i < k.
+        For primes every witness passes, for composites at most 25% of them.
 
-	while (n --> 0)
-	{
-		if (GETWORD(x, n) != 0) return 0;
-	}
-	return 1;
-}
+        a^d is computed once, then it's squared k - 1 times, all in Montgomery form. Once the value is 1 it stays 1,
+        so reaching 1 without seeing -1 first means 1 has a square root other than ±1: p is composite.
 
+        Scratch layout: d, x, one, minus one, R^2, then the space for the exponentiation.
+    */
+    size_t n = GETNWORDS(p);
+    size_t d = sOff;
+    size_t x = d + n;
+    size_t one = x + n;
+    size_t minusOne = one + n;
+    size_t r2 = minusOne + n;
+    size_t windowOff = r2 + n;
+    size_t k, i, tmpOff;
+    WORD_TYPE mInv;
+    int borrow = 1;
+
+    /* d = (p - 1) / 2^k */
+    for (i = 0; i < n; i++)
+    {
+        WORD_TYPE tmp;
 
-SPECIFIER int FN(add)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
-{
-    size_t i;
-    int carry = 0;
-    WORD_TYPE r;
-    WORD_TYPE s;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA > nB ? nA : nB;
+        borrow = FN(subBorrow)(GETWORD(p, i), 0, borrow, &tmp);
+        SETWORD(s, d + i, tmp);
+    }
+    k = FN(trailingZerosRange)(s, d);
+    if (k == 0)
+    {
+        /* Even numbers are out of scope, but Montgomery multiplication would not work with them anyway. */
+        return 0;
+    }
+    FN(shrRange)(s, d, n, k);
 
-    SETNWORDS(result, n);
+    /* The window scratch is not used yet, it's fine as a temporary. */
+    FN(montSetupRange)(p, &mInv, s, r2, s, windowOff);
+    FN(slidingWindowRange)(w, wOff, wLen, s, d, n, p, 1, mInv, s, r2, s, x, s, windowOff);
 
+    /* Everything to Montgomery form: 1 is R mod p, -1 is p - R mod p. */
+    FN(montMulRange)(s, r2, NULL, 0, p, mInv, s, one);
+    borrow = 0;
     for (i = 0; i < n; i++)
     {
-        WORD_TYPE aWord = i < nA ? GETWORD(a, i) : 0;
-        WORD_TYPE bWord = i < nB ? GETWORD(b, i) : 0;
-        WORD_TYPE rWord;
+        WORD_TYPE tmp;
 
-        s = carry;
-        carry = FN(addDigit)(aWord, bWord, &r);
-        rWord = s + r;
-        if (rWord < s) carry = 1;
-        SETWORD(result, i, rWord);
+        borrow = FN(subBorrow)(GETWORD(p, i), GETWORD(s, one + i), borrow, &tmp);
+        SETWORD(s, minusOne + i, tmp);
     }
+    FN(montMulRange)(s, x, s, r2, p, mInv, s, windowOff);
 
-    return carry;
+    /* The squarings go back and forth between x and the window scratch. */
+    tmpOff = x;
+    x = windowOff;
+
+    if (FN(compareRange)(s, x, s, one, n) == 0 || FN(compareRange)(s, x, s, minusOne, n) == 0)
+    {
+        return 1;
+    }
+    for (i = 1; i < k; i++)
+    {
+        size_t swap;
+
+        FN(montMulRange)(s, x, s, x, p, mInv, s, tmpOff);
+        swap = x;
+        x = tmpOff;
+        tmpOff = swap;
+
+        if (FN(compareRange)(s, x, s, minusOne, n) == 0) return 1;
+        if (FN(compareRange)(s, x, s, one, n) == 0) return 0;
+    }
+
+    return 0;
 }
 
 
-SPECIFIER int FN(sub)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
+SPECIFIER size_t FN(mrTestRangeScratchSize)(size_t n)
 {
-    size_t i;
-    int borrow = 0;
-    WORD_TYPE r;
-    WORD_TYPE s;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA > nB ? nA : nB;
+    return 5*n + FN(slidingWindowScratchSize)(n);
+}
 
-    SETNWORDS(result, n);
 
-    for (i = 0; i < n; i++)
+/* Returns x[off .. off + n) mod divisor. */
+SPECIFIER WORD_TYPE FN(modWordRange)(const BIGINT_TYPE *x, size_t off, size_t n, WORD_TYPE divisor)
+{
+    WORD_TYPE quotient;
+    WORD_TYPE remainder = 0;
+
+    while (n --> 0)
     {
-        WORD_TYPE aWord = GETWORD(a, i);
-        WORD_TYPE bWord = GETWORD(b, i);
-        WORD_TYPE rWord;
+        FN(divDigit)(remainder, GETWORD(x, off + n), divisor, &quotient, &remainder);
+    }
 
-        s = borrow;
-        borrow = FN(subDigit)(aWord, bWord, &r);
-        rWord = r - s;
-        if (rWord > r) borrow = 1;
+    return remainder;
+}
 
-        SETWORD(result, i, rWord);
-    }
 
-    return borrow;
+SPECIFIER size_t FN(mrTestScratchSize)(size_t n)
+{
+    return FN(mrTestRangeScratchSize)(n);
 }
 
 
-SPECIFIER int FN(mul)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *result)
+SPECIFIER int FN(mrTestScratch)(
+    const BIGINT_TYPE *toTest,
+    const BIGINT_TYPE *witnessToTest,
+    BIGINT_TYPE *scratch
+)
 {
-    size_t i, j;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t nR = GETNWORDS(result);
-    int truncate = 0;
+    return FN(mrTestRange)(toTest, witnessToTest, 0, GETNWORDS(witnessToTest), scratch, 0);
+}
 
-    ZERO_BIGINT(result);
 
-    /* long multiplication algorithm. */
-    for (i = 0; i < nA; i++)
+/* Returns the i-th prime, i < SMALL_PRIME_COUNT. */
+SPECIFIER WORD_TYPE FN(smallPrime)(size_t i)
+{
+    static const unsigned char primes[SMALL_PRIME_COUNT] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+    };
+
+    return primes[i];
+}
+
+
+/* Trial division by the small primes. Returns zero if the number is composite (or less than 2), 1 if it's prime and -1 if
+ * it's still undecided, then *bits is set to its bit length. */
+SPECIFIER int FN(trialDivision)(const BIGINT_TYPE *toTest, size_t *bits)
+{
+    size_t n = FN(significantWordsRange)(toTest, 0, GETNWORDS(toTest));
+    size_t i;
+    WORD_TYPE top;
+
+    if (n == 0) return 0;
+    if (n == 1 && GETWORD(toTest, 0) < 2) return 0;
+
+    for (i = 0; i < SMALL_PRIME_COUNT; i++)
     {
-        for (j = 0; j < nB; j++)
+        if (FN(modWordRange)(toTest, 0, n, FN(smallPrime)(i)) == 0)
         {
-            size_t k = i + j;
-            WORD_TYPE aWord;
-            WORD_TYPE bWord;
-            WORD_TYPE high, low;
-            WORD_TYPE tmpLow, tmpHigh;
-            int carryToHigh, carryToHigher;
+            return n == 1 && GETWORD(toTest, 0) == FN(smallPrime)(i);
+        }
+    }
 
-            if (truncate && (k >= nR))
-            {
-                /* If we know we are truncating we don't need to care about what would go beyond the last word.. */
-                continue;
-            }
+    *bits = (n - 1) * WORD_BITS;
+    for (top = GETWORD(toTest, n - 1); top; top >>= 1) (*bits)++;
 
-            aWord = GETWORD(a, i);
-            bWord = GETWORD(b, j);
+    /* 131^2 has 15 bits, anything smaller without a small factor is prime. */
+    return *bits <= 14 ? 1 : -1;
+}
 
-            FN(mulDigit)(aWord, bWord, &high, &low);
 
-            if (k >= nR)
-            {
-                if (low != 0)
-                {
-                    /* The low word is nonzero and would go beyond the last word, this means truncation. */
-                    /*printf("Truncate low case.\n");*/
-                    truncate = 1;
-                }
-                continue;
-            }
-            carryToHigh = FN(addDigit)(GETWORD(result, k), low, &tmpLow);
-            SETWORD(result, k, tmpLow);
-            if (k + 1 >= nR)
-            {
-                if (!truncate && ((high != 0) || carryToHigh))
-                {
-                    /* We would carry a word or carry beyond the last word in the result this indicates truncation.*/
-                    /*printf("Truncation high case:  i: %d, j: %d, k: %d, nR: %d, carryToHigh: %08x, high: %08x, aWord: %08x, bWord: %08x\n",
-                        (int)i, (int)j, (int)k, (int)nR, carryToHigh, high, aWord, bWord);*/
-                    truncate = 1;
-                }
-                continue;
-            }
-            carryToHigher = FN(addDigit)(GETWORD(result, k + 1), high, &tmpHigh);
+SPECIFIER size_t FN(isProbablePrimeScratchSize)(size_t n)
+{
+    /* The witness, then the space for the tests. */
+    return 1 + FN(mrTestRangeScratchSize)(n);
+}
 
-            tmpHigh += carryToHigh;
-            if (carryToHigh)
-            {
-                /* Check if tmpHigh overflowed, this would indicate another carry higher. */
-                carryToHigher |= tmpHigh == 0;
-            }
 
-            SETWORD(result, k + 1, tmpHigh);
-            for (k = k + 2; (k < nR && carryToHigher); k++)
-            {
-                WORD_TYPE tmp = GETWORD(result, k) + carryToHigher;
+/* isProbablePrime with isProbablePrimeScratchSize(n) words of scratch at sOff. */
+SPECIFIER int FN(isProbablePrimeRange)(
+    const BIGINT_TYPE *toTest,
+    int rounds,
+    BIGINT_TYPE *s, size_t sOff
+)
+{
+    /*
+        Trial division by the small primes first, it rules out most of the composites cheaply.
+        Then Miller-Rabin tests with the first few primes as witnesses. The first 12 primes are enough to decide it for every
+        number below 3.18 * 10^23 (Sorenson and Webster), so it's deterministic for 64 bit numbers.
+    */
+    size_t bits, witnesses, i;
+    int decided = FN(trialDivision)(toTest, &bits);
 
-                carryToHigher = tmp == 0;
-                SETWORD(result, k, tmp);
-            }
-            if ((k == nR) && (carryToHigher))
-            {
-                /* We would carry to higher than the last word. This indicates truncation. */
-                /*printf("Truncation carryToHigher case. i: %d, j: %d, k: %d\n", (int)i, (int)j, (int)k);*/
-                truncate = 1;
-            }
-        }
+    if (decided >= 0) return decided;
+
+    if (bits <= 64)
+    {
+        witnesses = 12;
     }
-    return truncate;
+    else
+    {
+        witnesses = rounds < 1 ? 1 : rounds > SMALL_PRIME_COUNT ? SMALL_PRIME_COUNT : (size_t)rounds;
+    }
+
+    for (i = 0; i < witnesses; i++)
+    {
+        SETWORD(s, sOff, FN(smallPrime)(i));
+        if (!FN(mrTestRange)(toTest, s, sOff, 1, s, sOff + 1)) return 0;
+    }
+
+    return 1;
 }
 
 
-SPECIFIER void FN(shl)(const BIGINT_TYPE *in, BIGINT_TYPE *out, unsigned shiftAmount)
+SPECIFIER int FN(isProbablePrimeScratch)(
+    const BIGINT_TYPE *toTest,
+    int rounds,
+    BIGINT_TYPE *scratch
+)
 {
-    size_t dIndex = shiftAmount / WORD_BITS;
-    size_t dShift = shiftAmount % WORD_BITS;
-    size_t i = GETNWORDS(in);
+    return FN(isProbablePrimeRange)(toTest, rounds, scratch, 0);
+}
 
-    SETNWORDS(out, i);
 
-    if (dShift)
+/* r[rOff .. rOff + n) += value. Returns non-zero if the sum doesn't fit. */
+SPECIFIER int FN(addSizeRange)(BIGINT_TYPE *r, size_t rOff, size_t n, size_t value)
+{
+    size_t i;
+    int carry = 0;
+
+    for (i = 0; i < n && (value || carry); i++)
     {
-        while (i --> 0)
-        {
-            WORD_TYPE newWord = 0;
-            WORD_TYPE part;
+        WORD_TYPE w;
+
+        carry = FN(addCarry)(GETWORD(r, rOff + i), (WORD_TYPE)value, carry, &w);
+        SETWORD(r, rOff + i, w);
+        /* If the value fits into a word it's fully added, otherwise a word is narrower than a size_t, so the shift is fine. */
+        value = (size_t)(WORD_TYPE)value == value ? 0 : (value >> (WORD_BITS / 2)) >> (WORD_BITS / 2);
+    }
+
+    return carry || value;
+}
+
+
+/* The work of a nextPrime thread: in each round it takes an interval of NEXTPRIME_INTERVAL odd candidates, then the next
+ * interval is step candidates further. */
+typedef struct
+{
+    BIGINT_TYPE *candidate;
+    int rounds;
+    int sieve; /* Zero if the start is so small that a candidate can be one of the sieve primes. */
+    int found; /* Positive if the candidate is prime, negative if the candidates don't fit into the words of the start. */
+    size_t first; /* Candidate i of the interval is start + 2*(first + i). */
+    size_t step;
+    BIGINT_TYPE *scratch;
+    size_t start;
+    size_t primes;
+    size_t nPrimes;
+    size_t residues; /* start + 2*first modulo each sieve prime. */
+    size_t bits;
+    size_t sOff;
+} FN(NextPrimeJob);
+
+
+SPECIFIER void FN(nextPrimeRun)(FN(NextPrimeJob) *job)
+{
+    BIGINT_TYPE *s = job->scratch;
+    size_t n = GETNWORDS(job->candidate);
+    size_t bitWords = (NEXTPRIME_INTERVAL + WORD_BITS - 1) / WORD_BITS;
+    size_t i, j;
 
-            part = i >= dIndex ? GETWORD(in, i - dIndex) : 0;
-            newWord |= part << dShift;
+    job->found = 0;
 
-            part = i >= dIndex + 1 ? GETWORD(in, i - dIndex - 1) : 0;
-            newWord |= part >> (WORD_BITS - dShift);
+    /* Sieve: mark the candidates that are divisible by a small prime. Only the residues of the interval start are needed
+     * for that, then they are moved to the next interval of the thread. */
+    for (i = 0; i < bitWords; i++)
+    {
+        SETWORD(s, job->bits + i, 0);
+    }
+    for (i = 0; job->sieve && i < job->nPrimes; i++)
+    {
+        size_t p = (size_t)GETWORD(s, job->primes + i);
+        size_t r = (size_t)GETWORD(s, job->residues + i);
 
-            SETWORD(out, i, newWord);
+        /* Candidate j is divisible by p if r + 2j ≡ 0 (mod p), that's j ≡ -r/2. */
+        j = r == 0 ? 0 : (p - r) & 1 ? (2*p - r) / 2 : (p - r) / 2;
+        for (; j < NEXTPRIME_INTERVAL; j += p)
+        {
+            SETWORD(s, job->bits + j / WORD_BITS, GETWORD(s, job->bits + j / WORD_BITS) | (WORD_TYPE)1 << (j % WORD_BITS));
         }
+        SETWORD(s, job->residues + i, (WORD_TYPE)((r + 2*job->step % p) % p));
     }
-    else
+
+    /* Then the expensive tests on the candidates that remained, in order. */
+    for (j = 0; j < NEXTPRIME_INTERVAL; j++)
     {
-        /* Zero shift case can be simplified. Also we cam avoid out of range shifts. */
-        while (i --> 0)
+        if (GETWORD(s, job->bits + j / WORD_BITS) >> (j % WORD_BITS) & 1) continue;
+
+        FN(copyRange)(job->candidate, 0, n, s, job->start, n);
+        if (FN(addSizeRange)(job->candidate, 0, n, 2*(job->first + j)))
+        {
+            job->found = -1;
+            break;
+        }
+        if (FN(isProbablePrimeRange)(job->candidate, job->rounds, s, job->sOff))
         {
-            SETWORD(out, i, i >= dIndex ? GETWORD(in, i - dIndex) : 0);
+            job->found = 1;
+            break;
         }
     }
+
+    job->first += job->step;
 }
 
 
-SPECIFIER void FN(shr)(const BIGINT_TYPE *in, BIGINT_TYPE *out, unsigned shiftAmount)
+#ifdef THREAD_TYPE
+
+SPECIFIER THREAD_ENTRY(FN(nextPrimeThread), arg)
 {
-    size_t dIndex = shiftAmount / WORD_BITS;
-    size_t dShift = shiftAmount % WORD_BITS;
-    size_t i;
-    size_t n = GETNWORDS(in);
+    FN(nextPrimeRun)((FN(NextPrimeJob)*)arg);
+    THREAD_RETURN;
+}
 
-    SETNWORDS(out, n);
+#endif
 
-    if (dShift)
+
+SPECIFIER size_t FN(nextPrimeScratchSize)(size_t n, size_t threadCount)
+{
+    /* The odd start, the sieve primes, the residues of the start, then the residues, the sieve bits and the test scratch
+     * of each thread. */
+    size_t bitWords = (NEXTPRIME_INTERVAL + WORD_BITS - 1) / WORD_BITS;
+
+    return n + 2*NEXTPRIME_SIEVE_PRIMES +
+        FN(threadsToUse)(threadCount) * (NEXTPRIME_SIEVE_PRIMES + bitWords + FN(isProbablePrimeScratchSize)(n));
+}
+
+
+SPECIFIER int FN(nextPrimeScratch)(
+    const BIGINT_TYPE *start,
+    int rounds,
+    size_t threadCount,
+    BIGINT_TYPE *result,
+    BIGINT_TYPE *candidates,
+    BIGINT_TYPE *scratch
+)
+{
+    /*
+        The odd numbers from the start are split into intervals of NEXTPRIME_INTERVAL candidates. In each round thread t
+        takes interval round*threads + t. It sieves its interval with the small primes, then tests the remaining candidates
+        in order until it finds a prime. After the round the first thread (in the order of the intervals) that found one
+        has the smallest prime, so the result doesn't depend on the number of threads.
+
+        The residues of the start modulo the sieve primes are computed once, then each thread just keeps adding the
+        distance of its intervals to them. No big number division is needed for the candidates.
+    */
+    size_t n = GETNWORDS(start);
+    size_t threads = FN(threadsToUse)(threadCount);
+    size_t bitWords = (NEXTPRIME_INTERVAL + WORD_BITS - 1) / WORD_BITS;
+    size_t oddStart = 0;
+    size_t primes = n;
+    size_t startResidues = primes + NEXTPRIME_SIEVE_PRIMES;
+    size_t threadScratch = startResidues + NEXTPRIME_SIEVE_PRIMES;
+    size_t threadSize = NEXTPRIME_SIEVE_PRIMES + bitWords + FN(isProbablePrimeScratchSize)(n);
+    size_t maxPrime = (size_t)(WORD_TYPE)~(WORD_TYPE)0;
+    size_t nPrimes = 0;
+    size_t candidate, i, t;
+    FN(NextPrimeJob) jobs[MODPOW_BATCH_MAX_THREADS];
+#ifdef THREAD_TYPE
+    THREAD_TYPE handles[MODPOW_BATCH_MAX_THREADS];
+    int running[MODPOW_BATCH_MAX_THREADS];
+#endif
+
+    SETNWORDS(result, n);
+    for (t = 0; t < threads; t++)
     {
-        for (i = 0; i < n; i++)
+        SETNWORDS(&candidates[t], n);
+    }
+    if (!n) return 1;
+
+    /* 2 is the only even prime. */
+    if (FN(significantWordsRange)(start, 0, n) <= 1 && GETWORD(start, 0) <= 2)
+    {
+        FN(copyRange)(result, 0, n, NULL, 0, 0);
+        SETWORD(result, 0, 2);
+        return 0;
+    }
+
+    FN(copyRange)(scratch, oddStart, n, start, 0, n);
+    SETWORD(scratch, oddStart, GETWORD(scratch, oddStart) | 1);
+
+    /* The sieve primes, by trial division with the ones found so far. They must fit into a word. */
+    for (candidate = 3; nPrimes < NEXTPRIME_SIEVE_PRIMES && candidate <= maxPrime; candidate += 2)
+    {
+        for (i = 0; i < nPrimes; i++)
         {
-            WORD_TYPE newWord = 0;
-            WORD_TYPE part;
+            size_t p = (size_t)GETWORD(scratch, primes + i);
+
+            if (p * p > candidate)
+            {
+                i = nPrimes;
+                break;
+            }
+            if (candidate % p == 0) break;
+        }
+        if (i < nPrimes) continue;
 
-            part = i + dIndex < n ? GETWORD(in, i + dIndex) : 0;
-            newWord |= part >> dShift;
+        SETWORD(scratch, primes + nPrimes, (WORD_TYPE)candidate);
+        SETWORD(scratch, startResidues + nPrimes, FN(modWordRange)(scratch, oddStart, n, (WORD_TYPE)candidate));
+        nPrimes++;
+    }
 
-            part = i + dIndex + 1 < n ? GETWORD(in, i + dIndex + 1) : 0;
-            newWord |= part << (WORD_BITS - dShift);
+    for (t = 0; t < threads; t++)
+    {
+        jobs[t].candidate = &candidates[t];
+        jobs[t].rounds = rounds;
+        /* Below the square of the largest sieve prime the trial division of isProbablePrime decides it anyway. */
+        jobs[t].sieve = nPrimes > 0 && (
+            FN(significantWordsRange)(scratch, oddStart, n) > 1 ||
+            (size_t)GETWORD(scratch, oddStart) > (size_t)GETWORD(scratch, primes + nPrimes - 1)
+        );
+        jobs[t].first = t * NEXTPRIME_INTERVAL;
+        jobs[t].step = threads * NEXTPRIME_INTERVAL;
+        jobs[t].scratch = scratch;
+        jobs[t].start = oddStart;
+        jobs[t].primes = primes;
+        jobs[t].nPrimes = nPrimes;
+        jobs[t].residues = threadScratch + t*threadSize;
+        jobs[t].bits = jobs[t].residues + NEXTPRIME_SIEVE_PRIMES;
+        jobs[t].sOff = jobs[t].bits + bitWords;
+
+        for (i = 0; i < nPrimes; i++)
+        {
+            size_t p = (size_t)GETWORD(scratch, primes + i);
+            size_t r = (size_t)GETWORD(scratch, startResidues + i);
 
-            SETWORD(out, i, newWord);
+            SETWORD(scratch, jobs[t].residues + i, (WORD_TYPE)((r + 2*jobs[t].first % p) % p));
         }
     }
-    else
+
+    for (;;)
     {
-        /* Zero shift case can be simplified. Also we cam avoid out of range shifts. */
-        for (i = 0; i < n; i++)
+#ifdef THREAD_TYPE
+        /* The calling thread does the first interval. If a thread can't be started, its interval is done by the calling thread too. */
+        for (t = 1; t < threads; t++)
+        {
+            running[t] = THREAD_START(handles[t], FN(nextPrimeThread), &jobs[t]) == 0;
+        }
+        FN(nextPrimeRun)(&jobs[0]);
+        for (t = 1; t < threads; t++)
+        {
+            if (running[t])
+            {
+                THREAD_JOIN(handles[t]);
+            }
+            else
+            {
+                FN(nextPrimeRun)(&jobs[t]);
+            }
+        }
+#else
+        FN(nextPrimeRun)(&jobs[0]);
+#endif
+
+        for (t = 0; t < threads; t++)
         {
-            SETWORD(out, i, i + dIndex < n ? GETWORD(in, i + dIndex) : 0);
+            if (jobs[t].found > 0)
+            {
+                FN(copyRange)(result, 0, n, &candidates[t], 0, n);
+                return 0;
+            }
+            if (jobs[t].found < 0)
+            {
+                /* The larger candidates don't fit either. */
+                return 1;
+            }
         }
     }
 }
 
 
-SPECIFIER void FN(and)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+/* The Jacobi symbol (a/n) for odd n, by the binary algorithm: only shifts and subtractions. */
+SPECIFIER int FN(jacobiWord)(WORD_TYPE a, WORD_TYPE n)
 {
-    size_t i;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA < nB ? nA : nB;
-    size_t nMax = nA > nB ? nA : nB;
+    int result = 1;
 
-    for (i = 0; i < n; i++)
-    {
-        SETWORD(out,i, GETWORD(a, i) & GETWORD(b, i));
-    }
-    for (; i < nMax; i++)
+    while (a)
     {
-        SETWORD(out, i, 0);
+        /* (2/n) is -1 if n is 3 or 5 mod 8. */
+        while (!(a & 1))
+        {
+            a >>= 1;
+            if ((n & 7) == 3 || (n & 7) == 5) result = -result;
+        }
+        /* Quadratic reciprocity: (a/n) = -(n/a) if both are 3 mod 4. */
+        if (a < n)
+        {
+            WORD_TYPE tmp = a;
+
+            a = n;
+            n = tmp;
+            if ((a & 3) == 3 && (n & 3) == 3) result = -result;
+        }
+        a -= n;
     }
 
-    SETNWORDS(out, nMax);
+    return n == 1 ? result : 0;
 }
 
 
-SPECIFIER void FN(or)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+/* Returns non-zero if p is a perfect square. Uses 3n words of scratch at sOff, where n is the number of words in p. */
+SPECIFIER int FN(isSquareRange)(const BIGINT_TYPE *p, BIGINT_TYPE *s, size_t sOff)
 {
+    /* Newton's iteration x = (x + p/x) / 2 from above, it decreases until it reaches floor(sqrt(p)). */
+    size_t n = GETNWORDS(p);
+    size_t x = sOff;
+    size_t q = x + n;
+    size_t rem = q + n;
+    size_t bits = 0;
     size_t i;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA < nB ? nA : nB;
-    size_t nMax = nA > nB ? nA : nB;
-    const BIGINT_TYPE *longer = nA > nB ? a : b;
 
-    for (i = 0; i < n; i++)
+    for (i = n*WORD_BITS; i > 0; i--)
     {
-        SETWORD(out, i, GETWORD(a, i) | GETWORD(b, i));
+        if (FN(getBit)(p, 0, i - 1))
+        {
+            bits = i;
+            break;
+        }
     }
-    for (; i < nMax; i++)
+
+    FN(copyRange)(s, x, n, NULL, 0, 0);
+    SETWORD(s, x + (bits + 1) / 2 / WORD_BITS, (WORD_TYPE)1 << (bits + 1) / 2 % WORD_BITS);
+
+    for (;;)
     {
-        SETWORD(out, i, GETWORD(longer, i));
+        int carry;
+
+        FN(divModRange)(p, 0, n, s, x, n, s, q, s, rem);
+        carry = FN(addN)(s, q, s, q, s, x, n, 0);
+        FN(halveRange)(s, q, n);
+        if (carry)
+        {
+            SETWORD(s, q + n - 1, GETWORD(s, q + n - 1) | (WORD_TYPE)1 << (WORD_BITS - 1));
+        }
+        if (FN(compareRange)(s, q, s, x, n) >= 0) break;
+        FN(copyRange)(s, x, n, s, q, n);
     }
 
-    SETNWORDS(out, nMax);
+    /* x is floor(sqrt(p)) now. The square goes to the space of q and rem. */
+    FN(sqrRange)(s, x, n, s, q);
+    return FN(compareRange)(s, q, p, 0, n) == 0 && FN(significantWordsRange)(s, q + n, n) == 0;
 }
 
 
-SPECIFIER void FN(xor)(const BIGINT_TYPE *a, const BIGINT_TYPE *b, BIGINT_TYPE *out)
+/* s[r] = s[a] + s[b] mod m, or s[a] - s[b] if subtract is set. They are n word ranges below m, where n is the number of words in
+ * m. r can be the same as a or b. */
+SPECIFIER void FN(addModRange)(BIGINT_TYPE *s, size_t r, size_t a, size_t b, const BIGINT_TYPE *m, int subtract)
 {
-    size_t i;
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA < nB ? nA : nB;
-    size_t nMax = nA > nB ? nA : nB;
-    const BIGINT_TYPE *longer = nA > nB ? a : b;
+    size_t n = GETNWORDS(m);
 
-    for (i = 0; i < n; i++)
+    if (subtract)
     {
-        SETWORD(out, i, GETWORD(a, i) ^ GETWORD(b, i));
+        if (FN(subN)(s, r, s, a, s, b, n, 0))
+        {
+            FN(addN)(s, r, s, r, m, 0, n, 0);
+        }
     }
-    for (; i < nMax; i++)
+    else if (FN(addN)(s, r, s, a, s, b, n, 0) || FN(compareRange)(s, r, m, 0, n) >= 0)
     {
-        SETWORD(out, i, GETWORD(longer, i));
+        FN(subN)(s, r, s, r, m, 0, n, 0);
     }
-
-    SETNWORDS(out, nMax);
 }
 
 
-SPECIFIER int FN(lessThan)(const BIGINT_TYPE *a, const BIGINT_TYPE *b)
+/* s[r] = s[a] * v mod m for a small signed v, s[a] is below m. Uses n + 1 words of temporary at t, where n is the number of
+ * words in m. r can be the same as a. */
+SPECIFIER void FN(mulSmallModRange)(BIGINT_TYPE *s, size_t r, size_t a, long v, const BIGINT_TYPE *m, size_t t)
 {
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA > nB ? nA : nB;
+    size_t n = GETNWORDS(m);
 
-    while (n --> 0)
+    SETWORD(s, t + n, FN(mul1)(s, t, s, a, n, (WORD_TYPE)(v < 0 ? -v : v)));
+    FN(divModRange)(s, t, n + 1, m, 0, n, NULL, 0, s, r);
+    if (v < 0 && FN(significantWordsRange)(s, r, n))
     {
-        WORD_TYPE aWord = n < nA ? GETWORD(a, n) : 0;
-        WORD_TYPE bWord = n < nB ? GETWORD(b, n) : 0;
-
-        if (aWord < bWord) return 1;
-        if (aWord > bWord) return 0;
+        FN(subN)(s, r, m, 0, s, r, n, 0);
     }
-    return 0;
 }
 
 
-SPECIFIER int FN(equal)(const BIGINT_TYPE *a, const BIGINT_TYPE *b)
+/* Strong Lucas probable prime test of the odd p with the parameters P = 1 and Q = (1 - D) / 4, where (D/p) = -1.
+ * Returns non-zero if p passes. Uses 7n + 2 words of scratch at sOff, where n is the number of words in p. */
+SPECIFIER int FN(lucasTestRange)(const BIGINT_TYPE *p, long d, BIGINT_TYPE *s, size_t sOff)
 {
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
-    size_t n = nA > nB ? nA : nB;
+    /*
+        Let p + 1 = 2^k e with odd e. p passes if U_e ≡ 0 (mod p) or V_(2^i e) ≡ 0 (mod p) for some i < k.
 
-    while (n --> 0)
+        Only the V sequence is computed, by a ladder that keeps V_j and V_(j+1) from the top bit of e:
+            V_2j = V_j^2 - 2Q^j, V_(2j+1) = V_j V_(j+1) - P Q^j
+        That's three multiplications for each bit, including the one for Q^j. Then U_e comes from D U_e = 2V_(e+1) - P V_e,
+        as D is coprime to p, U_e ≡ 0 is the same as 2V_(e+1) ≡ V_e. Everything is kept in Montgomery form, the additions and
+        the multiplications by the small Q work the same way on that.
+
+        Scratch layout: e (n + 1 words), R^2, V_j, V_(j+1), Q^j, Q^(j+1), then a temporary of n + 1 words.
+    */
+    size_t n = GETNWORDS(p);
+    size_t e = sOff;
+    size_t r2 = e + n + 1;
+    size_t v0 = r2 + n;
+    size_t v1 = v0 + n;
+    size_t qj = v1 + n;
+    size_t qj1 = qj + n;
+    size_t t = qj1 + n;
+    size_t k, bit;
+    long q = (1 - d) / 4;
+    WORD_TYPE mInv;
+
+    /* e = (p + 1) / 2^k, it can have one more word than p. */
+    FN(copyRange)(s, e, n + 1, p, 0, n);
+    FN(addSizeRange)(s, e, n + 1, 1);
+    k = FN(trailingZerosRange)(s, e);
+    FN(shrRange)(s, e, n + 1, k);
+
+    /* The space of the sequences is not used yet, it's fine as a temporary. */
+    FN(montSetupRange)(p, &mInv, s, r2, s, v0);
+
+    /* j = 1: V_1 = P = 1, V_2 = P^2 - 2Q. */
+    FN(montMulRange)(s, r2, NULL, 0, p, mInv, s, v0);
+    FN(mulSmallModRange)(s, qj, v0, q, p, t);
+    FN(addModRange)(s, v1, v0, qj, p, 1);
+    FN(addModRange)(s, v1, v1, qj, p, 1);
+
+    bit = (n + 1) * WORD_BITS;
+    while (!FN(getBit)(s, e, bit - 1)) bit--;
+    while (--bit > 0)
     {
-        WORD_TYPE aWord = n < nA ? GETWORD(a, n) : 0;
-        WORD_TYPE bWord = n < nB ? GETWORD(b, n) : 0;
+        FN(montMulRange)(s, v0, s, v1, p, mInv, s, t);
+        if (FN(getBit)(s, e, bit - 1))
+        {
+            /* j -> 2j + 1 */
+            FN(addModRange)(s, v0, t, qj, p, 1);
+            FN(mulSmallModRange)(s, qj1, qj, q, p, t);
+            FN(montMulRange)(s, v1, s, v1, p, mInv, s, t);
+            FN(addModRange)(s, t, t, qj1, p, 1);
+            FN(addModRange)(s, v1, t, qj1, p, 1);
+            FN(montMulRange)(s, qj, s, qj1, p, mInv, s, t);
+        }
+        else
+        {
+            /* j -> 2j */
+            FN(addModRange)(s, v1, t, qj, p, 1);
+            FN(montMulRange)(s, v0, s, v0, p, mInv, s, t);
+            FN(addModRange)(s, t, t, qj, p, 1);
+            FN(addModRange)(s, v0, t, qj, p, 1);
+            FN(montMulRange)(s, qj, s, qj, p, mInv, s, t);
+        }
+        FN(copyRange)(s, qj, n, s, t, n);
+    }
+
+    FN(addModRange)(s, t, v1, v1, p, 0);
+    if (FN(compareRange)(s, t, s, v0, n) == 0) return 1;
 
-        if (aWord != bWord) return 0;
+    for (;;)
+    {
+        if (!FN(significantWordsRange)(s, v0, n)) return 1;
+        if (--k == 0) return 0;
+
+        FN(montMulRange)(s, v0, s, v0, p, mInv, s, t);
+        FN(addModRange)(s, t, t, qj, p, 1);
+        FN(addModRange)(s, v0, t, qj, p, 1);
+        FN(montMulRange)(s, qj, s, qj, p, mInv, s, t);
+        FN(copyRange)(s, qj, n, s, t, n);
     }
-    return 1;
 }
 
 
-SPECIFIER void FN(divMod)(
-    const BIGINT_TYPE *dividend,
-    const BIGINT_TYPE *divisor,
-    BIGINT_TYPE *quotient,
-    BIGINT_TYPE *remainder
+SPECIFIER size_t FN(isPrimeBPSWScratchSize)(size_t n)
+{
+    /* The Miller-Rabin test needs the most, with the witness. */
+    size_t mr = 1 + FN(mrTestRangeScratchSize)(n);
+    size_t lucas = 7*n + 2;
+
+    return mr > lucas ? mr : lucas;
+}
+
+
+SPECIFIER int FN(isPrimeBPSWScratch)(
+    const BIGINT_TYPE *toTest,
+    BIGINT_TYPE *scratch
 )
 {
-    size_t i;
-    size_t nD = GETNWORDS(dividend);
-    size_t nS = GETNWORDS(divisor);
+    /*
+        Baillie-PSW: a strong probable prime test to base 2 and a strong Lucas probable prime test with Selfridge's parameters:
+        D is the first of 5, -7, 9, -11, 13 ... for which the Jacobi symbol (D/p) is -1. The two tests have no known common
+        pseudoprime, there is none below 2^64.
+    */
+    size_t bits;
+    long d = 5;
+    int decided = FN(trialDivision)(toTest, &bits);
+    int tries;
 
-    i = 0;
-    if (quotient)
+    if (decided >= 0) return decided;
+
+    SETWORD(scratch, 0, 2);
+    if (!FN(mrTestRange)(toTest, scratch, 0, 1, scratch, 1)) return 0;
+
+    for (tries = 0;; tries++)
     {
-        ZERO_BIGINT(quotient);
+        /* (D/p) by reciprocity from (p mod |D| / |D|), the sign from the residues of D and p mod 4. */
+        WORD_TYPE absD = (WORD_TYPE)(d < 0 ? -d : d);
+        WORD_TYPE p0 = GETWORD(toTest, 0);
+        int jacobi = FN(jacobiWord)(FN(modWordRange)(toTest, 0, GETNWORDS(toTest), absD), absD);
+
+        if ((absD & 3) == 3 && (p0 & 3) == 3) jacobi = -jacobi;
+        if (d < 0 && (p0 & 3) == 3) jacobi = -jacobi;
+
+        if (jacobi == -1) break;
+        /* p has a common factor with D, and it's larger than D. */
+        if (jacobi == 0) return 0;
+
+        /* For squares there is no such D. They are rare, so it's only checked when the search takes long. */
+        if (tries == 8 && FN(isSquareRange)(toTest, scratch, 0)) return 0;
+
+        d = d < 0 ? 2 - d : -d - 2;
     }
-    ZERO_BIGINT(remainder);
 
-    if (quotient) {SETNWORDS(quotient, nD);}
-    SETNWORDS(remainder, nS);
+    return FN(lucasTestRange)(toTest, d, scratch, 0);
+}
 
-    i = nD;
 
-    while (i --> 0)
-    {
-        size_t j = WORD_BITS;
-        WORD_TYPE dividendWord = GETWORD(dividend, i);
-        WORD_TYPE quotientWord = 0;
+SPECIFIER size_t FN(lcmScratchSize)(size_t nA, size_t nB)
+{
+    /* The GCD, then the quotient and the remainder of a / gcd */
+    return FN(gcdScratchSize)(nA, nB) + nA + (nA > nB ? nA : nB);
+}
 
-        while (j --> 0)
-        {
-            /* Shift in the next digit of the dividend. */
-            FN(shl)(remainder, remainder, 1);
-            SETWORD(remainder, 0, GETWORD(remainder, 0) | !!(dividendWord & (1 << j)));
 
-            /* Check if we can add one to the output. */
+SPECIFIER void FN(lcmScratch)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *b,
+    BIGINT_TYPE *lcm,
+    BIGINT_TYPE *scratch
+)
+{
+    size_t nA = GETNWORDS(a);
+    size_t nB = GETNWORDS(b);
+    size_t n = nA > nB ? nA : nB;
+    size_t q = FN(gcdScratchSize)(nA, nB);
+    size_t r = q + nA;
+    size_t gcd = FN(gcdRange)(a, b, scratch, 0);
+    size_t i;
+
+    /* lcm = a / gcd * b */
+    FN(divModRange)(a, 0, nA, scratch, gcd, n, scratch, q, scratch, r);
 
-            if (!FN(lessThan)(remainder, divisor))
-            {
-                if (quotient) quotientWord |= 1 << j;
-                FN(sub)(remainder, divisor, remainder);
-            }
-        }
-        if (quotient) SETWORD(quotient, i, quotientWord);
+    SETNWORDS(lcm, nA + nB);
+    ZERO_BIGINT(lcm);
+    for (i = 0; i < nA; i++)
+    {
+        WORD_TYPE qWord = GETWORD(scratch, q + i);
+
+        if (qWord) SETWORD(lcm, i + nB, FN(addMul1)(lcm, i, b, 0, nB, qWord));
     }
 }
 
@@ -805,28 +6347,18 @@ SPECIFIER void FN(gcdEuclidean)(
     BIGINT_TYPE *gcd
 )
 {
-	BIGINT_TYPE high, low;
+    BIGINT_TYPE scratch;
 
-    INIT_EMPTY(&low);
-    INIT_EMPTY(&high);
-	COPY_BIGINT(&high, a);
-	COPY_BIGINT(&low, b);
+    INIT_EMPTY(gcd);
+    INIT_EMPTY(&scratch);
 
-	for (;;)
-	{
-		FN(divMod)(&high, &low, NULL, gcd);
-		if (FN(isZero(gcd)))
-		{
-			COPY_BIGINT(gcd, &low);
-			goto cleanup;
-		}
+    ALLOC_BIGINT(gcd, GETNWORDS(b));
+    ALLOC_BIGINT(&scratch, FN(gcdScratchSize)(GETNWORDS(a), GETNWORDS(b)));
+    FN(gcdScratch)(a, b, gcd, &scratch);
 
-		COPY_BIGINT(&high, &low);
-		COPY_BIGINT(&low, gcd);
-	}
+    goto cleanup;
 cleanup:
-	DEINIT_BIGINT(&high);
-	DEINIT_BIGINT(&low);
+    DEINIT_BIGINT(&scratch);
 }
 
 
@@ -838,95 +6370,86 @@ SPECIFIER void FN(gcdExtendedEuclidean)(
     BIGINT_TYPE *gcd
 )
 {
-	BIGINT_TYPE high, low;
-    BIGINT_TYPE highHighCoeff, highLowCoeff;
-    BIGINT_TYPE lowHighCoeff, lowLowCoeff;
-    BIGINT_TYPE remHighCoeff, remLowCoeff;
-    BIGINT_TYPE quotient;
-    BIGINT_TYPE tmp;
-
-    size_t nA = GETNWORDS(a);
-    size_t nB = GETNWORDS(b);
+    BIGINT_TYPE scratch;
 
     INIT_EMPTY(x);
     INIT_EMPTY(y);
     INIT_EMPTY(gcd);
-    INIT_EMPTY(&high);
-    INIT_EMPTY(&low);
-    INIT_EMPTY(&highHighCoeff);
-    INIT_EMPTY(&highLowCoeff);
-    INIT_EMPTY(&lowHighCoeff);
-    INIT_EMPTY(&lowLowCoeff);
-    INIT_EMPTY(&remHighCoeff);
-    INIT_EMPTY(&remLowCoeff);
-    INIT_EMPTY(&quotient);
-    INIT_EMPTY(&tmp);
-
-	COPY_BIGINT(&high, a);
-	COPY_BIGINT(&low, b);
-
-    ALLOC_BIGINT(&highHighCoeff, nB);
-    ALLOC_BIGINT(&lowHighCoeff, nB);
-    ALLOC_BIGINT(&remHighCoeff, nB);
-    ALLOC_BIGINT(gcd, nB);
-
-    ALLOC_BIGINT(&quotient, nA);
-    ALLOC_BIGINT(&highLowCoeff, nA);
-    ALLOC_BIGINT(&lowLowCoeff, nA);
-    ALLOC_BIGINT(&remLowCoeff, nA);
-
-    ZERO_BIGINT(&highLowCoeff);
-    ZERO_BIGINT(&lowLowCoeff);
-    ZERO_BIGINT(&remLowCoeff);
-    ZERO_BIGINT(&highHighCoeff);
-    ZERO_BIGINT(&lowHighCoeff);
-    ZERO_BIGINT(&remHighCoeff);
-
-    SETWORD(&highHighCoeff, 0, 1);
-    SETWORD(&lowLowCoeff, 0, 1);
-
-	for (;;)
-	{
-		FN(divMod)(&high, &low, &quotient, gcd);
-		if (FN(isZero(gcd)))
-		{
-			COPY_BIGINT(gcd, &low);
-            COPY_BIGINT(x, &lowHighCoeff);
-            COPY_BIGINT(y, &lowLowCoeff);
-			goto cleanup;
-		}
-
-        ALLOC_BIGINT(&tmp, GETNWORDS(&highHighCoeff));
-        FN(mul)(&quotient, &lowHighCoeff, &tmp);
-        FN(sub)(&highHighCoeff, &tmp, &remHighCoeff);
-
-        ALLOC_BIGINT(&tmp, GETNWORDS(&highLowCoeff));
-        FN(mul)(&quotient, &lowLowCoeff, &tmp);
-        FN(sub)(&highLowCoeff, &tmp, &remLowCoeff);
-
-
-		COPY_BIGINT(&high, &low);
-        COPY_BIGINT(&highHighCoeff, &lowHighCoeff);
-        COPY_BIGINT(&highLowCoeff, &lowLowCoeff);
-
-		COPY_BIGINT(&low, gcd);
-		COPY_BIGINT(&lowHighCoeff, &remHighCoeff);
-		COPY_BIGINT(&lowLowCoeff, &remLowCoeff);
-	}
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(x, GETNWORDS(b));
+    ALLOC_BIGINT(y, GETNWORDS(a));
+    ALLOC_BIGINT(gcd, GETNWORDS(b));
+    ALLOC_BIGINT(&scratch, FN(gcdExtendedScratchSize)(GETNWORDS(a), GETNWORDS(b)));
+    FN(gcdExtendedScratch)(a, b, x, y, gcd, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+}
+
+
+SPECIFIER int FN(modInverse)(
+    const BIGINT_TYPE *a,
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *result
+)
+{
+    BIGINT_TYPE scratch;
+    int retVal = -1;
+
+    INIT_EMPTY(result);
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(result, GETNWORDS(modulus));
+    ALLOC_BIGINT(&scratch, FN(modInverseScratchSize)(GETNWORDS(a), GETNWORDS(modulus)));
+    retVal = FN(modInverseScratch)(a, modulus, result, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return retVal;
+}
+
+
+SPECIFIER void FN(montCtxInit)(
+    const BIGINT_TYPE *modulus,
+    WORD_TYPE *mInv,
+    BIGINT_TYPE *r2
+)
+{
+    BIGINT_TYPE scratch;
+
+    INIT_EMPTY(r2);
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(r2, GETNWORDS(modulus));
+    ALLOC_BIGINT(&scratch, FN(montCtxScratchSize)(GETNWORDS(modulus)));
+    FN(montCtxInitScratch)(modulus, mInv, r2, &scratch);
+
+    goto cleanup;
 cleanup:
-    DEINIT_BIGINT(&highHighCoeff);
-    DEINIT_BIGINT(&lowHighCoeff);
-    DEINIT_BIGINT(&remHighCoeff);
-    DEINIT_BIGINT(&quotient);
+    DEINIT_BIGINT(&scratch);
+}
+
 
-    DEINIT_BIGINT(&highLowCoeff);
-    DEINIT_BIGINT(&lowLowCoeff);
-    DEINIT_BIGINT(&remLowCoeff);
+SPECIFIER void FN(barrettCtxInit)(
+    const BIGINT_TYPE *modulus,
+    BIGINT_TYPE *mu
+)
+{
+    BIGINT_TYPE scratch;
 
-	DEINIT_BIGINT(&high);
-	DEINIT_BIGINT(&low);
+    INIT_EMPTY(mu);
+    INIT_EMPTY(&scratch);
 
-    DEINIT_BIGINT(&tmp);
+    ALLOC_BIGINT(mu, FN(barrettK)(modulus) + 1);
+    ALLOC_BIGINT(&scratch, FN(barrettCtxScratchSize)(GETNWORDS(modulus)));
+    FN(barrettCtxInitScratch)(modulus, mu, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
 }
 
 
@@ -937,50 +6460,154 @@ SPECIFIER int FN(modPow)(
     BIGINT_TYPE *result
 )
 {
-    BIGINT_TYPE mulRes;
-    int canStart = 0;
+    BIGINT_TYPE scratch;
     int truncated = 0;
 
     INIT_EMPTY(result);
-    INIT_EMPTY(&mulRes);
+    INIT_EMPTY(&scratch);
 
     ALLOC_BIGINT(result, GETNWORDS(modulo));
-    ALLOC_BIGINT(&mulRes, 2*GETNWORDS(base));
+    ALLOC_BIGINT(&scratch, FN(modPowScratchSize)(GETNWORDS(modulo)));
+    truncated = FN(modPowScratch)(base, exponent, modulo, result, &scratch);
 
-    ZERO_BIGINT(result);
-    SETWORD(result, 0, 1);
+goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return truncated;
+}
+
+
+SPECIFIER int FN(modPowMont)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+)
+{
+    BIGINT_TYPE scratch;
+    int truncated = 0;
 
+    INIT_EMPTY(result);
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(result, GETNWORDS(modulo));
+    ALLOC_BIGINT(&scratch, FN(modPowMontScratchSize)(GETNWORDS(modulo)));
+    truncated = FN(modPowMontScratch)(base, exponent, modulo, result, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return truncated;
+}
+
+
+SPECIFIER int FN(modPowFixedWindow)(
+    const BIGINT_TYPE *base,
+    const BIGINT_TYPE *exponent,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+)
+{
+    BIGINT_TYPE scratch;
+    int truncated = 0;
+
+    INIT_EMPTY(result);
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(result, GETNWORDS(modulo));
+    ALLOC_BIGINT(&scratch, FN(modPowFixedWindowScratchSize)(GETNWORDS(modulo)));
+    truncated = FN(modPowFixedWindowScratch)(base, exponent, modulo, result, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return truncated;
+}
+
+
+SPECIFIER int FN(modPowBatch)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *results,
+    size_t n,
+    size_t threadCount
+)
+{
+    BIGINT_TYPE scratch;
+    size_t i;
+
+    for (i = 0; i < n; i++)
     {
-        size_t n = GETNWORDS(exponent);
+        INIT_EMPTY(&results[i]);
+    }
+    INIT_EMPTY(&scratch);
 
-        while (n --> 0)
-        {
-            size_t m = WORD_BITS;
-            WORD_TYPE expWord = GETWORD(exponent, n);
+    for (i = 0; i < n; i++)
+    {
+        ALLOC_BIGINT(&results[i], GETNWORDS(modulo));
+    }
+    ALLOC_BIGINT(&scratch, FN(modPowBatchScratchSize)(GETNWORDS(modulo), threadCount));
+    FN(modPowBatchScratch)(bases, exponents, modulo, results, n, threadCount, &scratch);
 
-            while (m --> 0)
-            {
-                if (expWord & (1 << m)) canStart = 1;
-                if (!canStart) continue;
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return 0;
+}
 
-                /* Square the number. */
-                truncated |= FN(mul)(result, result, &mulRes);
-                FN(divMod)(&mulRes, modulo, NULL, result);
 
-                /* Multiply*/
-                if (expWord & (1 << m))
-                {
-                    truncated |= FN(mul)(result, base, &mulRes);
-                    FN(divMod)(&mulRes, modulo, NULL, result);
-                }
-            }
-        }
+SPECIFIER int FN(multiModPow)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    size_t k,
+    const BIGINT_TYPE *modulo,
+    BIGINT_TYPE *result
+)
+{
+    BIGINT_TYPE scratch;
+
+    INIT_EMPTY(result);
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(result, GETNWORDS(modulo));
+    ALLOC_BIGINT(&scratch, FN(multiModPowScratchSize)(GETNWORDS(modulo), k));
+    FN(multiModPowScratch)(bases, exponents, k, modulo, result, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return 0;
+}
+
+
+SPECIFIER int FN(modPowLanes)(
+    const BIGINT_TYPE *bases,
+    const BIGINT_TYPE *exponents,
+    const BIGINT_TYPE *moduli,
+    BIGINT_TYPE *results
+)
+{
+    BIGINT_TYPE scratch;
+    size_t i;
+
+    for (i = 0; i < MODPOW_LANES; i++)
+    {
+        INIT_EMPTY(&results[i]);
     }
+    INIT_EMPTY(&scratch);
 
-goto cleanup;
+    for (i = 0; i < MODPOW_LANES; i++)
+    {
+        ALLOC_BIGINT(&results[i], GETNWORDS(&moduli[i]));
+    }
+    ALLOC_BIGINT(&scratch, FN(modPowLanesScratchSize)(GETNWORDS(&moduli[0])));
+    FN(modPowLanesScratch)(bases, exponents, moduli, results, &scratch);
+
+    goto cleanup;
 cleanup:
-    DEINIT_BIGINT(&mulRes);
-    return truncated;
+    DEINIT_BIGINT(&scratch);
+    return 0;
 }
 
 
@@ -989,79 +6616,99 @@ SPECIFIER int FN(mrTest)(
     const BIGINT_TYPE *witnessToTest
 )
 {
-    /* Here we perform the Miller-Rabin test:
-     *
-     * To test p (toTest) with a (withnessToTest)
-     * Let p-1 = 2^k d, where d is odd.
-     *
-     * Then if a^d ≡ 1 (mod p) OR a^{2^i d} ≡ -1 (mod p) (for any aplicable i), then there is 75% chance that p is prime.
-     *
-     * If it fails the test then p is definitely composite.
-     *
-     * For primes all `a` passes the test. For composite numbers only 25% of the numbers pass the test at most.
-     */
-    BIGINT_TYPE n;
-    BIGINT_TYPE pMinus1;
-    BIGINT_TYPE one;
-    BIGINT_TYPE modulus;
+    BIGINT_TYPE scratch;
+    int retVal = 0; /* Default assumption: composite. */
+
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(&scratch, FN(mrTestScratchSize)(GETNWORDS(toTest)));
+    retVal = FN(mrTestScratch)(toTest, witnessToTest, &scratch);
+
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return retVal;
+}
+
+SPECIFIER int FN(isProbablePrime)(
+    const BIGINT_TYPE *toTest,
+    int rounds
+)
+{
+    BIGINT_TYPE scratch;
     int retVal = 0; /* Default assumption: composite. */
 
-    INIT_EMPTY(&n);
-    INIT_EMPTY(&pMinus1);
-    INIT_EMPTY(&one);
-    INIT_EMPTY(&modulus);
+    INIT_EMPTY(&scratch);
 
-    COPY_BIGINT(&n, toTest);
+    ALLOC_BIGINT(&scratch, FN(isProbablePrimeScratchSize)(GETNWORDS(toTest)));
+    retVal = FN(isProbablePrimeScratch)(toTest, rounds, &scratch);
 
-    ALLOC_BIGINT(&one, GETNWORDS(&n));
-    ZERO_BIGINT(&one);
-    SETWORD(&one, 0, 1);
-    INIT_EMPTY(&modulus);
+    goto cleanup;
+cleanup:
+    DEINIT_BIGINT(&scratch);
+    return retVal;
+}
 
-    FN(sub)(&n, &one, &n); /* n = p - 1*/
-    INIT_EMPTY(&pMinus1);
-    COPY_BIGINT(&pMinus1, &n);
+SPECIFIER int FN(nextPrime)(
+    const BIGINT_TYPE *start,
+    int rounds,
+    size_t threadCount,
+    BIGINT_TYPE *result
+)
+{
+    BIGINT_TYPE scratch;
+    BIGINT_TYPE candidates[MODPOW_BATCH_MAX_THREADS];
+    size_t threads = FN(threadsToUse)(threadCount);
+    size_t t;
+    int notFound = 1;
 
-    /* Start with n = 2^{k-1}*d, then this loop go down till n = 2^d. */
-    do
+    INIT_EMPTY(result);
+    INIT_EMPTY(&scratch);
+    for (t = 0; t < threads; t++)
     {
-        FN(shr)(&n, &n, 1);
-        DEINIT_BIGINT(&modulus);
-        FN(modPow)(witnessToTest, &n, toTest, &modulus);
-        if (FN(equal)(&modulus, &pMinus1))
-        {
-            /* a^{2^i d} ≡ -1 (mod p). We have found a -1 modulus, the number may be prime. */
-            retVal = 1;
-            goto cleanup;
-        }
-        if (!FN(equal)(&modulus, &one))
-        {
-            /* If a^{2^j d} ≡ ±1 (mod p), for some j; then a^{2^i d} ≡ 1 (mod p) for i > j. Due to squaring.
-             * If this condition fails then that indicates that a^{2^j d} ≡ ±1 (mod p) cannot be true for any j.
-             * Thus indicating the number must be composite.
-             */
-            goto cleanup;
-        }
+        INIT_EMPTY(&candidates[t]);
+    }
+
+    ALLOC_BIGINT(result, GETNWORDS(start));
+    for (t = 0; t < threads; t++)
+    {
+        ALLOC_BIGINT(&candidates[t], GETNWORDS(start));
+    }
+    ALLOC_BIGINT(&scratch, FN(nextPrimeScratchSize)(GETNWORDS(start), threadCount));
+    notFound = FN(nextPrimeScratch)(start, rounds, threadCount, result, candidates, &scratch);
 
-    } while (!(GETWORD(&n, 0) & 1));
-    /* Finally try: a^d ≡ 1 (mod p), if it passes the number may be prime. */
-    DEINIT_BIGINT(&modulus);
-    FN(modPow)(witnessToTest, &n, toTest, &modulus);
-    if (FN(equal)(&modulus, &one))
+    goto cleanup;
+cleanup:
+    for (t = 0; t < threads; t++)
     {
-        retVal = 1;
-        goto cleanup;
+        DEINIT_BIGINT(&candidates[t]);
     }
+    DEINIT_BIGINT(&scratch);
+    return notFound;
+}
+
+SPECIFIER int FN(isPrimeBPSW)(
+    const BIGINT_TYPE *toTest
+)
+{
+    BIGINT_TYPE scratch;
+    int retVal = 0; /* Default assumption: composite. */
 
+    INIT_EMPTY(&scratch);
+
+    ALLOC_BIGINT(&scratch, FN(isPrimeBPSWScratchSize)(GETNWORDS(toTest)));
+    retVal = FN(isPrimeBPSWScratch)(toTest, &scratch);
+
+    goto cleanup;
 cleanup:
-    DEINIT_BIGINT(&n);
-    DEINIT_BIGINT(&one);
-    DEINIT_BIGINT(&modulus);
-    DEINIT_BIGINT(&pMinus1);
+    DEINIT_BIGINT(&scratch);
     return retVal;
 }
 
 
+
+
+
 SPECIFIER void FN(mulEx)(
     const BIGINT_TYPE *a,
     const BIGINT_TYPE *b,
@@ -1070,14 +6717,23 @@ SPECIFIER void FN(mulEx)(
 {
     size_t nA = GETNWORDS(a);
     size_t nB = GETNWORDS(b);
+    size_t scratchSize = FN(mulScratchSize)(nA, nB);
+    BIGINT_TYPE scratch;
 
     INIT_EMPTY(res);
+    INIT_EMPTY(&scratch);
     ALLOC_BIGINT(res, nA + nB);
 
-    FN(mul)(a, b, res);
+    if (scratchSize)
+    {
+        ALLOC_BIGINT(&scratch, scratchSize);
+    }
+
+    FN(mulScratch)(a, b, res, scratchSize ? &scratch : NULL);
 
     goto cleanup;
-cleanup:;
+cleanup:
+    DEINIT_BIGINT(&scratch);
 }
 
 
@@ -1087,31 +6743,20 @@ SPECIFIER void FN(lcm)(
     BIGINT_TYPE *lcm
 )
 {
-    BIGINT_TYPE gcd;
-    BIGINT_TYPE tmp, tmp2;
+    BIGINT_TYPE scratch;
 
-    FN(gcdEuclidean)(a, b, &gcd);
-    INIT_EMPTY(&tmp);
-    ALLOC_BIGINT(&tmp, GETNWORDS(a));
-    INIT_EMPTY(&tmp2);
-    ALLOC_BIGINT(&tmp2, GETNWORDS(&gcd));
+    INIT_EMPTY(lcm);
+    INIT_EMPTY(&scratch);
 
-    FN(divMod)(a, &gcd, &tmp, &tmp2);
-    FN(mulEx)(&tmp, b, lcm);
+    ALLOC_BIGINT(lcm, GETNWORDS(a) + GETNWORDS(b));
+    ALLOC_BIGINT(&scratch, FN(lcmScratchSize)(GETNWORDS(a), GETNWORDS(b)));
+    FN(lcmScratch)(a, b, lcm, &scratch);
 
     goto cleanup;
 cleanup:
-    DEINIT_BIGINT(&gcd);
-    DEINIT_BIGINT(&tmp);
-    DEINIT_BIGINT(&tmp2);
+    DEINIT_BIGINT(&scratch);
 }
 
-
-
-
-
-
-
 #endif
 
 #endif
@@ -1125,13 +6770,55 @@ cleanup:
 #undef SETWORD
 #undef GETNWORDS
 #undef SETNWORDS
+#undef DOUBLE_WORD_TYPE
+#undef USE_CARRY_BUILTINS
+#undef WORD_PTR
+#undef USE_SIMD
+#undef USE_MULX
+#undef SIMD_SLL_128
+#undef SIMD_SRL_128
+#undef SIMD_SLL_256
+#undef SIMD_SRL_256
+#undef SIMD_AVX2
+#undef LANE_LIMB_BITS
+#undef LANE_LIMB_MASK
+#undef LANE_VECTOR_WORDS
+#undef LANE_MAX_LIMBS
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef THREAD_TYPE
+#undef THREAD_ENTRY
+#undef THREAD_RETURN
+#undef THREAD_START
+#undef THREAD_JOIN
 #undef HALF_WORD_BITS
 #undef HALF_WORD_BASE
 #undef HALF_WORD_MASK
+#undef KARATSUBA_THRESHOLD
+#undef TOOM3_THRESHOLD
+#undef NTT_THRESHOLD
+#undef GCD_LEHMER_THRESHOLD
+#undef MODPOW_WINDOW
+#undef MODPOW_FIXED_WINDOW
+#undef MULTIMODPOW_WINDOW
+#undef MODPOW_LANES
+#undef MODPOW_LANES_WINDOW
+#undef MODPOW_BATCH_MAX_THREADS
+#undef NEXTPRIME_SIEVE_PRIMES
+#undef NEXTPRIME_INTERVAL
+#undef SMALL_PRIME_COUNT
+#undef NTT_PRIME_1
+#undef NTT_ROOT_1
+#undef NTT_PRIME_2
+#undef NTT_ROOT_2
+#undef NTT_PRIME_3
+#undef NTT_ROOT_3
+#undef NTT_MAX_LOG
 #undef NUM_THEORY
 #undef COPY_BIGINT
 #undef ALLOC_BIGINT
 #undef DUMP_BIGINT
+#undef GETUSEDWORDS
 #undef ZERO_BIGINT
 
 #undef DECLARE_STUFF
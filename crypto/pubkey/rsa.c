@@ -79,48 +79,375 @@ BigInt genSimpleBigint(uint32_t x)
 uint32_t one = 1;
 const BigInt g_one = {&one, 1};
 
+/* Allocating variants of the bigint functions for the macros of rsa.h. */
+void addEx(const BigInt *a, const BigInt *b, BigInt *out)
+{
+    size_t n = (a->n > b->n ? a->n : b->n) + 1;
+
+    out->words = NULL;
+    if (allocBigint(out, n)) abort();
+    memset(out->words, 0, n * sizeof(*out->words));
+    memcpy(out->words, a->words, a->n * sizeof(*a->words));
+    if (add(out, b, out)) abort();
+}
+
+void subEx(const BigInt *a, const BigInt *b, BigInt *out)
+{
+    out->words = NULL;
+    if (allocBigint(out, a->n > b->n ? a->n : b->n)) abort();
+    if (sub(a, b, out)) abort();
+}
+
+void modEx(const BigInt *a, const BigInt *m, BigInt *out)
+{
+    out->words = NULL;
+    if (allocBigint(out, m->n)) abort();
+    divMod(a, m, NULL, out);
+}
+
+int modInverseEx(const BigInt *a, const BigInt *m, BigInt *out)
+{
+    if (modInverse(a, m, out))
+    {
+        free(out->words);
+        return -1;
+    }
+    return 0;
+}
+
+/* Montgomery context for rsaPublic. */
+typedef struct
+{
+    const BigInt *modulus;
+    uint32_t mInv;
+    BigInt r2;
+} MontCtx;
+
+void montCtxCreate(MontCtx *ctx, const BigInt *modulus)
+{
+    ctx->modulus = modulus;
+    montCtxInit(modulus, &ctx->mInv, &ctx->r2);
+}
+
+void montEnter(const BigInt *a, const MontCtx *ctx, BigInt *out)
+{
+    BigInt padded = {NULL, 0};
+    size_t n = ctx->modulus->n;
+
+    /* The Montgomery functions need the input on as many words as the modulus. */
+    assert(a->n <= n);
+    if (allocBigint(&padded, n)) abort();
+    memset(padded.words, 0, n * sizeof(*padded.words));
+    memcpy(padded.words, a->words, a->n * sizeof(*a->words));
+
+    out->words = NULL;
+    if (allocBigint(out, n)) abort();
+    montToDomain(&padded, ctx->modulus, ctx->mInv, &ctx->r2, out);
+
+    free(padded.words);
+}
+
+void montAlloc(const MontCtx *ctx, BigInt *out)
+{
+    out->words = NULL;
+    if (allocBigint(out, ctx->modulus->n)) abort();
+}
+
+void montLeave(const BigInt *a, const MontCtx *ctx, BigInt *out)
+{
+    out->words = NULL;
+    if (allocBigint(out, ctx->modulus->n)) abort();
+    montFromDomain(a, ctx->modulus, ctx->mInv, out);
+}
+
 #define BIGNUM BigInt
 #define BIGNUM_RELEASE(bi) (free((bi)->words))
 #define MUL(a, b, out) mulEx(a, b, out)
-#define SUB(a, b, out) sub(a, b, out)
-#define XGCD(a, b, x, y, gcd) gcdExtendedEuclidean(a, b, x, y, gcd)
+#define SUB(a, b, out) subEx(a, b, out)
+#define ADD(a, b, out) addEx(a, b, out)
 #define LCM(a, b, out) lcm(a, b, out)
-#define EQUAL(a, b) equal(a, b)
+#define MOD(a, m, out) modEx(a, m, out)
+#define MODINV(a, m, out) modInverseEx(a, m, out)
+#define MODPOW(base, exp, m, out) modPowFixedWindow(base, exp, m, out)
 #define ONE (&g_one)
+#define MODCTX MontCtx
+#define MODCTX_ALLOC(ctx, out) montAlloc(ctx, out)
+#define MODCTX_ENTER(a, ctx, out) montEnter(a, ctx, out)
+#define MODCTX_MUL(a, b, ctx, out) montMul(a, b, (ctx)->modulus, (ctx)->mInv, out)
+#define MODCTX_LEAVE(a, ctx, out) montLeave(a, ctx, out)
 #define DECLARE_STUFF
 #define DEFINE_STUFF
 #include "crypto/pubkey/rsa.h"
 
+/* Fills the bigint with pseudo random words, the top bit is set. */
+void fillRandom(BigInt *bi, size_t n)
+{
+    size_t i;
+
+    bi->words = NULL;
+    if (allocBigint(bi, n)) abort();
+    for (i = 0; i < n; i++)
+    {
+        bi->words[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+    bi->words[n - 1] |= 0x80000000;
+}
+
 int main()
 {
+    int res;
+
     {
-        BigInt p = genSimpleBigint(61);
-        BigInt q = genSimpleBigint(53);
+        BigInt primes[2];
         BigInt e = genSimpleBigint(17);
         BigInt modulus;
         BigInt privkey;
-        int res;
+        BigInt exponents[2], coefficients[1];
+        MontCtx ctx;
+        uint32_t i;
 
-        res = rsaMakeKeys(&p, &q, &e, &modulus, &privkey);
+        primes[0] = genSimpleBigint(61);
+        primes[1] = genSimpleBigint(53);
+
+        res = rsaMakeKeys(primes, 2, &e, &privkey, &modulus);
         assert(res == 0);
         assert(modulus.n == 2);
-        assert(modulus.words[0] == 780);
+        assert(modulus.words[0] == 3233);
         assert(modulus.words[1] == 0);
-        assert(privkey.n == 2);
+        /* lcm(60, 52) = 780, 17 * 413 = 7021 = 9*780 + 1 */
         assert(privkey.words[0] == 413);
         assert(privkey.words[1] == 0);
+        free(modulus.words);
+        free(privkey.words);
+
+        res = rsaMakeCrtKeys(primes, 2, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == 0);
+        assert(modulus.words[0] == 3233);
+        assert(privkey.words[0] == 413);
+        assert(exponents[0].words[0] == 53);
+        assert(exponents[1].words[0] == 49);
+        assert(coefficients[0].words[0] == 38);
+
+        montCtxCreate(&ctx, &modulus);
+
+        /* Every input must give the same as the exponentiation modulo n. */
+        for (i = 0; i < 3233; i++)
+        {
+            BigInt c = genSimpleBigint(i);
+            BigInt ref, m;
+
+            res = modPow(&c, &privkey, &modulus, &ref);
+            assert(res == 0);
+            rsaPrivateCrt(&c, primes, 2, exponents, coefficients, &m);
+            assert(equal(&m, &ref));
+            free(m.words);
+
+            /* And back with the public key. */
+            rsaPublic(&ref, 17, &ctx, &m);
+            assert(equal(&m, &c));
+
+            free(c.words);
+            free(ref.words);
+            free(m.words);
+        }
+        for (i = 1; i < 40; i++)
+        {
+            BigInt c = genSimpleBigint(1234);
+            BigInt exp = genSimpleBigint(i);
+            BigInt ref, m;
+
+            /* Other exponents too. */
+            res = modPow(&c, &exp, &modulus, &ref);
+            assert(res == 0);
+            rsaPublic(&c, i, &ctx, &m);
+            assert(equal(&m, &ref));
+
+            free(c.words);
+            free(exp.words);
+            free(ref.words);
+            free(m.words);
+        }
+
+        free(ctx.r2.words);
+        free(modulus.words);
+        free(privkey.words);
+        for (i = 0; i < 2; i++)
+        {
+            free(exponents[i].words);
+            free(primes[i].words);
+        }
+        free(coefficients[0].words);
+        free(e.words);
+    }
+    {
+        BigInt primes[3];
+        BigInt e = genSimpleBigint(17);
+        BigInt modulus;
+        BigInt privkey;
+        BigInt exponents[3], coefficients[2];
+        uint32_t i;
+
+        primes[0] = genSimpleBigint(61);
+        primes[1] = genSimpleBigint(53);
+        primes[2] = genSimpleBigint(47);
+
+        /* n = 151951, lcm(60, 52, 46) = 17940, 17 * 10553 = 179401 = 10*17940 + 1 */
+        res = rsaMakeCrtKeys(primes, 3, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == 0);
+        assert(modulus.words[0] == 151951);
+        assert(privkey.words[0] == 10553);
+        assert(exponents[0].words[0] == 53);
+        assert(exponents[1].words[0] == 49);
+        assert(exponents[2].words[0] == 19);
+        assert(coefficients[0].words[0] == 38);
+        /* 3233 * 14 = 45262 = 963*47 + 1 */
+        assert(coefficients[1].words[0] == 14);
+
+        for (i = 0; i < 151951; i += 7)
+        {
+            BigInt c = genSimpleBigint(i);
+            BigInt ref, m;
+
+            res = modPow(&c, &privkey, &modulus, &ref);
+            assert(res == 0);
+            rsaPrivateCrt(&c, primes, 3, exponents, coefficients, &m);
+            assert(equal(&m, &ref));
+
+            free(c.words);
+            free(ref.words);
+            free(m.words);
+        }
+
+        free(modulus.words);
+        free(privkey.words);
+        for (i = 0; i < 3; i++)
+        {
+            free(exponents[i].words);
+            free(primes[i].words);
+        }
+        free(coefficients[0].words);
+        free(coefficients[1].words);
+        free(e.words);
+    }
+    {
+        BigInt primes[3];
+        BigInt e = genSimpleBigint(3);
+        BigInt modulus;
+        BigInt privkey;
+        BigInt exponents[3], coefficients[2];
+        int i;
+
+        primes[0] = genSimpleBigint(7);
+        primes[1] = genSimpleBigint(11);
+        primes[2] = genSimpleBigint(11);
+
+        /* 3 divides p - 1, so there is no private exponent. */
+        res = rsaMakeKeys(primes, 2, &e, &privkey, &modulus);
+        assert(res == -1);
+        res = rsaMakeCrtKeys(primes, 2, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == -1);
+
+        /* Not enough primes. */
+        e.words[0] = 7;
+        res = rsaMakeKeys(&primes[1], 1, &e, &privkey, &modulus);
+        assert(res == -1);
+        res = rsaMakeCrtKeys(&primes[1], 1, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == -1);
+
+        /* The same prime twice. */
+        res = rsaMakeKeys(&primes[1], 2, &e, &privkey, &modulus);
+        assert(res == -1);
+        res = rsaMakeCrtKeys(&primes[1], 2, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == -1);
+        primes[0].words[0] = 13;
+        res = rsaMakeKeys(primes, 3, &e, &privkey, &modulus);
+        assert(res == -1);
+        res = rsaMakeCrtKeys(primes, 3, &e, &privkey, &modulus, exponents, coefficients);
+        assert(res == -1);
+        primes[2].words[0] = 13;
+        res = rsaMakeKeys(primes, 3, &e, &privkey, &modulus);
+        assert(res == -1);
+
+        for (i = 0; i < 3; i++)
+        {
+            free(primes[i].words);
+        }
+        free(e.words);
+    }
+    {
+        BigInt e = genSimpleBigint(65537);
+        size_t primeCount;
+
+        srand(1);
+
+        /* About 1024 bit keys with 2, 3 and 4 primes. */
+        for (primeCount = 2; primeCount <= 4; primeCount++)
+        {
+            BigInt primes[4];
+            BigInt modulus;
+            BigInt privkey;
+            BigInt exponents[4], coefficients[3];
+            size_t primeWords = 32 / primeCount;
+            MontCtx ctx;
+            size_t i;
+
+            for (i = 0; i < primeCount; i++)
+            {
+                BigInt start;
+
+                fillRandom(&start, primeWords);
+                res = nextPrime(&start, 8, 1, &primes[i]);
+                assert(res == 0);
+                free(start.words);
+            }
+            res = rsaMakeCrtKeys(primes, primeCount, &e, &privkey, &modulus, exponents, coefficients);
+            assert(res == 0);
+            montCtxCreate(&ctx, &modulus);
+
+            for (i = 0; i < 10; i++)
+            {
+                BigInt msg, c, ref, m;
+
+                fillRandom(&msg, primeWords * primeCount - 1);
+                res = modPow(&msg, &e, &modulus, &c);
+                assert(res == 0);
+                res = modPow(&c, &privkey, &modulus, &ref);
+                assert(res == 0);
+                assert(equal(&ref, &msg));
+                rsaPrivateCrt(&c, primes, primeCount, exponents, coefficients, &m);
+                assert(equal(&m, &msg));
+                free(m.words);
 
+                rsaPublic(&msg, 65537, &ctx, &m);
+                assert(equal(&m, &c));
 
+                free(msg.words);
+                free(c.words);
+                free(ref.words);
+                free(m.words);
+            }
 
+            free(ctx.r2.words);
+            free(modulus.words);
+            free(privkey.words);
+            for (i = 0; i < primeCount; i++)
+            {
+                free(primes[i].words);
+                free(exponents[i].words);
+            }
+            for (i = 0; i + 1 < primeCount; i++)
+            {
+                free(coefficients[i].words);
+            }
+        }
 
-        free(p.words);
-        free(q.words);
         free(e.words);
     }
 
+    (void)res; /* Only read by the asserts. */
     printf("RSA OK. %s %s\n", __DATE__, __TIME__);
 
     return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
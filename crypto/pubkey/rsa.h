@@ -25,80 +25,429 @@
     #error Please define LCM(a, b, out) to calculate the least common multiple.
 #endif
 
-#ifndef XGCD/*(a, b, x, y, gcd)*/
-    /* This macro should solve ax + by = gcd(a,b) equation. Inputs: a,b. Outputs: x, y, gcd. Outputs are newly allocated.*/
-    #error Please define XGCD(a,b, x, y, gcd) as a way to run the extended euclidean algorithm.
+#ifndef ADD/*(a, b, result)*/
+    /* This macro should add two big numbers. Inputs: a,b. Output: result. Output is newly allocated, no overflow allowed. */
+    #error Please define ADD(a, b, result) to add big integers
 #endif
 
-#ifndef EQUAL/*(a,b)*/
-    /* Inputs: a,b. Returns non-zero if the two numbers are equal, zero otherwise. */
-    #error Please define EQUAL(a, b) to compare two big numbers.
+#ifndef MOD/*(a, m, out)*/
+    /* Inputs: a,m. Output: out = a mod m. Output is newly allocated. */
+    #error Please define MOD(a, m, out) to calculate the remainder.
+#endif
+
+#ifndef MODINV/*(a, m, out)*/
+    /* Inputs: a,m. Output: out = a^-1 mod m, less than m. Output is newly allocated.
+       Returns non-zero if a and m are not coprime, out is released or left unallocated then. */
+    #error Please define MODINV(a, m, out) to calculate the modular inverse.
+#endif
+
+#ifndef MODPOW/*(base, exp, m, out)*/
+    /* Inputs: base, exp, m. Output: out = base^exp mod m. Output is newly allocated.
+       It's used with private exponents, so it should be a side channel resistant implementation. */
+    #error Please define MODPOW(base, exp, m, out) to do modular exponentiation.
 #endif
 
 #ifndef ONE
     #error Please define ONE to be the pointer to a big integer representing 1.
 #endif
 
+/* The reduction context is only needed for rsaPublic, without MODCTX it's left out. */
+#ifdef MODCTX
+    /* MODCTX: A precomputed reduction context for the modulus, like a Montgomery or a Barrett context. */
+
+    #ifndef MODCTX_ALLOC/*(ctx, out)*/
+        /* Inputs: ctx. Output: out, a number with room for a number in the representation of the context. Its value is undefined.
+           Output is newly allocated. */
+        #error Please define MODCTX_ALLOC(ctx, out) to allocate a number for the reduction context.
+    #endif
+
+    #ifndef MODCTX_ENTER/*(a, ctx, out)*/
+        /* Inputs: a (less than the modulus), ctx. Output: out, a in the representation of the context (eg. Montgomery form).
+           Output is newly allocated. */
+        #error Please define MODCTX_ENTER(a, ctx, out) to convert a number to the representation of the reduction context.
+    #endif
+
+    #ifndef MODCTX_MUL/*(a, b, ctx, out)*/
+        /* Inputs: a, b, ctx. Output: out = a*b mod modulus in the representation of the context.
+           All of them are from MODCTX_ENTER or MODCTX_ALLOC. Nothing is allocated, out is not the same as the inputs. */
+        #error Please define MODCTX_MUL(a, b, ctx, out) to multiply with the reduction context.
+    #endif
+
+    #ifndef MODCTX_LEAVE/*(a, ctx, out)*/
+        /* Inputs: a, ctx. Output: out, a converted back to normal representation. Output is newly allocated. */
+        #error Please define MODCTX_LEAVE(a, ctx, out) to convert a number back from the representation of the reduction context.
+    #endif
+#endif
+
 #ifdef DECLARE_STUFF
 
 /**
  * Generates the private key and modulus from the provided arguments.
+ * More than two primes can be used for multi-prime RSA (RFC 8017), the modulus is the product of all of them.
  *
- * prime, prime2 (in): The two primes used for the generation.
+ * primes (in): Array of the primes used for the generation. They must be different, that's checked.
+ * primeCount (in): The number of primes, at least 2.
  * pubExponent (in): The public exponent to use.
  * privExponent (out): The private key calculated.
  * modulus (out): The modulus.
  *
  * Returns 0 on success.
- * Returns -1 if privExponent divides the modulus.
+ * Returns -1 if there are less than 2 primes, the same prime is given twice, or the pubExponent has no inverse modulo
+ * lcm(primes[0] - 1, primes[1] - 1, ...). The outputs are not allocated then.
  *
  * It will not check if the primes are really primes, it's assumed the caller verified them before calling this function.
  */
-SPECIFIER int FN(rsaMakeKeys)(const BIGNUM *prime1, const BIGNUM *prime2, const BIGNUM *pubExponent, BIGNUM *privExponent, BIGNUM *modulus);
+SPECIFIER int FN(rsaMakeKeys)(
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *pubExponent,
+    BIGNUM *privExponent,
+    BIGNUM *modulus
+);
+
+/**
+ * Generates the private key and modulus like rsaMakeKeys, and the parameters of rsaPrivateCrt as well.
+ *
+ * primes, primeCount, pubExponent (in): Like in rsaMakeKeys.
+ * privExponent, modulus (out): Like in rsaMakeKeys.
+ * exponents (out): Array of primeCount numbers: exponents[i] = privExponent mod (primes[i] - 1).
+ *                  For two primes these are dP and dQ.
+ * coefficients (out): Array of primeCount - 1 numbers: coefficients[0] = primes[1]^-1 mod primes[0] (qInv),
+ *                     then coefficients[i - 1] = (primes[0] * ... * primes[i - 1])^-1 mod primes[i] for i >= 2.
+ *
+ * Returns 0 on success.
+ * Returns -1 if rsaMakeKeys fails. The outputs are not allocated then.
+ */
+SPECIFIER int FN(rsaMakeCrtKeys)(
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *pubExponent,
+    BIGNUM *privExponent,
+    BIGNUM *modulus,
+    BIGNUM *exponents,
+    BIGNUM *coefficients
+);
+
+/**
+ * The private key operation (decryption or signing) with the Chinese remainder theorem.
+ *
+ * Instead of a single exponentiation modulo n, it does one for each prime with exponents[i]: m[i] = input^exponents[i] mod primes[i].
+ * Then they are combined with Garner's formula. For two primes: output = m[1] + primes[1] * (qInv * (m[0] - m[1]) mod primes[0]).
+ * Each further prime adds its own term in the same way, see RFC 8017.
+ * With two primes it's about 3-4 times faster than input^privExponent mod modulus, more primes make the exponentiations even smaller.
+ *
+ * input (in): The ciphertext or the message to sign. Must be less than the modulus.
+ * primes, primeCount, exponents, coefficients (in): The private key, as computed by rsaMakeCrtKeys.
+ * output (out): input^privExponent mod modulus. Output is newly allocated, it's less than the modulus.
+ */
+SPECIFIER void FN(rsaPrivateCrt)(
+    const BIGNUM *input,
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *exponents,
+    const BIGNUM *coefficients,
+    BIGNUM *output
+);
+
+#ifdef MODCTX
+
+/**
+ * The public key operation (encryption or signature verification) for small public exponents.
+ *
+ * It's a left to right binary exponentiation with the multiplications of the context, without any other allocation.
+ * For the usual 65537 that's 16 squarings and one multiplication.
+ *
+ * input (in): The message or the signature. Must be less than the modulus.
+ * pubExponent (in): The public exponent, must not be zero.
+ * ctx (in): The reduction context of the modulus. It should be created once per key and reused for every operation.
+ * output (out): input^pubExponent mod modulus. Output is newly allocated.
+ */
+SPECIFIER void FN(rsaPublic)(
+    const BIGNUM *input,
+    unsigned long pubExponent,
+    const MODCTX *ctx,
+    BIGNUM *output
+);
+
+#endif
 
 #endif
 
 #ifdef DEFINE_STUFF
 
-SPECIFIER int FN(rsaMakeKeys)(const BIGNUM *prime1, const BIGNUM *prime2, const BIGNUM *pubExponent, BIGNUM *privExponent, BIGNUM *modulus)
+SPECIFIER int FN(rsaMakeKeys)(
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *pubExponent,
+    BIGNUM *privExponent,
+    BIGNUM *modulus
+)
 {
     BIGNUM totient;
-    BIGNUM pM1, pM2;
-    BIGNUM k,gcd;
+    BIGNUM pM1, next;
+    size_t i, j;
     int retVal = 0;
 
-    MUL(prime1, prime2, modulus); /* n = pq*/
-    SUB(prime1, ONE, &pM1);
-    SUB(prime2, ONE, &pM2);
-    LCM(&pM1, &pM2, &totient); /* totient = lcm(p-1, q-1) */
+    if (primeCount < 2) return -1;
 
-    XGCD(pubExponent, &totient, privExponent, &k, &gcd);
+    /* A repeated prime gives a key that can't decrypt. The primes must be coprime, so each pair must have an inverse. */
+    for (i = 0; i < primeCount; i++)
+    {
+        for (j = i + 1; j < primeCount; j++)
+        {
+            if (MODINV(&primes[j], &primes[i], &next)) return -1;
+            BIGNUM_RELEASE(&next);
+        }
+    }
 
-    if (!EQUAL(&gcd, ONE))
+    MUL(&primes[0], &primes[1], modulus); /* n = pq*/
+    SUB(&primes[0], ONE, &totient);
+    for (i = 1; i < primeCount; i++)
+    {
+        if (i >= 2)
+        {
+            MUL(modulus, &primes[i], &next);
+            BIGNUM_RELEASE(modulus);
+            *modulus = next;
+        }
+
+        /* totient = lcm(p-1, q-1, ...) */
+        SUB(&primes[i], ONE, &pM1);
+        LCM(&totient, &pM1, &next);
+        BIGNUM_RELEASE(&totient);
+        BIGNUM_RELEASE(&pM1);
+        totient = next;
+    }
+
+    /* d = e^-1 mod totient. Reduced, so it's never negative like the x of the extended euclidean algorithm can be. */
+    if (MODINV(pubExponent, &totient, privExponent))
     {
         retVal = -1;
-        BIGNUM_RELEASE(privExponent);
         BIGNUM_RELEASE(modulus);
         goto cleanup;
     }
 
 cleanup:
     BIGNUM_RELEASE(&totient);
-    BIGNUM_RELEASE(&pM1);
-    BIGNUM_RELEASE(&pM2);
-    BIGNUM_RELEASE(&k);
     return retVal;
 }
 
+
+SPECIFIER int FN(rsaMakeCrtKeys)(
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *pubExponent,
+    BIGNUM *privExponent,
+    BIGNUM *modulus,
+    BIGNUM *exponents,
+    BIGNUM *coefficients
+)
+{
+    BIGNUM product, next, pM1;
+    size_t i;
+    size_t done = 0;
+    int retVal = 0;
+
+    if (FN(rsaMakeKeys)(primes, primeCount, pubExponent, privExponent, modulus))
+    {
+        return -1;
+    }
+
+    /* The primes are coprime, rsaMakeKeys checked them. */
+    if (MODINV(&primes[1], &primes[0], &coefficients[0]))
+    {
+        retVal = -1;
+        goto cleanup;
+    }
+    done = 1;
+
+    for (i = 2; i < primeCount; i++)
+    {
+        /* The product of the primes before this one. */
+        if (i == 2)
+        {
+            MUL(&primes[0], &primes[1], &product);
+        }
+        else
+        {
+            MUL(&product, &primes[i - 1], &next);
+            BIGNUM_RELEASE(&product);
+            product = next;
+        }
+
+        if (MODINV(&product, &primes[i], &coefficients[i - 1]))
+        {
+            retVal = -1;
+            break;
+        }
+        done = i;
+    }
+    if (primeCount > 2)
+    {
+        BIGNUM_RELEASE(&product);
+    }
+    if (retVal) goto cleanup;
+
+    for (i = 0; i < primeCount; i++)
+    {
+        SUB(&primes[i], ONE, &pM1);
+        MOD(privExponent, &pM1, &exponents[i]);
+        BIGNUM_RELEASE(&pM1);
+    }
+
+cleanup:
+    if (retVal)
+    {
+        for (i = 0; i < done; i++)
+        {
+            BIGNUM_RELEASE(&coefficients[i]);
+        }
+        BIGNUM_RELEASE(privExponent);
+        BIGNUM_RELEASE(modulus);
+    }
+    return retVal;
+}
+
+
+/* Garner's step: acc += product * (coefficient * (x - acc) mod prime), where x = input^exponent mod prime.
+ * So acc mod prime becomes x, while acc mod product stays the same. The new acc is newly allocated, the old one is released. */
+SPECIFIER void FN(rsaGarnerStep)(
+    const BIGNUM *x,
+    const BIGNUM *prime,
+    const BIGNUM *coefficient,
+    const BIGNUM *product,
+    BIGNUM *acc
+)
+{
+    BIGNUM accP, sum, diff, prod, h, hR, next;
+
+    /* Adding the prime keeps the difference positive, since x < prime. */
+    MOD(acc, prime, &accP);
+    ADD(x, prime, &sum);
+    SUB(&sum, &accP, &diff);
+    MUL(coefficient, &diff, &prod);
+    MOD(&prod, prime, &h);
+
+    MUL(&h, product, &hR);
+    ADD(&hR, acc, &next);
+    BIGNUM_RELEASE(acc);
+    *acc = next;
+
+    BIGNUM_RELEASE(&accP);
+    BIGNUM_RELEASE(&sum);
+    BIGNUM_RELEASE(&diff);
+    BIGNUM_RELEASE(&prod);
+    BIGNUM_RELEASE(&h);
+    BIGNUM_RELEASE(&hR);
+}
+
+
+SPECIFIER void FN(rsaPrivateCrt)(
+    const BIGNUM *input,
+    const BIGNUM *primes,
+    size_t primeCount,
+    const BIGNUM *exponents,
+    const BIGNUM *coefficients,
+    BIGNUM *output
+)
+{
+    BIGNUM m, product, next;
+    size_t i;
+
+    /* output = m2 + q * (qInv * (m1 - m2) mod p), less than pq, because the second term is at most (p - 1)q. */
+    MODPOW(input, &exponents[1], &primes[1], output);
+    MODPOW(input, &exponents[0], &primes[0], &m);
+    FN(rsaGarnerStep)(&m, &primes[0], &coefficients[0], &primes[1], output);
+    BIGNUM_RELEASE(&m);
+
+    /* Then output += r1 * ... * r(i-1) * (t(i) * (m(i) - output) mod r(i)) for the rest. */
+    for (i = 2; i < primeCount; i++)
+    {
+        if (i == 2)
+        {
+            MUL(&primes[0], &primes[1], &product);
+        }
+        else
+        {
+            MUL(&product, &primes[i - 1], &next);
+            BIGNUM_RELEASE(&product);
+            product = next;
+        }
+
+        MODPOW(input, &exponents[i], &primes[i], &m);
+        FN(rsaGarnerStep)(&m, &primes[i], &coefficients[i - 1], &product, output);
+        BIGNUM_RELEASE(&m);
+    }
+    if (primeCount > 2)
+    {
+        BIGNUM_RELEASE(&product);
+    }
+}
+
+
+#ifdef MODCTX
+
+SPECIFIER void FN(rsaPublic)(
+    const BIGNUM *input,
+    unsigned long pubExponent,
+    const MODCTX *ctx,
+    BIGNUM *output
+)
+{
+    BIGNUM x, acc, tmp;
+    BIGNUM *a = &x;
+    unsigned long bit = 1;
+
+    /* The top bit of the exponent is covered by starting from the input. */
+    while (bit <= pubExponent / 2) bit <<= 1;
+
+    /* The multiplications can't work in place, so the result goes back and forth between acc and tmp. */
+    MODCTX_ENTER(input, ctx, &x);
+    MODCTX_ALLOC(ctx, &acc);
+    MODCTX_ALLOC(ctx, &tmp);
+
+    for (bit >>= 1; bit; bit >>= 1)
+    {
+        BIGNUM *b = a == &acc ? &tmp : &acc;
+
+        MODCTX_MUL(a, a, ctx, b);
+        a = b;
+
+        if (pubExponent & bit)
+        {
+            b = a == &acc ? &tmp : &acc;
+            MODCTX_MUL(a, &x, ctx, b);
+            a = b;
+        }
+    }
+
+    MODCTX_LEAVE(a, ctx, output);
+
+    BIGNUM_RELEASE(&x);
+    BIGNUM_RELEASE(&acc);
+    BIGNUM_RELEASE(&tmp);
+}
+
+#endif
+
 #endif
 
 
 #include "meta/templatefooter.h"
 
 #undef BIGNUM
+#undef BIGNUM_RELEASE
 #undef MUL
 #undef SUB
-#undef XGCD
-#undef EQUAL
+#undef ADD
+#undef LCM
+#undef MOD
+#undef MODINV
+#undef MODPOW
 #undef ONE
+#undef MODCTX
+#undef MODCTX_ALLOC
+#undef MODCTX_ENTER
+#undef MODCTX_MUL
+#undef MODCTX_LEAVE
 